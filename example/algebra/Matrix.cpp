@@ -7,11 +7,291 @@
  **********************************************/
 #include "algebra/Matrix.h"
 #include "algebra/MatrixHelper.h"
+#include "algebra/MatrixView.h"
 #include "utils/Log.h"
 #include "limits.h"
+#include <cmath>
 
 using abcdl::algebra::Mat;
 
+//max error of mat to a * b summed in double, a and b any views
+template<class T>
+double gemm_error(const abcdl::algebra::Matrix<T>& mat,
+                  const abcdl::algebra::MatrixView<T>& a,
+                  const abcdl::algebra::MatrixView<T>& b){
+    if(mat.rows() != a.rows() || mat.cols() != b.cols()){
+        return 1e10;
+    }
+    double max_error = 0;
+    for(size_t i = 0; i != a.rows(); i++){
+        for(size_t j = 0; j != b.cols(); j++){
+            double sum = 0;
+            for(size_t p = 0; p != a.cols(); p++){
+                sum += (double)a.get_data(i, p) * b.get_data(p, j);
+            }
+            max_error = std::max(max_error, std::fabs(sum - mat.get_data(i, j)));
+        }
+    }
+    return max_error;
+}
+
+/*
+ * MatrixHelper::dot against a direct loop for every m, n, k of sizes
+ * around the register tile and the cache blocks, on whole matrices,
+ * transposed views and a column range of a wider matrix.
+ * The error is scaled by k, the length of every sum.
+ */
+template<class T>
+bool check_gemm(const double tolerance){
+    abcdl::algebra::MatrixHelper<T> helper;
+    const size_t sizes[] = {1, 3, 4, 5, 17, 33, 64, 100, 129};
+    double max_error = 0;
+    for(size_t m : sizes){
+        for(size_t n : sizes){
+            for(size_t k : sizes){
+                abcdl::algebra::RandomMatrix<T> a(m, k, 0, 1, -1, 1);
+                abcdl::algebra::RandomMatrix<T> b(k, n, 0, 1, -1, 1);
+                abcdl::algebra::MatrixView<T> view_a(a);
+                abcdl::algebra::MatrixView<T> view_b(b);
+                auto mat = helper.dot(a, b);
+                max_error = std::max(max_error, gemm_error(mat, view_a, view_b) / k);
+
+                abcdl::algebra::RandomMatrix<T> a_t(k, m, 0, 1, -1, 1);
+                abcdl::algebra::RandomMatrix<T> b_t(n, k, 0, 1, -1, 1);
+                auto view_a_t = abcdl::algebra::MatrixView<T>(a_t).transpose();
+                auto view_b_t = abcdl::algebra::MatrixView<T>(b_t).transpose();
+                mat = helper.dot(view_a_t, view_b_t);
+                max_error = std::max(max_error, gemm_error(mat, view_a_t, view_b_t) / k);
+
+                abcdl::algebra::RandomMatrix<T> a_wide(m, k + 3, 0, 1, -1, 1);
+                auto view_a_range = abcdl::algebra::MatrixView<T>(a_wide).col_range(1, k);
+                mat = helper.dot(view_a_range, view_b);
+                max_error = std::max(max_error, gemm_error(mat, view_a_range, view_b) / k);
+            }
+        }
+    }
+    bool passed = max_error <= tolerance;
+    printf("gemm %s max error / k %g, tolerance %g\n", sizeof(T) == sizeof(float) ? "float" : "double", max_error, tolerance);
+    return passed;
+}
+
+/*
+ * tanh_derivative takes a = tanh(z), not z, and returns 1 - a * a,
+ * checked against the central difference of tanh at z.
+ * 37 values leave a tail after every simd width.
+ */
+template<class T>
+bool check_tanh_derivative(const double tolerance){
+    abcdl::algebra::MatrixHelper<T> helper;
+    abcdl::algebra::RandomMatrix<T> z(1, 37, 0, 1, -3, 3);
+    abcdl::algebra::Matrix<T> a;
+    abcdl::algebra::Matrix<T> derivate;
+    helper.tanh(a, z);
+    helper.tanh_derivative(derivate, a);
+
+    const double epsilon = 1e-5;
+    double max_error = 0;
+    for(size_t i = 0; i != z.get_size(); i++){
+        double value = z.data()[i];
+        double gradient = (std::tanh(value + epsilon) - std::tanh(value - epsilon)) / (2 * epsilon);
+        max_error = std::max(max_error, std::fabs(gradient - derivate.data()[i]));
+    }
+    bool passed = max_error <= tolerance;
+    printf("tanh_derivative %s max error %g, tolerance %g\n", sizeof(T) == sizeof(float) ? "float" : "double", max_error, tolerance);
+    return passed;
+}
+
+//conv size and padding of one dimension as documented on MatrixHelper::conv_dim
+void direct_conv_dim(const size_t size,
+                     const size_t kernal_size,
+                     const size_t stride,
+                     const abcdl::algebra::Convn_type type,
+                     size_t* conv_size,
+                     size_t* padding){
+    if(type == abcdl::algebra::SAME){
+        *conv_size = (size + stride - 1) / stride;
+        size_t total = (*conv_size - 1) * stride + kernal_size;
+        *padding = total > size ? (total - size) / 2 : 0;
+        return;
+    }
+    *padding = type == abcdl::algebra::FULL ? kernal_size - 1 : 0;
+    size_t data_size = size + 2 * (*padding);
+    *conv_size = (data_size - kernal_size + stride - 1) / stride + 1;
+}
+
+//convn by the direct loop, positions out of mat read 0
+template<class T>
+void direct_convn(abcdl::algebra::Matrix<T>& result,
+                  const abcdl::algebra::Matrix<T>& mat,
+                  const abcdl::algebra::Matrix<T>& kernal,
+                  const abcdl::algebra::Convn_type type,
+                  const size_t stride = 1){
+    size_t rows = mat.rows();
+    size_t cols = mat.cols();
+    size_t kernal_row = kernal.rows();
+    size_t kernal_col = kernal.cols();
+    size_t conv_row, conv_col, pad_row, pad_col;
+    direct_conv_dim(rows, kernal_row, stride, type, &conv_row, &pad_row);
+    direct_conv_dim(cols, kernal_col, stride, type, &conv_col, &pad_col);
+
+    result.reset(0, conv_row, conv_col);
+    for(size_t i = 0; i != conv_row; i++){
+        for(size_t j = 0; j != conv_col; j++){
+            T sum = 0;
+            for(size_t k_i = 0; k_i != kernal_row; k_i++){
+                for(size_t k_j = 0; k_j != kernal_col; k_j++){
+                    size_t row = i * stride + k_i;
+                    size_t col = j * stride + k_j;
+                    if(row >= pad_row && row - pad_row < rows && col >= pad_col && col - pad_col < cols){
+                        sum += mat.get_data(row - pad_row, col - pad_col) * kernal.get_data(k_i, k_j);
+                    }
+                }
+            }
+            result.set_data(sum, i, j);
+        }
+    }
+}
+
+//max error of result to expected, the shapes must agree
+template<class T>
+double convn_error(const abcdl::algebra::Matrix<T>& result, const abcdl::algebra::Matrix<T>& expected){
+    if(result.rows() != expected.rows() || result.cols() != expected.cols()){
+        return 1e10;
+    }
+    double max_error = 0;
+    for(size_t i = 0; i != result.get_size(); i++){
+        max_error = std::max(max_error, (double)std::fabs(result.data()[i] - expected.data()[i]));
+    }
+    return max_error;
+}
+
+/*
+ * convn routed to MatrixFFT, large kernals of 5..16 rows and cols on
+ * data of 8..40, VALID, FULL and SAME at stride 1 and 2, against the
+ * direct loop. Every case that is_preferred sends to the fft is counted,
+ * the error is scaled by the kernal size, the length of every sum.
+ */
+template<class T>
+bool check_fft(const double tolerance){
+    abcdl::algebra::MatrixHelper<T> helper;
+    abcdl::algebra::Convn_type types[] = {abcdl::algebra::VALID, abcdl::algebra::FULL, abcdl::algebra::SAME};
+    const size_t sizes[] = {8, 13, 24, 40};
+    const size_t kernal_sizes[] = {5, 7, 12, 16};
+
+    size_t num_fft = 0;
+    double max_error = 0;
+    for(auto type : types){
+        for(size_t stride = 1; stride <= 2; stride++){
+            for(size_t rows : sizes){
+                for(size_t cols : sizes){
+                    for(size_t kernal_row : kernal_sizes){
+                        for(size_t kernal_col : kernal_sizes){
+                            if(type == abcdl::algebra::VALID && (kernal_row > rows || kernal_col > cols)){
+                                continue;
+                            }
+                            abcdl::algebra::RandomMatrix<T> mat(rows, cols, 0, 1, -1, 1);
+                            abcdl::algebra::RandomMatrix<T> kernal(kernal_row, kernal_col, 0, 1, -1, 1);
+                            abcdl::algebra::Matrix<T> result;
+                            abcdl::algebra::Matrix<T> expected;
+                            direct_convn(expected, mat, kernal, type, stride);
+                            if(!abcdl::algebra::MatrixFFT<T>::is_preferred(rows, cols, kernal_row, kernal_col, expected.rows(), expected.cols())){
+                                continue;
+                            }
+                            num_fft++;
+                            helper.convn(result, mat, kernal, stride, type);
+                            max_error = std::max(max_error, convn_error(result, expected) / (kernal_row * kernal_col));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    bool passed = num_fft != 0 && max_error <= tolerance;
+    printf("fft %s %zu cases max error / kernal size %g, tolerance %g\n", sizeof(T) == sizeof(float) ? "float" : "double", num_fft, max_error, tolerance);
+    return passed;
+}
+
+/*
+ * kernal spectra are cached by address: a second convn with the same
+ * kernal reuses the spectrum, a kernal changed in place is transformed
+ * again, a kernal at another address takes a new entry.
+ */
+template<class T>
+bool check_fft_cache(const double tolerance){
+    abcdl::algebra::MatrixFFT<T> fft;
+    const size_t rows = 32;
+    const size_t cols = 32;
+    abcdl::algebra::RandomMatrix<T> kernal(12, 12, 0, 1, -1, 1);
+    abcdl::algebra::RandomMatrix<T> other_kernal(12, 12, 0, 1, -1, 1);
+    size_t conv_row = rows - kernal.rows() + 1;
+    size_t conv_col = cols - kernal.cols() + 1;
+
+    bool passed = true;
+    double max_error = 0;
+    auto run = [&](const abcdl::algebra::Matrix<T>& kernal, const size_t cache_size){
+        abcdl::algebra::RandomMatrix<T> mat(rows, cols, 0, 1, -1, 1);
+        abcdl::algebra::Matrix<T> result(conv_row, conv_col);
+        abcdl::algebra::Matrix<T> expected;
+        fft.convn(result.data(), conv_row, conv_col, mat.data(), rows, cols, kernal.data(), kernal.rows(), kernal.cols(), 1, 0, 0);
+        direct_convn(expected, mat, kernal, abcdl::algebra::VALID);
+        max_error = std::max(max_error, convn_error(result, expected));
+        passed = passed && fft.get_cache_size() == cache_size;
+    };
+    run(kernal, 1);
+    //reused on new data
+    run(kernal, 1);
+    //updated in place, the cached copy no longer matches
+    for(size_t i = 0; i != kernal.get_size(); i++){
+        kernal.data()[i] = -kernal.data()[i] / 2;
+    }
+    run(kernal, 1);
+    run(other_kernal, 2);
+    fft.clear_cache();
+    run(kernal, 1);
+
+    passed = passed && max_error <= tolerance;
+    printf("fft cache %s cache size %zu max error %g, tolerance %g %s\n", sizeof(T) == sizeof(float) ? "float" : "double", fft.get_cache_size(), max_error, tolerance, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+/*
+ * 3 x 3 convn at stride 1 goes through winograd, F(4x4) when the result has
+ * a full 4 x 4 tile, F(2x2) otherwise. Compared to the direct loop for
+ * every size of 3..19 rows and cols, VALID, FULL and SAME.
+ */
+template<class T>
+bool check_winograd(const T tolerance){
+    abcdl::algebra::MatrixHelper<T> helper;
+    abcdl::algebra::RandomMatrix<T> kernal(3, 3, 0, 1, -1, 1);
+    abcdl::algebra::Convn_type types[] = {abcdl::algebra::VALID, abcdl::algebra::FULL, abcdl::algebra::SAME};
+    const char* names[] = {"VALID", "FULL", "SAME"};
+
+    bool passed = true;
+    for(size_t t = 0; t != 3; t++){
+        T max_error = 0;
+        for(size_t rows = 3; rows <= 19; rows++){
+            for(size_t cols = 3; cols <= 19; cols++){
+                abcdl::algebra::RandomMatrix<T> mat(rows, cols, 0, 1, -1, 1);
+                abcdl::algebra::Matrix<T> result;
+                abcdl::algebra::Matrix<T> expected;
+                helper.convn(result, mat, kernal, 1, types[t]);
+                direct_convn(expected, mat, kernal, types[t]);
+                if(result.rows() != expected.rows() || result.cols() != expected.cols()){
+                    printf("winograd %s %zux%zu: shape %zux%zu, expected %zux%zu\n", names[t], rows, cols, result.rows(), result.cols(), expected.rows(), expected.cols());
+                    passed = false;
+                    continue;
+                }
+                for(size_t i = 0; i != result.get_size(); i++){
+                    max_error = std::max(max_error, static_cast<T>(std::fabs(result.data()[i] - expected.data()[i])));
+                }
+            }
+        }
+        printf("winograd %s %s max error %g, tolerance %g\n", sizeof(T) == sizeof(float) ? "float" : "double", names[t], (double)max_error, (double)tolerance);
+        passed = passed && max_error <= tolerance;
+    }
+    return passed;
+}
+
 int main(int argc,char** argv){
     abcdl::utils::log::set_min_log_level(abcdl::utils::log::INFO);
     abcdl::utils::log::initialize_log(argc, argv);
@@ -43,4 +323,25 @@ int main(int argc,char** argv){
     m1.display();
     auto m4 = m2 * m1;
     m4.display();
+
+    bool passed = check_gemm<float>(1e-6);
+    passed = check_gemm<double>(1e-14) && passed;
+    printf("gemm check %s\n", passed ? "passed" : "failed");
+
+    bool tanh_passed = check_tanh_derivative<float>(1e-5);
+    tanh_passed = check_tanh_derivative<double>(1e-9) && tanh_passed;
+    printf("tanh_derivative check %s\n", tanh_passed ? "passed" : "failed");
+    passed = passed && tanh_passed;
+
+    bool fft_passed = check_fft<float>(1e-6);
+    fft_passed = check_fft<double>(1e-14) && fft_passed;
+    fft_passed = check_fft_cache<float>(1e-4) && fft_passed;
+    fft_passed = check_fft_cache<double>(1e-12) && fft_passed;
+    printf("fft check %s\n", fft_passed ? "passed" : "failed");
+    passed = passed && fft_passed;
+
+    bool winograd_passed = check_winograd<float>(1e-4f);
+    winograd_passed = check_winograd<double>(1e-10) && winograd_passed;
+    printf("winograd check %s\n", winograd_passed ? "passed" : "failed");
+    return passed && winograd_passed ? 0 : 1;
 }
@@ -0,0 +1,242 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 22:00
+ * Last modified : 2026-10-17 22:00
+ * Filename      : pool_gradient.cpp
+ * Description   : pooling against direct loops and finite differences
+ **********************************************/
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include "framework/Pool.h"
+#include "algebra/MatrixKernel.h"
+#include "utils/Log.h"
+
+using abcdl::algebra::Tensor;
+
+std::default_random_engine random_engine(17);
+
+//uniform values of [min, max), or integers of [min, max) for ties
+void fill(Tensor<real>& tensor, const real min, const real max, const bool integer = false){
+    std::uniform_real_distribution<real> distribution(min, max);
+    for(size_t i = 0; i != tensor.get_size(); i++){
+        real value = distribution(random_engine);
+        tensor.data()[i] = integer ? std::floor(value) : value;
+    }
+}
+
+real max_error(const Tensor<real>& a, const Tensor<real>& b){
+    if(a.get_size() != b.get_size()){
+        return 1e10;
+    }
+    real error = 0;
+    for(size_t i = 0; i != a.get_size(); i++){
+        error = std::max(error, std::fabs(a.data()[i] - b.data()[i]));
+    }
+    return error;
+}
+
+/*
+ * pool and delta by the direct loop over every window, Mean(0), Max(1) and L2(2).
+ * A max tie goes to the first column of the window, then the first row,
+ * the order of the row-then-column reduction of MaxPooling.
+ */
+void direct_pool(Tensor<real>& pool,
+                 Tensor<real>& delta,
+                 const Tensor<real>& tensor,
+                 const Tensor<real>& pool_delta,
+                 const size_t scale,
+                 const int type){
+    size_t rows = tensor.rows() / scale;
+    size_t cols = tensor.cols() / scale;
+    pool.resize(tensor.num(), tensor.channels(), rows, cols);
+    delta.resize(tensor.num(), tensor.channels(), tensor.rows(), tensor.cols());
+    delta.reset(0);
+    for(size_t n = 0; n != tensor.num(); n++){
+        for(size_t c = 0; c != tensor.channels(); c++){
+            for(size_t j = 0; j != rows; j++){
+                for(size_t k = 0; k != cols; k++){
+                    real sum = 0;
+                    real square_sum = 0;
+                    size_t max_row = j * scale;
+                    size_t max_col = k * scale;
+                    for(size_t col = k * scale; col != (k + 1) * scale; col++){
+                        for(size_t row = j * scale; row != (j + 1) * scale; row++){
+                            real value = tensor.get_data(n, c, row, col);
+                            sum += value;
+                            square_sum += value * value;
+                            if(value > tensor.get_data(n, c, max_row, max_col)){
+                                max_row = row;
+                                max_col = col;
+                            }
+                        }
+                    }
+                    real value = type == 0 ? sum / (scale * scale) : type == 1 ? tensor.get_data(n, c, max_row, max_col) : std::sqrt(square_sum);
+                    pool.get_data(n, c, j, k) = value;
+
+                    real back = pool_delta.get_data(n, c, j, k);
+                    for(size_t row = j * scale; row != (j + 1) * scale; row++){
+                        for(size_t col = k * scale; col != (k + 1) * scale; col++){
+                            if(type == 0){
+                                delta.get_data(n, c, row, col) = back / (scale * scale);
+                            }else if(type == 1){
+                                delta.get_data(n, c, row, col) = row == max_row && col == max_col ? back : 0;
+                            }else{
+                                delta.get_data(n, c, row, col) = value == 0 ? 0 : back * tensor.get_data(n, c, row, col) / value;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+//sum of pool * weight, its derivative to pool is weight
+real loss(abcdl::framework::Pooling* pooling,
+          const Tensor<real>& tensor,
+          const Tensor<real>& weight,
+          const size_t scale){
+    Tensor<real> pool;
+    pooling->pool(pool, tensor, scale);
+    real value = 0;
+    for(size_t i = 0; i != pool.get_size(); i++){
+        value += pool.data()[i] * weight.data()[i];
+    }
+    return value;
+}
+
+/*
+ * forward and backward against direct_pool, then backward against the
+ * central difference of loss for every value of tensor, values past the
+ * last full window take no delta. ties is a tensor of small integers.
+ */
+bool check_pooling(const char* name,
+                   abcdl::framework::Pooling* pooling,
+                   const int type,
+                   const size_t rows,
+                   const size_t cols,
+                   const size_t scale,
+                   const bool ties){
+    Tensor<real> tensor(2, 3, rows, cols);
+    fill(tensor, ties ? 0 : -1, ties ? 3 : 1, ties);
+    Tensor<real> pool;
+    pooling->pool(pool, tensor, scale);
+    Tensor<real> weight(pool.num(), pool.channels(), pool.rows(), pool.cols());
+    fill(weight, -1, 1);
+    Tensor<real> delta(2, 3, rows, cols);
+    pooling->backward(delta, weight, tensor, pool, scale);
+
+    Tensor<real> expected_pool;
+    Tensor<real> expected_delta;
+    direct_pool(expected_pool, expected_delta, tensor, weight, scale, type);
+    real pool_error = max_error(pool, expected_pool);
+    real delta_error = max_error(delta, expected_delta);
+    bool passed = pool_error <= 1e-12 && delta_error <= 1e-12;
+
+    //a tie has no derivative, the difference is only taken on distinct values
+    real gradient_error = 0;
+    if(!ties){
+        const real epsilon = 1e-6;
+        for(size_t i = 0; i != tensor.get_size(); i++){
+            real value = tensor.data()[i];
+            tensor.data()[i] = value + epsilon;
+            real loss_plus = loss(pooling, tensor, weight, scale);
+            tensor.data()[i] = value - epsilon;
+            real loss_minus = loss(pooling, tensor, weight, scale);
+            tensor.data()[i] = value;
+            real gradient = (loss_plus - loss_minus) / (2 * epsilon);
+            gradient_error = std::max(gradient_error, std::fabs(gradient - delta.data()[i]));
+        }
+        passed = passed && gradient_error <= 1e-8;
+    }
+    printf("  %s %zux%zu scale %zu%s: pool error %g, delta error %g, gradient error %g %s\n",
+           name, rows, cols, scale, ties ? " ties" : "", (double)pool_error, (double)delta_error, (double)gradient_error, passed ? "ok" : "FAILED");
+    delete pooling;
+    return passed;
+}
+
+/*
+ * max_index and square_add of the instruction set picked at startup against
+ * the scalar loop for every size up to 67, past the tail of any simd width.
+ * Half the values of a tie with c, a tie keeps the index.
+ */
+template<class T>
+bool check_kernel(){
+    std::uniform_int_distribution<int> distribution(-4, 4);
+    T max_index_error = 0;
+    T square_add_error = 0;
+    for(size_t size = 1; size <= 67; size++){
+        std::vector<T> a(size), c(size), index(size), expected_c(size), expected_index(size);
+        for(size_t i = 0; i != size; i++){
+            a[i] = distribution(random_engine) / (T)2;
+            c[i] = i % 2 == 0 ? a[i] : distribution(random_engine) / (T)2;
+            index[i] = i % 3;
+        }
+
+        expected_c = c;
+        expected_index = index;
+        for(size_t i = 0; i != size; i++){
+            if(a[i] > expected_c[i]){
+                expected_c[i] = a[i];
+                expected_index[i] = 7;
+            }
+        }
+        std::vector<T> max_c = c;
+        abcdl::algebra::MatrixKernel<T>::max_index(max_c.data(), index.data(), a.data(), (T)7, size);
+        for(size_t i = 0; i != size; i++){
+            max_index_error = std::max(max_index_error, std::fabs(max_c[i] - expected_c[i]) + std::fabs(index[i] - expected_index[i]));
+        }
+
+        for(size_t i = 0; i != size; i++){
+            expected_c[i] = c[i] + a[i] * a[i];
+        }
+        abcdl::algebra::MatrixKernel<T>::square_add(c.data(), a.data(), size);
+        for(size_t i = 0; i != size; i++){
+            square_add_error = std::max(square_add_error, std::fabs(c[i] - expected_c[i]));
+        }
+    }
+    //values are halves, every sum is exact
+    bool passed = max_index_error == 0 && square_add_error == 0;
+    printf("  %s max_index error %g, square_add error %g %s\n",
+           sizeof(T) == sizeof(float) ? "float" : "double", (double)max_index_error, (double)square_add_error, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+int main(int argc, char** argv){
+    abcdl::utils::log::set_min_log_level(abcdl::utils::log::INFO);
+    abcdl::utils::log::initialize_log(argc, argv);
+
+    const char* simd_names[] = {"none", "sse4.2", "avx2", "avx512"};
+    abcdl::algebra::Simd_type simd_type = abcdl::algebra::MatrixKernel<real>::get_simd_type();
+    printf("simd %s\n", simd_names[simd_type]);
+
+    bool passed = check_kernel<float>();
+    passed = check_kernel<double>() && passed;
+
+    //8 x 6 is full windows of 2, 7 x 9 leaves a row and a column past them
+    passed = check_pooling("Mean", new abcdl::framework::MeanPooling(), 0, 8, 6, 2, false) && passed;
+    passed = check_pooling("Mean", new abcdl::framework::MeanPooling(), 0, 7, 9, 2, false) && passed;
+    passed = check_pooling("Mean", new abcdl::framework::MeanPooling(), 0, 7, 11, 3, false) && passed;
+    passed = check_pooling("Max", new abcdl::framework::MaxPooling(), 1, 8, 6, 2, false) && passed;
+    passed = check_pooling("Max", new abcdl::framework::MaxPooling(), 1, 7, 9, 2, false) && passed;
+    passed = check_pooling("Max", new abcdl::framework::MaxPooling(), 1, 7, 11, 3, false) && passed;
+    passed = check_pooling("Max", new abcdl::framework::MaxPooling(), 1, 8, 6, 2, true) && passed;
+    passed = check_pooling("Max", new abcdl::framework::MaxPooling(), 1, 7, 11, 3, true) && passed;
+    passed = check_pooling("L2", new abcdl::framework::L2Pooling(), 2, 8, 6, 2, false) && passed;
+    passed = check_pooling("L2", new abcdl::framework::L2Pooling(), 2, 7, 9, 2, false) && passed;
+    passed = check_pooling("L2", new abcdl::framework::L2Pooling(), 2, 7, 11, 3, false) && passed;
+
+    //the kernel table is fixed at startup, every lower instruction set runs in its own process
+    if(getenv("ABCDL_SIMD") == nullptr){
+        for(int type = abcdl::algebra::SIMD_NONE; type < simd_type; type++){
+            setenv("ABCDL_SIMD", simd_names[type], 1);
+            passed = std::system((std::string("\"") + argv[0] + "\"").c_str()) == 0 && passed;
+        }
+    }
+
+    printf("pool check %s %s\n", simd_names[simd_type], passed ? "passed" : "failed");
+    return passed ? 0 : 1;
+}
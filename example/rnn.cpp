@@ -47,9 +47,10 @@ int main(int argc, char** argv){
 	//helper.read_word2index("data/rnn/word_to_index", map);
 
     const size_t sample_size = 1000;
-	abcdl::algebra::MatSet data_seq_data;
-	abcdl::algebra::MatSet data_seq_label;
-	if(!helper.read_seq_data("data/rnn/train_seq_data", data_seq_data, "data/rnn/train_seq_label", data_seq_label, sample_size)){
+	//word indices, a one-hot 8000-wide row per word is never built
+	abcdl::rnn::SeqIndexSet data_seq_data;
+	abcdl::rnn::SeqIndexSet data_seq_label;
+	if(!helper.read_seq_index("data/rnn/train_seq_data", data_seq_data, "data/rnn/train_seq_label", data_seq_label, sample_size)){
 		return -1;
 	}
 
@@ -57,6 +58,7 @@ int main(int argc, char** argv){
 
     abcdl::rnn::RNN rnn(8000, 100);
     rnn.set_epoch(50);
+    rnn.set_num_sampled(64);
     rnn.load_model("./data/rnn_seq.model");
 
     LOG(INFO) << "training size:" << data_seq_data.size();
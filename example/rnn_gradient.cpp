@@ -0,0 +1,383 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 18:00
+ * Last modified : 2026-10-17 18:00
+ * Filename      : rnn_gradient.cpp
+ * Description   : RNN gradients against finite differences
+ **********************************************/
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <algorithm>
+#include "rnn/Layer.h"
+#include "rnn/RNN.h"
+#include "utils/Log.h"
+#include "utils/ThreadPool.h"
+
+using abcdl::algebra::Mat;
+
+//cross entropy of the packed batch, sum of -log(o[t][y]) over every word
+real loss(abcdl::rnn::Layer* layer,
+          const abcdl::rnn::SeqBatch& batch_index,
+          const abcdl::rnn::SeqBatch& batch_label,
+          const Mat& U,
+          const Mat& W,
+          const Mat& V){
+    std::vector<Mat> states;
+    std::vector<Mat> activations;
+    layer->farward(batch_index, U, W, V, states, activations);
+    real value = 0;
+    for(size_t t = 0; t != activations.size(); t++){
+        for(size_t b = 0; b != activations[t].rows(); b++){
+            value -= std::log(activations[t].get_data(b, (*batch_label[b])[t]));
+        }
+    }
+    return value;
+}
+
+/*
+ * sampled softmax loss when every word is a candidate: the softmax of step t
+ * is taken over all words, logit c corrected by log(num_sampled * Q(c)),
+ * Q the log-uniform distribution the words are drawn from.
+ */
+real sampled_loss(abcdl::rnn::Layer* layer,
+                  const abcdl::rnn::SeqBatch& batch_index,
+                  const abcdl::rnn::SeqBatch& batch_label,
+                  const Mat& U,
+                  const Mat& W,
+                  const Mat& V,
+                  const size_t num_sampled){
+    std::vector<Mat> states;
+    layer->farward_state(batch_index, U, W, states);
+    size_t feature_dim = V.rows();
+    real log_range = std::log(static_cast<real>(feature_dim) + 1);
+    real value = 0;
+    for(size_t t = 0; t != states.size(); t++){
+        for(size_t b = 0; b != states[t].cols(); b++){
+            std::vector<real> logit(feature_dim);
+            real max_value = -1e10;
+            for(size_t c = 0; c != feature_dim; c++){
+                for(size_t i = 0; i != V.cols(); i++){
+                    logit[c] += V.get_data(c, i) * states[t].get_data(i, b);
+                }
+                real probability = std::log((c + static_cast<real>(2)) / (c + static_cast<real>(1))) / log_range;
+                logit[c] -= std::log(num_sampled * probability);
+                max_value = std::max(max_value, logit[c]);
+            }
+            real sum = 0;
+            for(size_t c = 0; c != feature_dim; c++){
+                sum += std::exp(logit[c] - max_value);
+            }
+            value += std::log(sum) + max_value - logit[(*batch_label[b])[t]];
+        }
+    }
+    return value;
+}
+
+/*
+ * max error of derivate to the central difference of loss_func for every value of mat,
+ * the makefile builds it with ABCDL_TYPE_DOUBLE, float is too coarse for the difference.
+ */
+bool check(const char* name,
+           const std::function<real()>& loss_func,
+           Mat& mat,
+           const Mat& derivate){
+    const real epsilon = 1e-5;
+    const real tolerance = 1e-6;
+    real max_error = 0;
+    real max_gradient = 0;
+    for(size_t i = 0; i != mat.get_size(); i++){
+        real value = mat.data()[i];
+        mat.data()[i] = value + epsilon;
+        real loss_plus = loss_func();
+        mat.data()[i] = value - epsilon;
+        real loss_minus = loss_func();
+        mat.data()[i] = value;
+
+        real gradient = (loss_plus - loss_minus) / (2 * epsilon);
+        max_error = std::max(max_error, std::fabs(gradient - derivate.data()[i]));
+        max_gradient = std::max(max_gradient, std::fabs(gradient));
+    }
+    bool passed = max_error <= tolerance * std::max(static_cast<real>(1), max_gradient);
+    printf("  %s max error %g, max gradient %g %s\n", name, (double)max_error, (double)max_gradient, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+bool check_cell(const char* name,
+                abcdl::rnn::Layer* layer,
+                const size_t feature_dim,
+                const size_t hidden_dim,
+                const abcdl::rnn::SeqBatch& batch_index,
+                const abcdl::rnn::SeqBatch& batch_label){
+    size_t gate_dim = layer->get_num_gates() * hidden_dim;
+    abcdl::algebra::RandomMatrix<real> U(gate_dim, feature_dim, 0, 1, -0.5, 0.5);
+    abcdl::algebra::RandomMatrix<real> W(gate_dim, hidden_dim, 0, 1, -0.5, 0.5);
+    abcdl::algebra::RandomMatrix<real> V(feature_dim, hidden_dim, 0, 1, -0.5, 0.5);
+
+    std::vector<Mat> states;
+    std::vector<Mat> activations;
+    Mat derivate_weight(0.0, U.rows(), U.cols());
+    Mat derivate_pre_weight(0.0, W.rows(), W.cols());
+    Mat derivate_act_weight(0.0, V.rows(), V.cols());
+    layer->farward(batch_index, U, W, V, states, activations);
+    layer->backward(batch_index, batch_label, U, W, V, states, activations, derivate_weight, derivate_pre_weight, derivate_act_weight);
+
+    printf("%s cell\n", name);
+    auto loss_func = [&]{ return loss(layer, batch_index, batch_label, U, W, V); };
+    bool passed = check("dU", loss_func, U, derivate_weight);
+    passed = check("dW", loss_func, W, derivate_pre_weight) && passed;
+    passed = check("dV", loss_func, V, derivate_act_weight) && passed;
+    delete layer;
+    return passed;
+}
+
+/*
+ * backward_sampled drawing 1000 words of 10, every word is a candidate of
+ * every step, against the central difference of sampled_loss. Then with 3
+ * words drawn: the same seed gives the same gradients, another seed others.
+ */
+bool check_sampled(const char* name,
+                   abcdl::rnn::Layer* layer,
+                   const size_t feature_dim,
+                   const size_t hidden_dim,
+                   const abcdl::rnn::SeqBatch& batch_index,
+                   const abcdl::rnn::SeqBatch& batch_label){
+    size_t gate_dim = layer->get_num_gates() * hidden_dim;
+    abcdl::algebra::RandomMatrix<real> U(gate_dim, feature_dim, 0, 1, -0.5, 0.5);
+    abcdl::algebra::RandomMatrix<real> W(gate_dim, hidden_dim, 0, 1, -0.5, 0.5);
+    abcdl::algebra::RandomMatrix<real> V(feature_dim, hidden_dim, 0, 1, -0.5, 0.5);
+
+    std::vector<Mat> states;
+    layer->farward_state(batch_index, U, W, states);
+    auto derivates = [&](const size_t num_sampled, const size_t seed){
+        std::vector<Mat> mats = {Mat(0.0, U.rows(), U.cols()), Mat(0.0, W.rows(), W.cols()), Mat(0.0, V.rows(), V.cols())};
+        abcdl::rnn::Sampler sampler(seed);
+        layer->backward_sampled(batch_index, batch_label, num_sampled, sampler, U, W, V, states, mats[0], mats[1], mats[2]);
+        return mats;
+    };
+    auto max_difference = [](const std::vector<Mat>& a, const std::vector<Mat>& b){
+        real value = 0;
+        for(size_t k = 0; k != a.size(); k++){
+            for(size_t i = 0; i != a[k].get_size(); i++){
+                value = std::max(value, std::fabs(a[k].data()[i] - b[k].data()[i]));
+            }
+        }
+        return value;
+    };
+
+    const size_t num_sampled = 1000;
+    auto all_words = derivates(num_sampled, 7);
+    printf("%s sampled softmax\n", name);
+    auto loss_func = [&]{ return sampled_loss(layer, batch_index, batch_label, U, W, V, num_sampled); };
+    bool passed = check("dU", loss_func, U, all_words[0]);
+    passed = check("dW", loss_func, W, all_words[1]) && passed;
+    passed = check("dV", loss_func, V, all_words[2]) && passed;
+
+    real same_seed = max_difference(derivates(3, 7), derivates(3, 7));
+    real other_seed = max_difference(derivates(3, 7), derivates(3, 8));
+    bool seed_passed = same_seed == 0 && other_seed > 0;
+    printf("  3 sampled, same seed difference %g, other seed difference %g %s\n", (double)same_seed, (double)other_seed, seed_passed ? "ok" : "FAILED");
+    delete layer;
+    return passed && seed_passed;
+}
+
+//farward and backward of a single sequence against the packed batch of that sequence
+bool check_sequence(const char* name,
+                    abcdl::rnn::Layer* layer,
+                    const size_t feature_dim,
+                    const size_t hidden_dim,
+                    const abcdl::rnn::SeqIndex& seq_index,
+                    const abcdl::rnn::SeqIndex& seq_label){
+    size_t gate_dim = layer->get_num_gates() * hidden_dim;
+    abcdl::algebra::RandomMatrix<real> U(gate_dim, feature_dim, 0, 1, -0.5, 0.5);
+    abcdl::algebra::RandomMatrix<real> W(gate_dim, hidden_dim, 0, 1, -0.5, 0.5);
+    abcdl::algebra::RandomMatrix<real> V(feature_dim, hidden_dim, 0, 1, -0.5, 0.5);
+
+    Mat state;
+    Mat activation;
+    Mat derivates[3] = {Mat(0.0, U.rows(), U.cols()), Mat(0.0, W.rows(), W.cols()), Mat(0.0, V.rows(), V.cols())};
+    layer->farward(seq_index, U, W, V, state, activation);
+    layer->backward(seq_index, seq_label, U, W, V, state, activation, derivates[0], derivates[1], derivates[2]);
+
+    abcdl::rnn::SeqBatch batch_index(1, &seq_index);
+    abcdl::rnn::SeqBatch batch_label(1, &seq_label);
+    std::vector<Mat> states;
+    std::vector<Mat> activations;
+    Mat batch_derivates[3] = {Mat(0.0, U.rows(), U.cols()), Mat(0.0, W.rows(), W.cols()), Mat(0.0, V.rows(), V.cols())};
+    layer->farward(batch_index, U, W, V, states, activations);
+    layer->backward(batch_index, batch_label, U, W, V, states, activations, batch_derivates[0], batch_derivates[1], batch_derivates[2]);
+
+    real activation_error = activations.size() == activation.rows() ? 0 : 1;
+    for(size_t t = 0; t != activations.size() && activation_error == 0; t++){
+        for(size_t i = 0; i != feature_dim; i++){
+            activation_error = std::max(activation_error, std::fabs(activation.get_data(t, i) - activations[t].get_data(0, i)));
+        }
+    }
+    real max_error = 0;
+    for(size_t k = 0; k != 3; k++){
+        for(size_t i = 0; i != derivates[k].get_size(); i++){
+            max_error = std::max(max_error, std::fabs(derivates[k].data()[i] - batch_derivates[k].data()[i]));
+        }
+    }
+    bool passed = activation_error <= 1e-12 && max_error <= 1e-12;
+    printf("%s sequence\n  o[t] max error to the batch %g, dU dW dV max error %g %s\n", name, (double)activation_error, (double)max_error, passed ? "ok" : "FAILED");
+    delete layer;
+    return passed;
+}
+
+//U, W and V of rnn, through the model file
+std::vector<Mat*> read_weights(abcdl::rnn::RNN& rnn, const std::string& path){
+    std::vector<Mat*> weights;
+    abcdl::utils::ModelLoader loader;
+    rnn.write_model(path);
+    loader.read<real>(path, &weights, "RNNMODEL");
+    std::remove(path.c_str());
+    return weights;
+}
+
+/*
+ * one mini batch step dealt to num_shard shards, each on its own sampler and
+ * arena, against the same step as a single packed batch from the same weights.
+ * The pool has 4 threads so shards run at once on any machine.
+ */
+bool check_shard(const char* name,
+                 const abcdl::rnn::Cell_type cell_type,
+                 const size_t feature_dim,
+                 const size_t hidden_dim,
+                 const size_t num_shard,
+                 const abcdl::rnn::SeqIndexSet& seq_index,
+                 const abcdl::rnn::SeqIndexSet& seq_label){
+    const std::string path = "rnn_gradient_shard.model";
+    abcdl::utils::ThreadPool::get_instance().set_num_thread(4);
+
+    abcdl::rnn::RNN rnn(feature_dim, hidden_dim, cell_type);
+    rnn.write_model(path);
+    abcdl::rnn::RNN shard_rnn(path);
+    for(abcdl::rnn::RNN* model : {&rnn, &shard_rnn}){
+        model->set_model_path("");
+        model->set_epoch(1);
+        model->set_mini_batch_size(seq_index.size());
+    }
+    shard_rnn.set_num_shard(num_shard);
+    rnn.train(seq_index, seq_label);
+    shard_rnn.train(seq_index, seq_label);
+
+    auto weights = read_weights(rnn, path);
+    auto shard_weights = read_weights(shard_rnn, path);
+    real max_error = weights.size() == 3 && shard_weights.size() == 3 ? 0 : 1;
+    for(size_t k = 0; k != weights.size() && max_error == 0; k++){
+        for(size_t i = 0; i != weights[k]->get_size(); i++){
+            max_error = std::max(max_error, std::fabs(weights[k]->data()[i] - shard_weights[k]->data()[i]));
+        }
+    }
+    for(auto weight : weights){
+        delete weight;
+    }
+    for(auto weight : shard_weights){
+        delete weight;
+    }
+    bool passed = max_error <= 1e-12;
+    printf("%s %zu shards\n  U W V max error to one batch %g %s\n", name, num_shard, (double)max_error, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+/*
+ * RNN::step fed the words of every sequence of the batch one at a time
+ * against the packed batch farward of the same weights: o[t] of the
+ * activation step, and the top_k words and probabilities of the top step.
+ */
+bool check_stream(const char* name,
+                  const abcdl::rnn::Cell_type cell_type,
+                  abcdl::rnn::Layer* layer,
+                  const size_t feature_dim,
+                  const size_t hidden_dim,
+                  const abcdl::rnn::SeqBatch& batch_index){
+    const size_t top_k = 3;
+    abcdl::rnn::RNN rnn(feature_dim, hidden_dim, cell_type);
+    auto weights = read_weights(rnn, "rnn_gradient_stream.model");
+    std::vector<Mat> states;
+    std::vector<Mat> activations;
+    layer->farward(batch_index, *weights[0], *weights[1], *weights[2], states, activations);
+
+    real activation_error = 0;
+    real top_error = 0;
+    for(size_t b = 0; b != batch_index.size(); b++){
+        abcdl::rnn::State state;
+        abcdl::rnn::State top_state;
+        Mat activation;
+        std::vector<std::pair<size_t, real>> top;
+        const abcdl::rnn::SeqIndex& seq_index = *batch_index[b];
+        for(size_t t = 0; t != seq_index.size(); t++){
+            rnn.step(seq_index[t], state, activation);
+            rnn.step(seq_index[t], top_state, top_k, top);
+
+            std::vector<std::pair<size_t, real>> expected_top;
+            for(size_t i = 0; i != feature_dim; i++){
+                real value = activations[t].get_data(b, i);
+                activation_error = std::max(activation_error, std::fabs(activation.get_data(0, i) - value));
+                expected_top.push_back(std::make_pair(i, value));
+            }
+            std::sort(expected_top.begin(), expected_top.end(), [](const std::pair<size_t, real>& a, const std::pair<size_t, real>& c){
+                return a.second > c.second;
+            });
+            if(top.size() != top_k){
+                top_error = 1;
+                continue;
+            }
+            for(size_t k = 0; k != top_k; k++){
+                top_error = std::max(top_error, top[k].first == expected_top[k].first ? std::fabs(top[k].second - expected_top[k].second) : 1);
+            }
+        }
+    }
+    for(auto weight : weights){
+        delete weight;
+    }
+    delete layer;
+    bool passed = activation_error <= 1e-12 && top_error <= 1e-12;
+    printf("%s stream\n  o[t] max error to the batch %g, top %zu max error %g %s\n", name, (double)activation_error, top_k, (double)top_error, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+int main(int argc, char** argv){
+    abcdl::utils::log::set_min_log_level(abcdl::utils::log::INFO);
+    abcdl::utils::log::initialize_log(argc, argv);
+
+    const size_t feature_dim = 10;
+    const size_t hidden_dim = 6;
+    //bptt of the Elman cell runs through the whole sequence
+    const size_t bptt_truncate = 100;
+
+    //a packed batch of lengths 6, 4, 4 and 2, longest first
+    abcdl::rnn::SeqIndexSet seq_index = {{1, 4, 2, 9, 0, 7}, {3, 3, 8, 5}, {6, 2, 0, 1}, {9, 5}};
+    abcdl::rnn::SeqIndexSet seq_label = {{4, 2, 9, 0, 7, 1}, {3, 8, 5, 6}, {2, 0, 1, 3}, {5, 8}};
+    abcdl::rnn::SeqBatch batch_index;
+    abcdl::rnn::SeqBatch batch_label;
+    for(size_t i = 0; i != seq_index.size(); i++){
+        batch_index.push_back(&seq_index[i]);
+        batch_label.push_back(&seq_label[i]);
+    }
+
+    bool passed = check_cell("Elman", new abcdl::rnn::Layer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index, batch_label);
+    passed = check_cell("LSTM", new abcdl::rnn::LSTMLayer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index, batch_label) && passed;
+    passed = check_cell("GRU", new abcdl::rnn::GRULayer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index, batch_label) && passed;
+
+    passed = check_sequence("Elman", new abcdl::rnn::Layer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, seq_index[0], seq_label[0]) && passed;
+    passed = check_sequence("LSTM", new abcdl::rnn::LSTMLayer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, seq_index[0], seq_label[0]) && passed;
+    passed = check_sequence("GRU", new abcdl::rnn::GRULayer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, seq_index[0], seq_label[0]) && passed;
+
+    passed = check_sampled("Elman", new abcdl::rnn::Layer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index, batch_label) && passed;
+    passed = check_sampled("LSTM", new abcdl::rnn::LSTMLayer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index, batch_label) && passed;
+    passed = check_sampled("GRU", new abcdl::rnn::GRULayer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index, batch_label) && passed;
+
+    passed = check_shard("Elman", abcdl::rnn::ELMAN, feature_dim, hidden_dim, 3, seq_index, seq_label) && passed;
+    passed = check_shard("LSTM", abcdl::rnn::LSTM, feature_dim, hidden_dim, 3, seq_index, seq_label) && passed;
+    passed = check_shard("GRU", abcdl::rnn::GRU, feature_dim, hidden_dim, 3, seq_index, seq_label) && passed;
+
+    passed = check_stream("Elman", abcdl::rnn::ELMAN, new abcdl::rnn::Layer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index) && passed;
+    passed = check_stream("LSTM", abcdl::rnn::LSTM, new abcdl::rnn::LSTMLayer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index) && passed;
+    passed = check_stream("GRU", abcdl::rnn::GRU, new abcdl::rnn::GRULayer(hidden_dim, bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc()), feature_dim, hidden_dim, batch_index) && passed;
+
+    printf("gradient check %s\n", passed ? "passed" : "failed");
+    return passed ? 0 : 1;
+}
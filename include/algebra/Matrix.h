@@ -9,9 +9,12 @@
 
 #include <string>
 #include <cstring>
+#include <vector>
+#include <utility>
 #include "utils/TypeDef.h"
 #include "utils/Log.h"
 #include "utils/ParallelOperator.h"
+#include "algebra/MatrixAllocator.h"
 
 
 namespace abcdl{
@@ -28,6 +31,9 @@ enum Convn_type{
     SAME
 };
 
+template<class T, class E>
+class MatrixExpression;
+
 template<class T>
 class Matrix{
 public:
@@ -42,21 +48,44 @@ public:
     Matrix(const Matrix<T>& mat){
         _rows = mat.rows();
         _cols = mat.cols();
-        _data = new T[_rows * _cols];
+        reserve_data(_rows * _cols);
         memcpy(_data, mat.data(), sizeof(T) * _rows * _cols);
     }
+    //takes the buffer and the allocator of mat, mat is left empty
+    Matrix(Matrix<T>&& mat){
+        _rows           = mat._rows;
+        _cols           = mat._cols;
+        _data           = mat._data;
+        _capacity       = mat._capacity;
+        _own_data       = mat._own_data;
+        _allocator      = mat._allocator;
+        _data_allocator = mat._data_allocator;
+        mat._rows           = 0;
+        mat._cols           = 0;
+        mat._data           = nullptr;
+        mat._capacity       = 0;
+        mat._own_data       = true;
+        mat._data_allocator = nullptr;
+    }
     ~Matrix();
 
     inline size_t rows() const { return _rows;}
     inline size_t cols() const { return _cols;}
     inline size_t get_size() const { return _rows * _cols;}
+    inline size_t get_capacity() const { return _capacity;}
+    /*
+     * rows x cols without keeping values, the buffer is reused
+     * when its capacity is enough.
+     */
+    inline void resize(const size_t rows, const size_t cols){
+        reserve_data(rows * cols);
+        _rows = rows;
+        _cols = cols;
+    }
     inline void clear(){
         _rows = 0;
         _cols = 0;
-        if (_data!= nullptr){
-            delete[] _data;
-            _data = nullptr;
-        }
+        release_data();
     }
     inline T* data() const { return _data; }
     inline T& get_data(const size_t idx) const{
@@ -83,12 +112,7 @@ public:
     inline void set_data(const T* data,
                          const size_t rows,
                          const size_t cols){
-        if(_rows * _cols != rows * cols){
-            if(_data != nullptr){
-                delete[] _data;
-            }
-            _data = new T[rows * cols];
-        }
+        reserve_data(rows * cols);
         _rows = rows;
         _cols = cols;
         memcpy(_data, data, sizeof(T) * rows * cols);
@@ -97,14 +121,38 @@ public:
         set_data(mat.data(), mat.rows(), mat.cols());
     }
 
+    /*
+     * takes data allocated by new T[], it is freed by delete[].
+     * new T[] is only aligned to alignof(T), allocate_data gives aligned buffers.
+     */
     void set_shallow_data(T* data,
                           const size_t rows,
                           const size_t cols);
+    /*
+     * buffer of size values from the allocator of this matrix,
+     * hand it over by set_allocated_data(data, rows, cols) with rows * cols == size.
+     */
+    inline T* allocate_data(const size_t size) const{
+        return static_cast<T*>(_allocator->allocate(sizeof(T) * size));
+    }
+    void set_allocated_data(T* data,
+                            const size_t rows,
+                            const size_t cols);
+    inline Allocator* get_allocator() const { return _allocator; }
+    /*
+     * refer to data without owning it, data must outlive the matrix.
+     * Writes go to data, anything that reallocates detaches from it.
+     */
+    void set_view_data(T* data,
+                       const size_t rows,
+                       const size_t cols);
     
     Matrix<T> get_row(const size_t row_id, const size_t row_size = 1) const;
     void get_row(Matrix<T>* mat,
                  const size_t row_id,
                  const size_t row_size = 1) const;
+    //gather rows of row_ids into mat, mat keeps its buffer if the shape fits
+    void get_rows(Matrix<T>* mat, const std::vector<size_t>& row_ids) const;
     void set_row(const Matrix<T>& mat);
     void set_row(const size_t row_id, const Matrix<T>& mat);
     void insert_row(const Matrix<T>& mat);
@@ -139,7 +187,10 @@ public:
         return *this;
     }
 
-    void for_each(const std::function<void(T*)> &f);
+    template<class F>
+    void for_each(const F& f){
+        _po.parallel_mul2one(_data, get_size(), f);
+    }
 
     void display(const std::string& split="\t", bool with_title = true) const; 
 
@@ -149,6 +200,10 @@ public:
 
     Matrix<T>& operator = (const T& value);
     Matrix<T>& operator = (const Matrix<T>& mat);
+    Matrix<T>& operator = (Matrix<T>&& mat);
+    //fused evaluation, defined in algebra/MatrixExpression.h
+    template<class E>
+    Matrix<T>& operator = (const MatrixExpression<T, E>& expression);
 
     Matrix<T> operator + (const T& value) const;
     Matrix<T> operator + (const Matrix<T>& mat) const;
@@ -205,6 +260,8 @@ public:
     T min() const;
     size_t argmin() const;
     T sum() const;
+    //ROW: rows x 1 sum of every row, COL: 1 x cols sum of every col
+    Matrix<T> sum(Axis_type type) const;
     real mean() const;
     Matrix<real> mean(Axis_type type) const;
     Matrix<real> inverse() const;
@@ -254,10 +311,45 @@ private:
         return _rows == mat.rows() && _cols == mat.cols();
     }
 
+protected:
+    //frees _data unless it is a view on a buffer owned elsewhere
+    inline void release_data(){
+        if(_data != nullptr && _own_data){
+            if(_data_allocator != nullptr){
+                _data_allocator->deallocate(_data, sizeof(T) * _capacity);
+            }else{
+                delete[] _data;
+            }
+        }
+        _data = nullptr;
+        _capacity = 0;
+        _own_data = true;
+        _data_allocator = nullptr;
+    }
+    /*
+     * room for size values, an owned buffer is kept if it is big enough,
+     * a view is kept only for the same size, it can't grow or shrink.
+     */
+    inline void reserve_data(const size_t size){
+        if(_data != nullptr && (_own_data ? _capacity >= size : _capacity == size)){
+            return;
+        }
+        release_data();
+        _data = allocate_data(size);
+        _capacity = size;
+        _data_allocator = _allocator;
+    }
+
 protected:
     size_t _rows;
     size_t _cols;
-    T*   _data;
+    T*   _data = nullptr;
+    size_t _capacity = 0;
+    bool _own_data = true;
+    //allocator of new buffers, bound when the matrix is constructed
+    Allocator* _allocator = Allocator::get_current();
+    //allocator _data came from, nullptr for a buffer of new T[]
+    Allocator* _data_allocator = nullptr;
 	const abcdl::utils::ParallelOperator<T> _po;
 };//class Matrix
 
@@ -266,12 +358,8 @@ template<class T>
 class RandomMatrix : public Matrix<T>{
 public:
     RandomMatrix(){}
-    RandomMatrix(const Matrix<T>& mat){
-        this->_rows = mat.rows();
-        this->_cols = mat.cols();
-        this->_data = new T[mat.get_size()];
-        memcpy(this->_data, mat.data(), sizeof(T) * mat.get_size());
-    }
+    RandomMatrix(const Matrix<T>& mat) : Matrix<T>(mat){}
+    RandomMatrix(Matrix<T>&& mat) : Matrix<T>(std::move(mat)){}
     RandomMatrix(size_t rows,
                  size_t cols,
                  const T& mean_value = 0,
@@ -287,16 +375,11 @@ public:
                const T& max = 0);
 
     RandomMatrix<T>& operator = (const Matrix<T>& mat){
-        if(this->get_size() != mat.get_size()){
-            if(this->_data != nullptr){
-                delete[] this->_data;
-            }
-            this->_data = new T[mat.get_size()];
-        }
-        this->_rows = mat.rows();
-        this->_cols = mat.cols();
-        memcpy(this->_data, mat.data(), sizeof(T) * mat.get_size());
-
+        Matrix<T>::operator = (mat);
+        return *this;
+    }
+    RandomMatrix<T>& operator = (Matrix<T>&& mat){
+        Matrix<T>::operator = (std::move(mat));
         return *this;
     }
 
@@ -311,13 +394,11 @@ template<class T>
 class EyeMatrix : public Matrix<T>{
 public:
     explicit EyeMatrix(const size_t size){
-        T* data = new T[size * size];
-        memset(data, 0, sizeof(T) * size * size);
+        this->reset(0, size, size);
         T value = 1;
         for(size_t i = 0; i != size; i++){
-            data[i * size + i] = value;
+            this->_data[i * size + i] = value;
         }
-        this->set_shallow_data(data, size, size);
     }
 };//class EyeMatrix
 
@@ -0,0 +1,173 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 15:20
+* Last modified: 2026-10-17 15:20
+* Filename: MatrixAllocator.h
+* Description: pluggable storage allocators of Matrix buffers
+**********************************************/
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stddef.h>
+#include "utils/TypeDef.h"
+
+namespace abcdl{
+namespace algebra{
+
+struct AllocatorStats{
+    size_t num_allocate;        //allocate calls
+    size_t num_deallocate;      //deallocate calls
+    size_t num_heap_allocate;   //allocate calls which went to the system heap
+    size_t num_heap_free;       //blocks given back to the system heap
+    size_t bytes_in_use;        //bytes handed out and not deallocated yet
+    size_t peak_bytes_in_use;
+};
+
+/*
+ * A Matrix draws its buffers from the allocator which was current on its
+ * thread when it was constructed, and gives every buffer back to the
+ * allocator it came from. Every buffer starts on a multiple of
+ * get_alignment() bytes, ABCDL_ALIGNMENT unless given otherwise.
+ */
+class Allocator{
+public:
+    explicit Allocator(const size_t alignment = ABCDL_ALIGNMENT);
+    virtual ~Allocator(){}
+
+    virtual void* allocate(const size_t bytes) = 0;
+    virtual void deallocate(void* ptr, const size_t bytes) = 0;
+
+    AllocatorStats get_stats() const;
+    void reset_stats();
+    inline size_t get_alignment() const { return _alignment; }
+
+    //allocator of matrices constructed on this thread
+    static Allocator* get_current();
+    //nullptr restores the default allocator
+    static void set_current(Allocator* allocator);
+    //the process-wide PoolAllocator
+    static Allocator* get_default();
+
+protected:
+    //system heap memory aligned to _alignment, freed by heap_free
+    void* heap_allocate(const size_t bytes) const;
+    static void heap_free(void* ptr);
+
+    void count_allocate(const size_t bytes);
+    void count_heap_allocate(const size_t num = 1);
+    void count_deallocate(const size_t bytes);
+    void count_heap_free(const size_t num = 1);
+
+private:
+    size_t _alignment;
+    std::atomic<size_t> _num_allocate{0};
+    std::atomic<size_t> _num_deallocate{0};
+    std::atomic<size_t> _num_heap_allocate{0};
+    std::atomic<size_t> _num_heap_free{0};
+    std::atomic<size_t> _bytes_in_use{0};
+    std::atomic<size_t> _peak_bytes_in_use{0};
+};//class Allocator
+
+//every allocate and deallocate goes to the system heap
+class HeapAllocator : public Allocator{
+public:
+    explicit HeapAllocator(const size_t alignment = ABCDL_ALIGNMENT) : Allocator(alignment){}
+    void* allocate(const size_t bytes);
+    void deallocate(void* ptr, const size_t bytes);
+};//class HeapAllocator
+
+/*
+ * Blocks are rounded up to a power of two size class, a deallocated block
+ * is kept on the free list of its class and handed out again, so a loop
+ * which allocates the same shapes every step stops touching the heap after
+ * the first step.
+ */
+class PoolAllocator : public Allocator{
+public:
+    explicit PoolAllocator(const size_t alignment = ABCDL_ALIGNMENT) : Allocator(alignment){}
+    ~PoolAllocator();
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator = (const PoolAllocator&) = delete;
+
+    void* allocate(const size_t bytes);
+    void deallocate(void* ptr, const size_t bytes);
+
+    //give all cached blocks back to the system heap
+    void release();
+    size_t get_cached_bytes() const { return _cached_bytes; }
+
+private:
+    static const size_t MIN_CLASS = 6;
+    static const size_t NUM_CLASS = 64;
+
+    static size_t size_class(const size_t bytes);
+
+private:
+    //a free block stores the next free block of its class in its first bytes
+    void* _free_list[NUM_CLASS] = {};
+    size_t _cached_bytes = 0;
+    std::mutex _mutex;
+};//class PoolAllocator
+
+/*
+ * Bump allocator for the temporaries of one training step: allocate moves
+ * a pointer forward, deallocate only counts, reset() rewinds everything at
+ * the end of the step. Chunks are kept, after a reset the used chunks are
+ * merged into one, so a steady step runs in a single chunk without any
+ * heap allocation.
+ * Matrices constructed while the arena is current must be destroyed
+ * before reset(), a reset with live buffers is refused.
+ */
+class ArenaAllocator : public Allocator{
+public:
+    explicit ArenaAllocator(const size_t chunk_bytes = 1 << 20,
+                            const size_t alignment = ABCDL_ALIGNMENT);
+    ~ArenaAllocator();
+    ArenaAllocator(const ArenaAllocator&) = delete;
+    ArenaAllocator& operator = (const ArenaAllocator&) = delete;
+
+    void* allocate(const size_t bytes);
+    void deallocate(void* ptr, const size_t bytes);
+
+    bool reset();
+    size_t get_num_live() const { return _num_live; }
+    size_t get_chunk_bytes() const;
+
+private:
+    struct Chunk{
+        char* data;
+        size_t size;
+    };
+
+    void* new_chunk(const size_t bytes);
+
+private:
+    size_t _min_chunk_bytes;
+    std::vector<Chunk> _chunks;
+    size_t _chunk_id = 0;
+    size_t _offset = 0;
+    size_t _num_live = 0;
+    std::mutex _mutex;
+};//class ArenaAllocator
+
+//makes allocator current on this thread until the scope ends
+class AllocatorScope{
+public:
+    explicit AllocatorScope(Allocator* allocator){
+        _pre_allocator = Allocator::get_current();
+        Allocator::set_current(allocator);
+    }
+    ~AllocatorScope(){
+        Allocator::set_current(_pre_allocator);
+    }
+    AllocatorScope(const AllocatorScope&) = delete;
+    AllocatorScope& operator = (const AllocatorScope&) = delete;
+
+private:
+    Allocator* _pre_allocator;
+};//class AllocatorScope
+
+}//namespace algebra
+}//namespace abcdl
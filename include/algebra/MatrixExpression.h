@@ -0,0 +1,393 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 14:10
+* Last modified: 2026-10-17 14:10
+* Filename: MatrixExpression.h
+* Description: lazy elementwise matrix expressions,
+*              evaluated in one pass without temporaries
+**********************************************/
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include "algebra/Matrix.h"
+
+namespace abcdl{
+namespace algebra{
+
+/*
+ * expr(mat) starts an expression, + - * / with matrices, expressions and
+ * scalars and the activation methods only build a tree; it's computed when
+ * assigned to a Matrix, row by row on the thread pool, into the destination.
+ *
+ *     out = (expr(input) - means) * scales;
+ *     out = (expr(z) + bias).sigmoid();
+ *
+ * The right operand follows the broadcast rules of Matrix::operator+:
+ * same shape, a row vector(1 x cols) or a col vector(rows x 1).
+ * Operands are held by reference, assign the expression in the statement
+ * that builds it, never keep it in an auto variable.
+ */
+template<class T, class E>
+class MatrixExpression;
+
+template<class T, class Op, class E>
+class UnaryExpression;
+
+template<class T, class Op, class L, class R>
+class BinaryExpression;
+
+template<class T>
+class MatrixTerm;
+
+/*
+ * element operators
+ */
+template<class T>
+struct AddOp{
+    inline T operator()(const T a, const T b) const { return a + b; }
+};
+
+template<class T>
+struct SubOp{
+    inline T operator()(const T a, const T b) const { return a - b; }
+};
+
+template<class T>
+struct MulOp{
+    inline T operator()(const T a, const T b) const { return a * b; }
+};
+
+template<class T>
+struct DivOp{
+    inline T operator()(const T a, const T b) const { return a / b; }
+};
+
+template<class T>
+struct AddScalarOp{
+    T value;
+    inline T operator()(const T a) const { return a + value; }
+};
+
+template<class T>
+struct SubScalarOp{
+    T value;
+    inline T operator()(const T a) const { return a - value; }
+};
+
+template<class T>
+struct ScalarSubOp{
+    T value;
+    inline T operator()(const T a) const { return value - a; }
+};
+
+template<class T>
+struct MulScalarOp{
+    T value;
+    inline T operator()(const T a) const { return a * value; }
+};
+
+template<class T>
+struct DivScalarOp{
+    T value;
+    inline T operator()(const T a) const { return a / value; }
+};
+
+template<class T>
+struct ScalarDivOp{
+    T value;
+    inline T operator()(const T a) const { return value / a; }
+};
+
+template<class T>
+struct PowOp{
+    T exponent;
+    inline T operator()(const T a) const { return std::pow(a, exponent); }
+};
+
+template<class T>
+struct LogOp{
+    inline T operator()(const T a) const { return std::log(a); }
+};
+
+template<class T>
+struct SqrtOp{
+    inline T operator()(const T a) const { return std::sqrt(a); }
+};
+
+//the activations keep the clamps of MatrixHelper
+template<class T>
+struct ExpOp{
+    inline T operator()(const T a) const { return std::exp(std::min(a, (T)EXP_MAX)); }
+};
+
+template<class T>
+struct SigmoidOp{
+    inline T operator()(const T a) const {
+        return 1 / (1 + std::exp(-(std::min((T)SIGMOID_MAX, std::max(a, (T)SIGMOID_MIN)))));
+    }
+};
+
+template<class T>
+struct TanhOp{
+    inline T operator()(const T a) const {
+        return 2.0 /(1.0 + std::exp(std::min((T)EXP_MAX, -2 * a))) - 1.0;
+    }
+};
+
+template<class T>
+struct ReluOp{
+    inline T operator()(const T a) const { return a < 0 ? 0 : a; }
+};
+
+template<class T, class E>
+class MatrixExpression{
+public:
+    typedef T value_type;
+
+    inline const E& self() const { return static_cast<const E&>(*this); }
+    inline size_t rows() const { return self().rows(); }
+    inline size_t cols() const { return self().cols(); }
+
+    UnaryExpression<T, PowOp<T>, E> pow(const T& exponent) const;
+    UnaryExpression<T, LogOp<T>, E> log() const;
+    UnaryExpression<T, SqrtOp<T>, E> sqrt() const;
+    UnaryExpression<T, ExpOp<T>, E> exp() const;
+    UnaryExpression<T, SigmoidOp<T>, E> sigmoid() const;
+    UnaryExpression<T, TanhOp<T>, E> tanh() const;
+    UnaryExpression<T, ReluOp<T>, E> relu() const;
+
+    Matrix<T> eval() const{
+        Matrix<T> mat;
+        mat = *this;
+        return mat;
+    }
+};//class MatrixExpression
+
+template<class T>
+class MatrixTerm : public MatrixExpression<T, MatrixTerm<T> >{
+public:
+    explicit MatrixTerm(const Matrix<T>& mat) :
+        _data(mat.data()), _rows(mat.rows()), _cols(mat.cols()), _row_stride(0), _col_stride(0){}
+
+    inline size_t rows() const { return _rows; }
+    inline size_t cols() const { return _cols; }
+    inline bool valid() const { return true; }
+
+    //a dimension of 1 is repeated over the destination, others are walked
+    inline void bind(const size_t rows, const size_t cols) const{
+        _row_stride = (_rows == 1 && rows != 1) ? 0 : _cols;
+        _col_stride = (_cols == 1 && cols != 1) ? 0 : 1;
+    }
+    inline T at(const size_t row, const size_t col) const{
+        return _data[row * _row_stride + col * _col_stride];
+    }
+
+private:
+    const T* _data;
+    size_t _rows;
+    size_t _cols;
+    mutable size_t _row_stride;
+    mutable size_t _col_stride;
+};//class MatrixTerm
+
+template<class T, class Op, class E>
+class UnaryExpression : public MatrixExpression<T, UnaryExpression<T, Op, E> >{
+public:
+    UnaryExpression(const E& expr, const Op& op) : _expr(expr), _op(op){}
+
+    inline size_t rows() const { return _expr.rows(); }
+    inline size_t cols() const { return _expr.cols(); }
+    inline bool valid() const { return _expr.valid(); }
+
+    inline void bind(const size_t rows, const size_t cols) const{
+        _expr.bind(rows, cols);
+    }
+    inline T at(const size_t row, const size_t col) const{
+        return _op(_expr.at(row, col));
+    }
+
+private:
+    E _expr;
+    Op _op;
+};//class UnaryExpression
+
+template<class T, class Op, class L, class R>
+class BinaryExpression : public MatrixExpression<T, BinaryExpression<T, Op, L, R> >{
+public:
+    BinaryExpression(const L& lhs, const R& rhs) : _lhs(lhs), _rhs(rhs){
+        _valid = (_lhs.rows() == _rhs.rows() && _lhs.cols() == _rhs.cols())
+              || (_lhs.cols() == _rhs.cols() && _rhs.rows() == 1)
+              || (_lhs.rows() == _rhs.rows() && _rhs.cols() == 1);
+        CHECK(_valid);
+    }
+
+    //the shape is taken from the left operand, as Matrix operators do
+    inline size_t rows() const { return _lhs.rows(); }
+    inline size_t cols() const { return _lhs.cols(); }
+    inline bool valid() const { return _valid && _lhs.valid() && _rhs.valid(); }
+
+    inline void bind(const size_t rows, const size_t cols) const{
+        _lhs.bind(rows, cols);
+        _rhs.bind(rows, cols);
+    }
+    inline T at(const size_t row, const size_t col) const{
+        return _op(_lhs.at(row, col), _rhs.at(row, col));
+    }
+
+private:
+    L _lhs;
+    R _rhs;
+    Op _op;
+    bool _valid;
+};//class BinaryExpression
+
+template<class T>
+inline MatrixTerm<T> expr(const Matrix<T>& mat){
+    return MatrixTerm<T>(mat);
+}
+
+template<class T, class E>
+UnaryExpression<T, PowOp<T>, E> MatrixExpression<T, E>::pow(const T& exponent) const{
+    PowOp<T> op;
+    op.exponent = exponent;
+    return UnaryExpression<T, PowOp<T>, E>(self(), op);
+}
+
+template<class T, class E>
+UnaryExpression<T, LogOp<T>, E> MatrixExpression<T, E>::log() const{
+    return UnaryExpression<T, LogOp<T>, E>(self(), LogOp<T>());
+}
+
+template<class T, class E>
+UnaryExpression<T, SqrtOp<T>, E> MatrixExpression<T, E>::sqrt() const{
+    return UnaryExpression<T, SqrtOp<T>, E>(self(), SqrtOp<T>());
+}
+
+template<class T, class E>
+UnaryExpression<T, ExpOp<T>, E> MatrixExpression<T, E>::exp() const{
+    return UnaryExpression<T, ExpOp<T>, E>(self(), ExpOp<T>());
+}
+
+template<class T, class E>
+UnaryExpression<T, SigmoidOp<T>, E> MatrixExpression<T, E>::sigmoid() const{
+    return UnaryExpression<T, SigmoidOp<T>, E>(self(), SigmoidOp<T>());
+}
+
+template<class T, class E>
+UnaryExpression<T, TanhOp<T>, E> MatrixExpression<T, E>::tanh() const{
+    return UnaryExpression<T, TanhOp<T>, E>(self(), TanhOp<T>());
+}
+
+template<class T, class E>
+UnaryExpression<T, ReluOp<T>, E> MatrixExpression<T, E>::relu() const{
+    return UnaryExpression<T, ReluOp<T>, E>(self(), ReluOp<T>());
+}
+
+/*
+ * expression (op) expression/matrix, matrix (op) expression
+ */
+#define ABCDL_EXPRESSION_BINARY_OPERATOR(op, Op) \
+    template<class T, class L, class R> \
+    inline BinaryExpression<T, Op<T>, L, R> operator op (const MatrixExpression<T, L>& lhs, \
+                                                         const MatrixExpression<T, R>& rhs){ \
+        return BinaryExpression<T, Op<T>, L, R>(lhs.self(), rhs.self()); \
+    } \
+    template<class T, class L> \
+    inline BinaryExpression<T, Op<T>, L, MatrixTerm<T> > operator op (const MatrixExpression<T, L>& lhs, \
+                                                                      const Matrix<T>& rhs){ \
+        return BinaryExpression<T, Op<T>, L, MatrixTerm<T> >(lhs.self(), MatrixTerm<T>(rhs)); \
+    } \
+    template<class T, class R> \
+    inline BinaryExpression<T, Op<T>, MatrixTerm<T>, R> operator op (const Matrix<T>& lhs, \
+                                                                     const MatrixExpression<T, R>& rhs){ \
+        return BinaryExpression<T, Op<T>, MatrixTerm<T>, R>(MatrixTerm<T>(lhs), rhs.self()); \
+    }
+
+ABCDL_EXPRESSION_BINARY_OPERATOR(+, AddOp)
+ABCDL_EXPRESSION_BINARY_OPERATOR(-, SubOp)
+ABCDL_EXPRESSION_BINARY_OPERATOR(*, MulOp)
+ABCDL_EXPRESSION_BINARY_OPERATOR(/, DivOp)
+
+#undef ABCDL_EXPRESSION_BINARY_OPERATOR
+
+/*
+ * expression (op) scalar, scalar (op) expression,
+ * the scalar is converted to T instead of taking part in deduction.
+ */
+#define ABCDL_EXPRESSION_SCALAR_OPERATOR(op, Op) \
+    template<class T, class E> \
+    inline UnaryExpression<T, Op<T>, E> operator op (const MatrixExpression<T, E>& lhs, \
+                                                     const typename MatrixExpression<T, E>::value_type& value){ \
+        Op<T> scalar_op; \
+        scalar_op.value = value; \
+        return UnaryExpression<T, Op<T>, E>(lhs.self(), scalar_op); \
+    }
+
+#define ABCDL_EXPRESSION_SCALAR_LEFT_OPERATOR(op, Op) \
+    template<class T, class E> \
+    inline UnaryExpression<T, Op<T>, E> operator op (const typename MatrixExpression<T, E>::value_type& value, \
+                                                     const MatrixExpression<T, E>& rhs){ \
+        Op<T> scalar_op; \
+        scalar_op.value = value; \
+        return UnaryExpression<T, Op<T>, E>(rhs.self(), scalar_op); \
+    }
+
+ABCDL_EXPRESSION_SCALAR_OPERATOR(+, AddScalarOp)
+ABCDL_EXPRESSION_SCALAR_OPERATOR(-, SubScalarOp)
+ABCDL_EXPRESSION_SCALAR_OPERATOR(*, MulScalarOp)
+ABCDL_EXPRESSION_SCALAR_OPERATOR(/, DivScalarOp)
+ABCDL_EXPRESSION_SCALAR_LEFT_OPERATOR(+, AddScalarOp)
+ABCDL_EXPRESSION_SCALAR_LEFT_OPERATOR(-, ScalarSubOp)
+ABCDL_EXPRESSION_SCALAR_LEFT_OPERATOR(*, MulScalarOp)
+ABCDL_EXPRESSION_SCALAR_LEFT_OPERATOR(/, ScalarDivOp)
+
+#undef ABCDL_EXPRESSION_SCALAR_OPERATOR
+#undef ABCDL_EXPRESSION_SCALAR_LEFT_OPERATOR
+
+template<class T>
+template<class E>
+Matrix<T>& Matrix<T>::operator = (const MatrixExpression<T, E>& expression){
+    const E& root = expression.self();
+    //a broken operand shape was logged when the tree was built
+    if(!root.valid()){
+        return *this;
+    }
+    size_t rows = root.rows();
+    size_t cols = root.cols();
+    size_t size = rows * cols;
+    root.bind(rows, cols);
+
+    /*
+     * an operand of the same shape as this is read at the index being written,
+     * so it's evaluated in place. When the size changes, this may still be read
+     * through a broadcast operand, the result goes to a new buffer.
+     */
+    T* data = _data;
+    if(get_size() != size){
+        data = allocate_data(size);
+    }
+
+    size_t num_thread = std::min(rows, _po.get_num_thread(size, _po.get_block_size(size)));
+    _po.parallel_range(rows, num_thread,
+        [data, cols, &root](size_t start_idx, size_t end_idx){
+            for(size_t i = start_idx; i != end_idx; i++){
+                T* row_data = &data[i * cols];
+                for(size_t j = 0; j != cols; j++){
+                    row_data[j] = root.at(i, j);
+                }
+            }
+        }
+    );
+
+    if(data != _data){
+        set_allocated_data(data, rows, cols);
+    }else{
+        _rows = rows;
+        _cols = cols;
+    }
+    return *this;
+}
+
+}//namespace algebra
+}//namespace abcdl
@@ -0,0 +1,116 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 18:30
+* Last modified: 2026-10-17 18:30
+* Filename: MatrixFFT.h
+* Description: fft convolution with cached kernal spectra
+**********************************************/
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace abcdl{
+namespace algebra{
+
+/*
+ * Convolution as a product of spectra: the data and the kernal are zero
+ * padded to power of two P x Q, transformed by a radix-2 real 2-D fft,
+ * multiplied and transformed back. It costs O(PQ log PQ) whatever the
+ * kernal size, so it wins over the direct O(N^2 K^2) loop for large kernals
+ * and large FULL convolutions.
+ *
+ * Spectra of kernals are cached by address and checked against a copy of
+ * the kernal, so they are reused until the weights are updated.
+ * The cache is not locked, an instance must not be shared by threads.
+ */
+template<class T>
+class MatrixFFT{
+public:
+    //real type of the transforms, double for integer T
+    typedef typename std::conditional<std::is_floating_point<T>::value, T, double>::type R;
+    typedef std::complex<R> Complex;
+
+    /*
+     * true when the fft is expected to beat the direct loop for
+     * a rows x cols data with a kernal_row x kernal_col kernal
+     * giving conv_row x conv_col positions.
+     */
+    static bool is_preferred(const size_t rows,
+                             const size_t cols,
+                             const size_t kernal_row,
+                             const size_t kernal_col,
+                             const size_t conv_row,
+                             const size_t conv_col);
+
+    /*
+     * the result of convn: conv_row x conv_col positions at stride,
+     * the data padded by pad_row and pad_col (at most kernal - 1) before
+     * the first value, positions past the data are 0 as in the direct loop.
+     */
+    void convn(T* result,
+               const size_t conv_row,
+               const size_t conv_col,
+               const T* data,
+               const size_t rows,
+               const size_t cols,
+               const T* kernal,
+               const size_t kernal_row,
+               const size_t kernal_col,
+               const size_t stride,
+               const size_t pad_row,
+               const size_t pad_col);
+
+    inline size_t get_cache_size() const { return _spectra.size(); }
+    void clear_cache(){ _spectra.clear(); }
+
+private:
+    struct Spectrum{
+        const T* kernal;
+        size_t kernal_row;
+        size_t kernal_col;
+        size_t fft_row;
+        size_t fft_col;
+        std::vector<T> values;
+        std::vector<Complex> spectrum;
+    };
+
+    //spectrum of the flipped kernal at fft_row x fft_col, cached
+    const std::vector<Complex>& kernal_spectrum(const T* kernal,
+                                                const size_t kernal_row,
+                                                const size_t kernal_col,
+                                                const size_t fft_row,
+                                                const size_t fft_col);
+
+    //rows x cols real data zero padded to fft_row x fft_col, spectrum is fft_row x (fft_col / 2 + 1)
+    void rfft2(std::vector<Complex>& spectrum,
+               const T* data,
+               const size_t rows,
+               const size_t cols,
+               const size_t fft_row,
+               const size_t fft_col);
+    //inverse of rfft2, spectrum is overwritten, values is fft_row x fft_col
+    void irfft2(std::vector<R>& values,
+                std::vector<Complex>& spectrum,
+                const size_t fft_row,
+                const size_t fft_col);
+
+    //in place radix-2 fft of size n at stride 1, inverse is not scaled
+    void fft(Complex* data, const size_t n, const bool inverse);
+    //exp(-2 pi i k / n) for k < n / 2
+    const std::vector<Complex>& twiddles(const size_t n);
+
+private:
+    static const size_t MAX_CACHE_SIZE = 256;
+
+    std::vector<Spectrum> _spectra;
+    std::vector<std::vector<Complex>> _twiddles;
+    std::vector<Complex> _spectrum;
+    std::vector<Complex> _buffer;
+    std::vector<R> _values;
+};//class MatrixFFT
+
+}//namespace algebra
+}//namespace abcdl
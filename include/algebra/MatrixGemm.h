@@ -0,0 +1,158 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 11:02
+* Last modified: 2026-10-17 11:02
+* Filename: MatrixGemm.h
+* Description: packed, cache blocked matrix multiply
+**********************************************/
+#pragma once
+
+#include <cstddef>
+#include "utils/ParallelOperator.h"
+
+namespace abcdl{
+namespace algebra{
+
+/*
+ * Blocking of the gemm loops:
+ *   NC columns of B are packed per L3 block,
+ *   KC is the depth of a packed panel, KC * NR of B stays in L1,
+ *   MC rows of A are packed per L2 block,
+ *   MR * NR is the register tile computed by the micro kernel,
+ *   MatrixKernel::gemm_tile, NR a multiple of the simd width.
+ */
+template<class T>
+struct GemmBlock{
+    static const size_t MR = 4;
+    static const size_t NR = 4;
+    static const size_t MC = 64;
+    static const size_t KC = 256;
+    static const size_t NC = 2048;
+};
+
+template<>
+struct GemmBlock<float>{
+    static const size_t MR = 8;
+    static const size_t NR = 8;
+    static const size_t MC = 128;
+    static const size_t KC = 256;
+    static const size_t NC = 4096;
+};
+
+template<>
+struct GemmBlock<double>{
+    static const size_t MR = 8;
+    static const size_t NR = 4;
+    static const size_t MC = 96;
+    static const size_t KC = 256;
+    static const size_t NC = 2048;
+};
+
+/*
+ * Work done on an output tile right after its last k panel,
+ * while the tile is still in the micro kernel accumulators.
+ *   scale == nullptr: C = kernel(C + bias), bias is a 1 x n row
+ *   scale != nullptr: C = C .* kernel(scale), scale is m x n with leading dimension ld_scale
+ * bias and kernel may be nullptr.
+ */
+template<class T>
+struct GemmEpilogue{
+    const T* bias   = nullptr;
+    const T* scale  = nullptr;
+    size_t ld_scale = 0;
+    void (*kernel)(T*, const T*, const size_t) = nullptr;
+
+    bool empty() const{
+        return bias == nullptr && scale == nullptr && kernel == nullptr;
+    }
+    //epilogue of the sub block starting at C(row, col)
+    GemmEpilogue<T> offset(const size_t row, const size_t col) const{
+        GemmEpilogue<T> epilogue = *this;
+        if(bias != nullptr){
+            epilogue.bias = &bias[col];
+        }
+        if(scale != nullptr){
+            epilogue.scale = &scale[row * ld_scale + col];
+        }
+        return epilogue;
+    }
+};
+
+template<class T>
+class MatrixGemm{
+public:
+    /*
+     * C = A * B, C is row-major with leading dimension ldc.
+     * A(i, p) = a[i * rs_a + p * cs_a], B(p, j) = b[p * rs_b + j * cs_b],
+     * so transposed or strided operands are passed by swapping strides.
+     * Rows of C are split over the thread pool.
+     */
+    void gemm(const size_t m,
+              const size_t n,
+              const size_t k,
+              const T* a,
+              const size_t rs_a,
+              const size_t cs_a,
+              const T* b,
+              const size_t rs_b,
+              const size_t cs_b,
+              T* c,
+              const size_t ldc) const;
+    //same as above, epilogue is applied to every tile of C
+    void gemm(const size_t m,
+              const size_t n,
+              const size_t k,
+              const T* a,
+              const size_t rs_a,
+              const size_t cs_a,
+              const T* b,
+              const size_t rs_b,
+              const size_t cs_b,
+              T* c,
+              const size_t ldc,
+              const GemmEpilogue<T>& epilogue) const;
+
+private:
+    void small_gemm(const size_t m,
+                    const size_t n,
+                    const size_t k,
+                    const T* a,
+                    const size_t rs_a,
+                    const size_t cs_a,
+                    const T* b,
+                    const size_t rs_b,
+                    const size_t cs_b,
+                    T* c,
+                    const size_t ldc,
+                    const GemmEpilogue<T>& epilogue) const;
+
+    void pack_a(const size_t mc,
+                const size_t kc,
+                const T* a,
+                const size_t rs_a,
+                const size_t cs_a,
+                T* packed) const;
+
+    void pack_b(const size_t kc,
+                const size_t nc,
+                const T* b,
+                const size_t rs_b,
+                const size_t cs_b,
+                T* packed) const;
+
+    void macro_kernel(const size_t mc,
+                      const size_t nc,
+                      const size_t kc,
+                      const T* packed_a,
+                      const T* packed_b,
+                      T* c,
+                      const size_t ldc,
+                      const bool accumulate,
+                      const GemmEpilogue<T>* epilogue) const;
+
+private:
+    abcdl::utils::ParallelOperator<T> _po;
+};//class MatrixGemm
+
+}//namespace algebra
+}//namespace abcdl
@@ -8,6 +8,13 @@
 #pragma once
 
 #include "algebra/Matrix.h"
+#include "algebra/MatrixFFT.h"
+#include "algebra/MatrixGemm.h"
+#include "algebra/MatrixKernel.h"
+#include "algebra/MatrixView.h"
+#include "algebra/MatrixWinograd.h"
+#include "algebra/PaddedMatrix.h"
+#include "algebra/Tensor.h"
 #include "utils/ParallelOperator.h"
 
 namespace abcdl{
@@ -15,6 +22,15 @@ namespace algebra{
 
 using abcdl::algebra::Matrix;
 
+enum Activate_type{
+    LINEAR = 0,
+    SIGMOID,
+    TANH,
+    RELU,
+    LEAKY_RELU,
+    ELU
+};
+
 template<class T>
 class MatrixHelper{
 public:
@@ -22,6 +38,38 @@ public:
     void dot(Matrix<T>& mat,
              const Matrix<T>& mat_a,
              const Matrix<T>& mat_b);
+    //views are read through their strides, slices and transposes are not copied
+    Matrix<T> dot(const MatrixView<T>& view_a, const MatrixView<T>& view_b);
+    void dot(Matrix<T>& mat,
+             const MatrixView<T>& view_a,
+             const MatrixView<T>& view_b);
+    //rows of mat are written at its pitch, mat must not overlap the operands
+    void dot(PaddedMatrix<T>& mat,
+             const MatrixView<T>& view_a,
+             const MatrixView<T>& view_b);
+    /*
+     * mat = activate(mat_a * mat_b + bias), bias is a 1 x mat_b.cols() row.
+     * bias and activation run on every gemm tile before it is stored.
+     */
+    void dot_bias_activate(Matrix<T>& mat,
+                           const Matrix<T>& mat_a,
+                           const Matrix<T>& mat_b,
+                           const Matrix<T>& bias,
+                           const Activate_type type);
+    void dot_bias_activate(Matrix<T>& mat,
+                           const MatrixView<T>& view_a,
+                           const MatrixView<T>& view_b,
+                           const Matrix<T>& bias,
+                           const Activate_type type);
+    /*
+     * mat = (delta * weight.T) .* derivative(activate_data),
+     * activate_data is the output of type, weight.T is never built.
+     */
+    void dot_transpose_derivative(Matrix<T>& mat,
+                                  const Matrix<T>& delta,
+                                  const Matrix<T>& weight,
+                                  const Matrix<T>& activate_data,
+                                  const Activate_type type);
     Matrix<T> outer(const Matrix<T>& mat_a, const Matrix<T>& mat_b);
     void outer(Matrix<T>& mat,
                const Matrix<T>& mat_a,
@@ -35,9 +83,13 @@ public:
     void sin(Matrix<T>& mat, const Matrix<T>& mat_a);
     void cos(Matrix<T>& mat, const Matrix<T>& mat_a);
     void sigmoid(Matrix<T>& mat, const Matrix<T>& mat_a);
+    //mat_a is sigmoid(z), mat = a * (1 - a)
     void sigmoid_derivative(Matrix<T>& mat, const Matrix<T>& mat_a);
     void softmax(Matrix<T>& mat, const Matrix<T>& mat_a);
+    //softmax of every row(ROW) or column(COL) on its own
+    void softmax(Matrix<T>& mat, const Matrix<T>& mat_a, const Axis_type axis_type);
     void tanh(Matrix<T>& mat, const Matrix<T>& mat_a);
+    //mat_a is tanh(z), not z, mat = 1 - a * a
     void tanh_derivative(Matrix<T>& mat, const Matrix<T>& mat_a);
     void relu(Matrix<T>& mat, const Matrix<T>& mat_a);
     void relu_derivative(Matrix<T>& mat, const Matrix<T>& mat_a);
@@ -50,18 +102,77 @@ public:
                 const size_t row_dim,
                 const size_t col_dim);
 
+    /*
+     * conv_size and padding (0 before the first value) of a convolution
+     * of size values by kernal_size at stride:
+     *   VALID: no padding, the last window may pass the end and read 0
+     *   FULL:  kernal_size - 1 on both sides
+     *   SAME:  size / stride rounded up, padding split evenly, the extra one after
+     */
+    static bool conv_dim(const size_t size,
+                         const size_t kernal_size,
+                         const size_t stride,
+                         const Convn_type type,
+                         size_t* conv_size,
+                         size_t* padding);
+
+    /*
+     * no padded copy of mat is made for FULL and SAME.
+     * 3 x 3 floating point kernals at stride 1 go through MatrixWinograd,
+     * large kernals and large FULL convolutions through MatrixFFT.
+     */
     bool convn(Matrix<T>& result,
                const Matrix<T>& mat,
                const Matrix<T>& kernal,
                const size_t stride,
                const Convn_type type = VALID);
+    /*
+     * lowers the channels of sample n into one patch matrix,
+     * row (channel, k_i, k_j) has one column per output position of convn,
+     * so kernals * result convolves every channel by a single gemm.
+     */
+    bool im2col(Matrix<T>& result,
+                const Tensor<T>& tensor,
+                const size_t n,
+                const size_t kernal_row,
+                const size_t kernal_col,
+                const size_t stride,
+                const Convn_type type = VALID);
+    //sample n of tensor = sum of the patches over the positions they were taken from
+    bool col2im(Tensor<T>& tensor,
+                const size_t n,
+                const Matrix<T>& patches,
+                const size_t kernal_row,
+                const size_t kernal_col,
+                const size_t stride,
+                const Convn_type type = VALID);
 
     void transpose(Matrix<T>& mat, const Matrix<T>& mat_a);
 
     void zero_like(Matrix<T>& mat, const Matrix<T>& mat_a);
 
+private:
+    /*
+     * buffer for a rows x cols result: the buffer of mat when it shares
+     * no memory with the operands, otherwise a new one for set_allocated_data.
+     */
+    T* result_data(Matrix<T>& mat,
+                   const size_t rows,
+                   const size_t cols,
+                   const MatrixView<T>& view_a,
+                   const MatrixView<T>& view_b,
+                   const Matrix<T>* mat_c = nullptr);
+
+    typedef void (*Kernel)(T*, const T*, const size_t);
+    Kernel activate_kernel(const Activate_type type) const;
+    Kernel derivative_kernel(const Activate_type type) const;
+
 private:
     abcdl::utils::ParallelOperator<T> _po;
+    MatrixGemm<T> _gemm;
+    MatrixWinograd<T> _winograd;
+    //kernal spectra of this helper, reused while the kernals are unchanged
+    MatrixFFT<T> _fft;
 };//class MatrixHelper
 
 }//namespace algebra
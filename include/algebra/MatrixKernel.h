@@ -0,0 +1,74 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 13:20
+* Last modified: 2026-10-17 13:20
+* Filename: MatrixKernel.h
+* Description: elementwise kernels, vectorized for
+*              float/double with runtime dispatch
+**********************************************/
+#pragma once
+
+#include <cstddef>
+
+namespace abcdl{
+namespace algebra{
+
+enum Simd_type{
+    SIMD_NONE = 0,
+    SIMD_SSE4_2,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+/*
+ * Every kernel works on a continuous array of size elements, c may alias a or b.
+ * float and double pick SSE4.2/AVX2/AVX-512 code once at startup by cpuid,
+ * env ABCDL_SIMD(none, sse4.2, avx2, avx512) limits the instruction set.
+ * exp, sigmoid and tanh use polynomial approximations on the simd path.
+ * Other types always run the scalar code.
+ */
+template<class T>
+class MatrixKernel{
+public:
+    static Simd_type get_simd_type();
+
+    static void add(T* c, const T* a, const T* b, const size_t size);
+    static void sub(T* c, const T* a, const T* b, const size_t size);
+    static void mul(T* c, const T* a, const T* b, const size_t size);
+    static void div(T* c, const T* a, const T* b, const size_t size);
+
+    static void add_scalar(T* c, const T* a, const T b, const size_t size);
+    static void sub_scalar(T* c, const T* a, const T b, const size_t size);
+    static void mul_scalar(T* c, const T* a, const T b, const size_t size);
+    static void div_scalar(T* c, const T* a, const T b, const size_t size);
+
+    static void exp(T* c, const T* a, const size_t size);
+    //c = exp(max(a - max_value, SOFTMAX_MIN))
+    static void softmax_exp(T* c, const T* a, const T max_value, const size_t size);
+    static void sigmoid(T* c, const T* a, const size_t size);
+    static void sigmoid_derivative(T* c, const T* a, const size_t size);
+    static void tanh(T* c, const T* a, const size_t size);
+    //a is tanh(z), c = 1 - a * a
+    static void tanh_derivative(T* c, const T* a, const size_t size);
+    static void relu(T* c, const T* a, const size_t size);
+    static void relu_derivative(T* c, const T* a, const size_t size);
+    static void leaky_relu(T* c, const T* a, const size_t size);
+    static void leaky_relu_derivative(T* c, const T* a, const size_t size);
+    static void elu(T* c, const T* a, const size_t size);
+    static void elu_derivative(T* c, const T* a, const size_t size);
+
+    //pooling: where a > c, c = a and index = id
+    static void max_index(T* c, T* index, const T* a, const T id, const size_t size);
+    //pooling: c += a * a
+    static void square_add(T* c, const T* a, const size_t size);
+
+    /*
+     * gemm micro kernel: ab = a * b, a is a packed MR-row panel and b a packed
+     * NR-col panel kc deep, ab is MR x NR row-major, MR and NR of GemmBlock<T>.
+     * The tile stays in registers for the whole kc loop.
+     */
+    static void gemm_tile(T* ab, const T* a, const T* b, const size_t kc);
+};//class MatrixKernel
+
+}//namespace algebra
+}//namespace abcdl
@@ -0,0 +1,394 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 13:20
+* Last modified: 2026-10-17 13:20
+* Filename: MatrixKernelSimd.h
+* Description: instruction set independent body of the
+*              simd kernels, only for MatrixKernel.cpp
+**********************************************/
+
+/*
+ * No include guard: MatrixKernel.cpp includes this file once per instruction
+ * set, inside a namespace compiled with the matching target pragma, after
+ * defining VecFloat and VecDouble with:
+ *   scalar, reg, mask, WIDTH,
+ *   zero, set1, load, store, add, sub, mul, div, min, max, fmadd,
+ *   round, pow2n, lt, ge, gt, select.
+ */
+
+template<class V, class F>
+inline void unary_loop(typename V::scalar* c,
+                       const typename V::scalar* a,
+                       const size_t size,
+                       F f){
+    typedef typename V::scalar T;
+    size_t i = 0;
+    for(; i + V::WIDTH <= size; i += V::WIDTH){
+        V::store(&c[i], f(V::load(&a[i])));
+    }
+    //the tail goes through the same vector code to keep results consistent
+    if(i != size){
+        T buf_a[V::WIDTH] = {0};
+        T buf_c[V::WIDTH];
+        for(size_t j = i; j != size; j++){
+            buf_a[j - i] = a[j];
+        }
+        V::store(buf_c, f(V::load(buf_a)));
+        for(size_t j = i; j != size; j++){
+            c[j] = buf_c[j - i];
+        }
+    }
+}
+
+template<class V, class F>
+inline void binary_loop(typename V::scalar* c,
+                        const typename V::scalar* a,
+                        const typename V::scalar* b,
+                        const size_t size,
+                        F f){
+    typedef typename V::scalar T;
+    size_t i = 0;
+    for(; i + V::WIDTH <= size; i += V::WIDTH){
+        V::store(&c[i], f(V::load(&a[i]), V::load(&b[i])));
+    }
+    if(i != size){
+        //pad b with 1, so div does not raise on the unused lanes
+        T buf_a[V::WIDTH] = {0};
+        T buf_b[V::WIDTH];
+        T buf_c[V::WIDTH];
+        for(size_t j = 0; j != V::WIDTH; j++){
+            buf_b[j] = 1;
+        }
+        for(size_t j = i; j != size; j++){
+            buf_a[j - i] = a[j];
+            buf_b[j - i] = b[j];
+        }
+        V::store(buf_c, f(V::load(buf_a), V::load(buf_b)));
+        for(size_t j = i; j != size; j++){
+            c[j] = buf_c[j - i];
+        }
+    }
+}
+
+/*
+ * exp(x) = 2^n * exp(r), n = round(x / ln2), |r| <= ln2 / 2.
+ * ln2 is split in two parts to keep r exact, exp(r) is a polynomial:
+ * cephes minimax of degree 7 for float, taylor of degree 11 for double.
+ */
+template<class V>
+inline typename V::reg vexp(typename V::reg x){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const bool is_float = sizeof(T) == sizeof(float);
+
+    x = V::min(x, V::set1(is_float ? (T)88.3762626647949 : (T)709.0));
+    x = V::max(x, V::set1(is_float ? (T)-87.3365447505531 : (T)-708.3964185322641));
+
+    reg n = V::round(V::mul(x, V::set1((T)1.44269504088896341)));
+    x = V::sub(x, V::mul(n, V::set1(is_float ? (T)0.693359375 : (T)6.93145751953125E-1)));
+    x = V::sub(x, V::mul(n, V::set1(is_float ? (T)-2.12194440e-4 : (T)1.42860682030941723212E-6)));
+
+    reg y;
+    if(is_float){
+        y = V::set1((T)1.9875691500E-4);
+        y = V::fmadd(y, x, V::set1((T)1.3981999507E-3));
+        y = V::fmadd(y, x, V::set1((T)8.3334519073E-3));
+        y = V::fmadd(y, x, V::set1((T)4.1665795894E-2));
+        y = V::fmadd(y, x, V::set1((T)1.6666665459E-1));
+        y = V::fmadd(y, x, V::set1((T)5.0000001201E-1));
+        y = V::fmadd(y, x, V::set1((T)1));
+        y = V::fmadd(y, x, V::set1((T)1));
+    }else{
+        y = V::set1((T)(1.0 / 39916800.0));
+        y = V::fmadd(y, x, V::set1((T)(1.0 / 3628800.0)));
+        y = V::fmadd(y, x, V::set1((T)(1.0 / 362880.0)));
+        y = V::fmadd(y, x, V::set1((T)(1.0 / 40320.0)));
+        y = V::fmadd(y, x, V::set1((T)(1.0 / 5040.0)));
+        y = V::fmadd(y, x, V::set1((T)(1.0 / 720.0)));
+        y = V::fmadd(y, x, V::set1((T)(1.0 / 120.0)));
+        y = V::fmadd(y, x, V::set1((T)(1.0 / 24.0)));
+        y = V::fmadd(y, x, V::set1((T)(1.0 / 6.0)));
+        y = V::fmadd(y, x, V::set1((T)0.5));
+        y = V::fmadd(y, x, V::set1((T)1));
+        y = V::fmadd(y, x, V::set1((T)1));
+    }
+    return V::mul(y, V::pow2n(n));
+}
+
+template<class V>
+void add(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar* b, const size_t size){
+    typedef typename V::reg reg;
+    binary_loop<V>(c, a, b, size, [](reg x, reg y){ return V::add(x, y); });
+}
+
+template<class V>
+void sub(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar* b, const size_t size){
+    typedef typename V::reg reg;
+    binary_loop<V>(c, a, b, size, [](reg x, reg y){ return V::sub(x, y); });
+}
+
+template<class V>
+void mul(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar* b, const size_t size){
+    typedef typename V::reg reg;
+    binary_loop<V>(c, a, b, size, [](reg x, reg y){ return V::mul(x, y); });
+}
+
+template<class V>
+void div(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar* b, const size_t size){
+    typedef typename V::reg reg;
+    binary_loop<V>(c, a, b, size, [](reg x, reg y){ return V::div(x, y); });
+}
+
+template<class V>
+void add_scalar(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar b, const size_t size){
+    typedef typename V::reg reg;
+    const reg value = V::set1(b);
+    unary_loop<V>(c, a, size, [value](reg x){ return V::add(x, value); });
+}
+
+template<class V>
+void sub_scalar(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar b, const size_t size){
+    typedef typename V::reg reg;
+    const reg value = V::set1(b);
+    unary_loop<V>(c, a, size, [value](reg x){ return V::sub(x, value); });
+}
+
+template<class V>
+void mul_scalar(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar b, const size_t size){
+    typedef typename V::reg reg;
+    const reg value = V::set1(b);
+    unary_loop<V>(c, a, size, [value](reg x){ return V::mul(x, value); });
+}
+
+template<class V>
+void div_scalar(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar b, const size_t size){
+    typedef typename V::reg reg;
+    const reg value = V::set1(b);
+    unary_loop<V>(c, a, size, [value](reg x){ return V::div(x, value); });
+}
+
+template<class V>
+void exp(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg exp_max = V::set1((T)EXP_MAX);
+    unary_loop<V>(c, a, size, [exp_max](reg x){ return vexp<V>(V::min(x, exp_max)); });
+}
+
+template<class V>
+void softmax_exp(typename V::scalar* c, const typename V::scalar* a, const typename V::scalar max_value, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg value = V::set1(max_value);
+    const reg softmax_min = V::set1((T)SOFTMAX_MIN);
+    unary_loop<V>(c, a, size, [value, softmax_min](reg x){
+        return vexp<V>(V::max(V::sub(x, value), softmax_min));
+    });
+}
+
+template<class V>
+void sigmoid(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg sigmoid_min = V::set1((T)SIGMOID_MIN);
+    const reg sigmoid_max = V::set1((T)SIGMOID_MAX);
+    const reg one = V::set1((T)1);
+    unary_loop<V>(c, a, size, [sigmoid_min, sigmoid_max, one](reg x){
+        x = V::min(sigmoid_max, V::max(x, sigmoid_min));
+        return V::div(one, V::add(one, vexp<V>(V::sub(V::zero(), x))));
+    });
+}
+
+template<class V>
+void sigmoid_derivative(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg one = V::set1((T)1);
+    unary_loop<V>(c, a, size, [one](reg x){ return V::mul(x, V::sub(one, x)); });
+}
+
+template<class V>
+void tanh(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg exp_max = V::set1((T)EXP_MAX);
+    const reg minus_two = V::set1((T)-2);
+    const reg one = V::set1((T)1);
+    const reg two = V::set1((T)2);
+    unary_loop<V>(c, a, size, [exp_max, minus_two, one, two](reg x){
+        reg e = vexp<V>(V::min(exp_max, V::mul(minus_two, x)));
+        return V::sub(V::div(two, V::add(one, e)), one);
+    });
+}
+
+template<class V>
+void tanh_derivative(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg one = V::set1((T)1);
+    unary_loop<V>(c, a, size, [one](reg x){ return V::sub(one, V::mul(x, x)); });
+}
+
+template<class V>
+void relu(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::reg reg;
+    unary_loop<V>(c, a, size, [](reg x){ return V::select(V::lt(x, V::zero()), V::zero(), x); });
+}
+
+template<class V>
+void relu_derivative(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg one = V::set1((T)1);
+    unary_loop<V>(c, a, size, [one](reg x){ return V::select(V::gt(x, V::zero()), one, V::zero()); });
+}
+
+template<class V>
+void leaky_relu(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg slope = V::set1((T)0.01);
+    unary_loop<V>(c, a, size, [slope](reg x){ return V::select(V::lt(x, V::zero()), V::mul(x, slope), x); });
+}
+
+template<class V>
+void leaky_relu_derivative(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg one = V::set1((T)1);
+    const reg slope = V::set1((T)0.01);
+    unary_loop<V>(c, a, size, [one, slope](reg x){ return V::select(V::ge(x, V::zero()), one, slope); });
+}
+
+template<class V>
+void elu(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg exp_max = V::set1((T)EXP_MAX);
+    const reg one = V::set1((T)1);
+    unary_loop<V>(c, a, size, [exp_max, one](reg x){
+        reg e = V::sub(vexp<V>(V::min(exp_max, x)), one);
+        return V::select(V::ge(x, V::zero()), x, e);
+    });
+}
+
+template<class V>
+void elu_derivative(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const reg exp_max = V::set1((T)EXP_MAX);
+    const reg one = V::set1((T)1);
+    unary_loop<V>(c, a, size, [exp_max, one](reg x){
+        return V::select(V::ge(x, V::zero()), one, vexp<V>(V::min(exp_max, x)));
+    });
+}
+
+template<class V>
+void max_index(typename V::scalar* c,
+               typename V::scalar* index,
+               const typename V::scalar* a,
+               const typename V::scalar id,
+               const size_t size){
+    typedef typename V::reg reg;
+    typedef typename V::mask mask;
+    const reg value = V::set1(id);
+    size_t i = 0;
+    for(; i + V::WIDTH <= size; i += V::WIDTH){
+        reg x = V::load(&a[i]);
+        reg y = V::load(&c[i]);
+        mask m = V::gt(x, y);
+        V::store(&c[i], V::select(m, x, y));
+        V::store(&index[i], V::select(m, value, V::load(&index[i])));
+    }
+    for(; i != size; i++){
+        if(a[i] > c[i]){
+            c[i] = a[i];
+            index[i] = id;
+        }
+    }
+}
+
+template<class V>
+void square_add(typename V::scalar* c, const typename V::scalar* a, const size_t size){
+    typedef typename V::reg reg;
+    binary_loop<V>(c, c, a, size, [](reg x, reg y){ return V::fmadd(y, y, x); });
+}
+
+/*
+ * MR x NR accumulators in MR * NR / WIDTH registers, a row of b is NR / WIDTH
+ * loads, every value of a is broadcast once and multiplied into its row.
+ * Only filled where WIDTH divides NR.
+ */
+template<class V>
+void gemm_tile(typename V::scalar* ab, const typename V::scalar* a, const typename V::scalar* b, const size_t kc){
+    typedef typename V::scalar T;
+    typedef typename V::reg reg;
+    const size_t MR = GemmBlock<T>::MR;
+    const size_t NR = GemmBlock<T>::NR;
+    const size_t NV = NR / V::WIDTH;
+
+    reg c[MR][NV];
+    for(size_t i = 0; i != MR; i++){
+        for(size_t j = 0; j != NV; j++){
+            c[i][j] = V::zero();
+        }
+    }
+    for(size_t p = 0; p != kc; p++){
+        reg b_row[NV];
+        for(size_t j = 0; j != NV; j++){
+            b_row[j] = V::load(&b[j * V::WIDTH]);
+        }
+        for(size_t i = 0; i != MR; i++){
+            reg a_value = V::set1(a[i]);
+            for(size_t j = 0; j != NV; j++){
+                c[i][j] = V::fmadd(a_value, b_row[j], c[i][j]);
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+    for(size_t i = 0; i != MR; i++){
+        for(size_t j = 0; j != NV; j++){
+            V::store(&ab[i * NR + j * V::WIDTH], c[i][j]);
+        }
+    }
+}
+
+template<class V, bool FIT = GemmBlock<typename V::scalar>::NR % V::WIDTH == 0>
+struct GemmTable{
+    static void fill(KernelTable<typename V::scalar>* table){
+        table->gemm_tile = &gemm_tile<V>;
+    }
+};
+
+template<class V>
+struct GemmTable<V, false>{
+    static void fill(KernelTable<typename V::scalar>* table){}
+};
+
+template<class V>
+void fill_table(KernelTable<typename V::scalar>* table){
+    table->add = &add<V>;
+    table->sub = &sub<V>;
+    table->mul = &mul<V>;
+    table->div = &div<V>;
+    table->add_scalar = &add_scalar<V>;
+    table->sub_scalar = &sub_scalar<V>;
+    table->mul_scalar = &mul_scalar<V>;
+    table->div_scalar = &div_scalar<V>;
+    table->exp = &exp<V>;
+    table->softmax_exp = &softmax_exp<V>;
+    table->sigmoid = &sigmoid<V>;
+    table->sigmoid_derivative = &sigmoid_derivative<V>;
+    table->tanh = &tanh<V>;
+    table->tanh_derivative = &tanh_derivative<V>;
+    table->relu = &relu<V>;
+    table->relu_derivative = &relu_derivative<V>;
+    table->leaky_relu = &leaky_relu<V>;
+    table->leaky_relu_derivative = &leaky_relu_derivative<V>;
+    table->elu = &elu<V>;
+    table->elu_derivative = &elu_derivative<V>;
+    table->max_index = &max_index<V>;
+    table->square_add = &square_add<V>;
+    GemmTable<V>::fill(table);
+}
@@ -20,7 +20,10 @@ public:
         _mats.push_back(mat);
     }
 
-    abcdl::algebra::Matrix<T> operator [] (size_t idx) const{
+    const abcdl::algebra::Matrix<T>& operator [] (size_t idx) const{
+        return _mats[idx];
+    }
+    abcdl::algebra::Matrix<T>& operator [] (size_t idx){
         return _mats[idx];
     }
 
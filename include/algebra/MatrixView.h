@@ -0,0 +1,103 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 14:10
+* Last modified: 2026-10-17 14:10
+* Filename: MatrixView.h
+* Description: non-owning strided view of matrix data
+**********************************************/
+#pragma once
+
+#include "algebra/Matrix.h"
+
+namespace abcdl{
+namespace algebra{
+
+/*
+ * Element (i, j) of a view is data[i * row_stride + j * col_stride].
+ * Row ranges, col ranges and transposes only change the pointer and
+ * strides, the viewed matrix must outlive the view.
+ * A view is read only, it can be taken of a const matrix,
+ * writes go through the matrix or tensor that owns the data.
+ */
+template<class T>
+class MatrixView{
+public:
+    MatrixView(const Matrix<T>& mat){
+        _data       = mat.data();
+        _rows       = mat.rows();
+        _cols       = mat.cols();
+        _row_stride = mat.cols();
+        _col_stride = 1;
+    }
+    MatrixView(const T* data,
+               const size_t rows,
+               const size_t cols,
+               const size_t row_stride,
+               const size_t col_stride = 1){
+        _data       = data;
+        _rows       = rows;
+        _cols       = cols;
+        _row_stride = row_stride;
+        _col_stride = col_stride;
+    }
+
+    inline size_t rows() const { return _rows; }
+    inline size_t cols() const { return _cols; }
+    inline size_t get_size() const { return _rows * _cols; }
+    inline size_t row_stride() const { return _row_stride; }
+    inline size_t col_stride() const { return _col_stride; }
+    inline const T* data() const { return _data; }
+
+    inline const T& get_data(const size_t row_id, const size_t col_id) const{
+        CHECK(row_id < _rows && col_id < _cols);
+        return _data[row_id * _row_stride + col_id * _col_stride];
+    }
+
+    //rows are packed one after another, like a Matrix
+    inline bool is_continuous() const{
+        return _col_stride == 1 && (_row_stride == _cols || _rows <= 1);
+    }
+
+    MatrixView<T> row_range(const size_t row_id, const size_t row_size = 1) const{
+        CHECK(row_id + row_size <= _rows);
+        return MatrixView<T>(&_data[row_id * _row_stride], row_size, _cols, _row_stride, _col_stride);
+    }
+    MatrixView<T> col_range(const size_t col_id, const size_t col_size = 1) const{
+        CHECK(col_id + col_size <= _cols);
+        return MatrixView<T>(&_data[col_id * _col_stride], _rows, col_size, _row_stride, _col_stride);
+    }
+    MatrixView<T> row(const size_t row_id) const{
+        return row_range(row_id, 1);
+    }
+    MatrixView<T> col(const size_t col_id) const{
+        return col_range(col_id, 1);
+    }
+    MatrixView<T> transpose() const{
+        return MatrixView<T>(_data, _cols, _rows, _col_stride, _row_stride);
+    }
+
+    void copy_to(Matrix<T>* mat) const{
+        mat->resize(_rows, _cols);
+        T* data = mat->data();
+        for(size_t i = 0; i != _rows; i++){
+            const T* row_data = &_data[i * _row_stride];
+            if(_col_stride == 1){
+                memcpy(&data[i * _cols], row_data, sizeof(T) * _cols);
+            }else{
+                for(size_t j = 0; j != _cols; j++){
+                    data[i * _cols + j] = row_data[j * _col_stride];
+                }
+            }
+        }
+    }
+
+private:
+    const T* _data;
+    size_t _rows;
+    size_t _cols;
+    size_t _row_stride;
+    size_t _col_stride;
+};//class MatrixView
+
+}//namespace algebra
+}//namespace abcdl
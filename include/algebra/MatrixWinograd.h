@@ -0,0 +1,66 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 17:55
+* Last modified: 2026-10-17 17:55
+* Filename: MatrixWinograd.h
+* Description: winograd convolution of 3 x 3 kernals
+**********************************************/
+#pragma once
+
+#include <cstddef>
+#include "utils/ParallelOperator.h"
+
+namespace abcdl{
+namespace algebra{
+
+/*
+ * Winograd F(m x m, 3 x 3): the kernal is transformed once, then every
+ * (m + 2) x (m + 2) input tile gives an m x m output tile by (m + 2)^2
+ * multiplies instead of 9 * m * m.
+ *   F(2x2, 3x3): 16 instead of 36, 2.25x fewer
+ *   F(4x4, 3x3): 36 instead of 144, 4x fewer
+ * Input and output transforms only add, subtract and scale by constants.
+ */
+template<class T>
+class MatrixWinograd{
+public:
+    //floating point 3 x 3 kernal at stride 1
+    static bool is_supported(const size_t kernal_row,
+                             const size_t kernal_col,
+                             const size_t stride);
+
+    /*
+     * same as convn at stride 1, data is rows x cols padded by pad_row
+     * and pad_col zeros before the first value, result is conv_row x conv_col,
+     * values past the data read 0. Padding is never built, the tiles on
+     * the border are filled 0 where they leave the data.
+     * F(4x4, 3x3) is taken when the result has a full 4 x 4 tile.
+     */
+    void convn(T* result,
+               const size_t conv_row,
+               const size_t conv_col,
+               const T* data,
+               const size_t rows,
+               const size_t cols,
+               const T* kernal,
+               const size_t pad_row,
+               const size_t pad_col) const;
+
+private:
+    template<size_t M>
+    void convn_tile(T* result,
+                    const size_t conv_row,
+                    const size_t conv_col,
+                    const T* data,
+                    const size_t rows,
+                    const size_t cols,
+                    const T* kernal,
+                    const size_t pad_row,
+                    const size_t pad_col) const;
+
+private:
+    abcdl::utils::ParallelOperator<T> _po;
+};//class MatrixWinograd
+
+}//namespace algebra
+}//namespace abcdl
@@ -0,0 +1,113 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 16:05
+* Last modified: 2026-10-17 16:05
+* Filename: PaddedMatrix.h
+* Description: matrix whose rows start on an alignment boundary
+**********************************************/
+#pragma once
+
+#include "algebra/Matrix.h"
+#include "algebra/MatrixView.h"
+
+namespace abcdl{
+namespace algebra{
+
+/*
+ * Row i starts at data() + i * pitch(), pitch() is cols() rounded up to
+ * the alignment of the allocator. Threads which split the rows never
+ * write the same cache line, and every row is aligned for vector loads.
+ * Use view() wherever a MatrixView is taken.
+ */
+template<class T>
+class PaddedMatrix{
+public:
+    PaddedMatrix(){}
+    PaddedMatrix(const size_t rows, const size_t cols){
+        resize(rows, cols);
+    }
+    explicit PaddedMatrix(const MatrixView<T>& view){
+        copy_from(view);
+    }
+    PaddedMatrix(const PaddedMatrix<T>&) = delete;
+    PaddedMatrix<T>& operator = (const PaddedMatrix<T>&) = delete;
+    ~PaddedMatrix(){
+        release_data();
+    }
+
+    inline size_t rows() const { return _rows; }
+    inline size_t cols() const { return _cols; }
+    inline size_t pitch() const { return _pitch; }
+    inline T* data() const { return _data; }
+    inline T* row_data(const size_t row_id) const { return &_data[row_id * _pitch]; }
+    inline T& get_data(const size_t row_id, const size_t col_id) const{
+        CHECK(row_id < _rows && col_id < _cols);
+        return _data[row_id * _pitch + col_id];
+    }
+
+    inline MatrixView<T> view() const{
+        return MatrixView<T>(_data, _rows, _cols, _pitch, 1);
+    }
+
+    //values are not kept, the padding is zero
+    void resize(const size_t rows, const size_t cols){
+        size_t alignment = _allocator->get_alignment();
+        size_t pitch = cols;
+        if(alignment % sizeof(T) == 0){
+            size_t align_size = alignment / sizeof(T);
+            pitch = (cols + align_size - 1) / align_size * align_size;
+        }
+        size_t size = rows * pitch;
+        if(_data == nullptr || _capacity < size){
+            release_data();
+            _data = static_cast<T*>(_allocator->allocate(sizeof(T) * size));
+            _capacity = size;
+        }
+        _rows  = rows;
+        _cols  = cols;
+        _pitch = pitch;
+        if(pitch != cols){
+            for(size_t i = 0; i != rows; i++){
+                memset(&_data[i * pitch + cols], 0, sizeof(T) * (pitch - cols));
+            }
+        }
+    }
+
+    void copy_from(const MatrixView<T>& view){
+        resize(view.rows(), view.cols());
+        for(size_t i = 0; i != _rows; i++){
+            T* data = row_data(i);
+            const T* src_data = &view.data()[i * view.row_stride()];
+            if(view.col_stride() == 1){
+                memcpy(data, src_data, sizeof(T) * _cols);
+            }else{
+                for(size_t j = 0; j != _cols; j++){
+                    data[j] = src_data[j * view.col_stride()];
+                }
+            }
+        }
+    }
+    void copy_to(Matrix<T>* mat) const{
+        view().copy_to(mat);
+    }
+
+private:
+    inline void release_data(){
+        if(_data != nullptr){
+            _allocator->deallocate(_data, sizeof(T) * _capacity);
+        }
+        _data = nullptr;
+        _capacity = 0;
+    }
+
+private:
+    size_t _rows = 0;
+    size_t _cols = 0;
+    size_t _pitch = 0;
+    T* _data = nullptr;
+    size_t _capacity = 0;
+    Allocator* _allocator = Allocator::get_current();
+};//class PaddedMatrix
+
+}//namespace algebra
+}//namespace abcdl
@@ -0,0 +1,194 @@
+/**********************************************
+* Author: Jun Jiang - jiangjun4@sina.com
+* Created: 2026-10-17 17:20
+* Last modified: 2026-10-17 17:20
+* Filename: Tensor.h
+* Description: contiguous multi-channel matrix
+**********************************************/
+#pragma once
+
+#include <vector>
+#include "algebra/Matrix.h"
+#include "algebra/MatrixView.h"
+
+namespace abcdl{
+namespace algebra{
+
+enum Tensor_layout{
+    NCHW = 0,
+    NHWC
+};
+
+/*
+ * num x channels x rows x cols values in one buffer. NCHW keeps every
+ * channel as a continuous rows x cols block, NHWC keeps the channels of
+ * a position together. get_matrix() and get_channel() are views on the
+ * buffer, writes go to the tensor while their shape is not changed.
+ */
+template<class T>
+class Tensor{
+public:
+    Tensor(){}
+    Tensor(const size_t num,
+           const size_t channels,
+           const size_t rows,
+           const size_t cols,
+           const Tensor_layout layout = NCHW){
+        resize(num, channels, rows, cols, layout);
+    }
+    Tensor(const Tensor<T>&) = delete;
+    Tensor<T>& operator = (const Tensor<T>&) = delete;
+    ~Tensor(){
+        release_data();
+    }
+
+    inline size_t num() const { return _num; }
+    inline size_t channels() const { return _channels; }
+    inline size_t rows() const { return _rows; }
+    inline size_t cols() const { return _cols; }
+    inline Tensor_layout get_layout() const { return _layout; }
+    inline size_t get_size() const { return _num * _channels * _rows * _cols; }
+    inline T* data() const { return _data; }
+
+    inline size_t offset(const size_t n,
+                         const size_t c,
+                         const size_t row_id,
+                         const size_t col_id) const{
+        if(_layout == NCHW){
+            return ((n * _channels + c) * _rows + row_id) * _cols + col_id;
+        }
+        return ((n * _rows + row_id) * _cols + col_id) * _channels + c;
+    }
+    inline T& get_data(const size_t n,
+                       const size_t c,
+                       const size_t row_id,
+                       const size_t col_id) const{
+        CHECK(n < _num && c < _channels && row_id < _rows && col_id < _cols);
+        return _data[offset(n, c, row_id, col_id)];
+    }
+
+    //NCHW: (num * channels) x (rows * cols), NHWC: (num * rows * cols) x channels
+    inline Matrix<T>& get_matrix(){ return _matrix; }
+    inline const Matrix<T>& get_matrix() const { return _matrix; }
+
+    //rows x cols matrix of channel c of sample n, NCHW only
+    inline Matrix<T>& get_channel(const size_t n, const size_t c){
+        CHECK(_layout == NCHW && n < _num && c < _channels);
+        return _channel_matrices[n * _channels + c];
+    }
+    inline const Matrix<T>& get_channel(const size_t n, const size_t c) const{
+        CHECK(_layout == NCHW && n < _num && c < _channels);
+        return _channel_matrices[n * _channels + c];
+    }
+
+    //channel c of sample n in any layout
+    inline MatrixView<T> view(const size_t n, const size_t c) const{
+        if(_layout == NCHW){
+            return MatrixView<T>(&_data[offset(n, c, 0, 0)], _rows, _cols, _cols, 1);
+        }
+        return MatrixView<T>(&_data[offset(n, c, 0, 0)], _rows, _cols, _cols * _channels, _channels);
+    }
+
+    //values are not kept
+    void resize(const size_t num,
+                const size_t channels,
+                const size_t rows,
+                const size_t cols,
+                const Tensor_layout layout = NCHW){
+        size_t size = num * channels * rows * cols;
+        if(_data == nullptr || _capacity < size){
+            release_data();
+            _data = static_cast<T*>(_allocator->allocate(sizeof(T) * size));
+            _capacity = size;
+        }
+        _num      = num;
+        _channels = channels;
+        _rows     = rows;
+        _cols     = cols;
+        _layout   = layout;
+        bind_matrices();
+    }
+
+    void reset(const T& value = 0){
+        if(get_size() != 0){
+            _matrix.reset(value);
+        }
+    }
+
+    //reorders the values into layout
+    void to_layout(const Tensor_layout layout){
+        if(layout == _layout){
+            return;
+        }
+        if(_data == nullptr){
+            _layout = layout;
+            bind_matrices();
+            return;
+        }
+
+        T* data = static_cast<T*>(_allocator->allocate(sizeof(T) * _capacity));
+        size_t plane = _rows * _cols;
+        for(size_t n = 0; n != _num; n++){
+            for(size_t c = 0; c != _channels; c++){
+                for(size_t i = 0; i != plane; i++){
+                    size_t nchw = (n * _channels + c) * plane + i;
+                    size_t nhwc = (n * plane + i) * _channels + c;
+                    if(layout == NHWC){
+                        data[nhwc] = _data[nchw];
+                    }else{
+                        data[nchw] = _data[nhwc];
+                    }
+                }
+            }
+        }
+
+        size_t capacity = _capacity;
+        release_data();
+        _data     = data;
+        _capacity = capacity;
+        _layout   = layout;
+        bind_matrices();
+    }
+
+private:
+    void bind_matrices(){
+        if(_layout == NCHW){
+            _matrix.set_view_data(_data, _num * _channels, _rows * _cols);
+
+            size_t size = _num * _channels;
+            if(_channel_matrices.size() != size){
+                //never copied, a copy of a view owns its data
+                std::vector<Matrix<T>>(size).swap(_channel_matrices);
+            }
+            for(size_t i = 0; i != size; i++){
+                _channel_matrices[i].set_view_data(&_data[i * _rows * _cols], _rows, _cols);
+            }
+        }else{
+            _matrix.set_view_data(_data, _num * _rows * _cols, _channels);
+            _channel_matrices.clear();
+        }
+    }
+
+    inline void release_data(){
+        if(_data != nullptr){
+            _allocator->deallocate(_data, sizeof(T) * _capacity);
+        }
+        _data = nullptr;
+        _capacity = 0;
+    }
+
+private:
+    size_t _num      = 0;
+    size_t _channels = 0;
+    size_t _rows     = 0;
+    size_t _cols     = 0;
+    Tensor_layout _layout = NCHW;
+    T* _data = nullptr;
+    size_t _capacity = 0;
+    Allocator* _allocator = Allocator::get_current();
+    Matrix<T> _matrix;
+    std::vector<Matrix<T>> _channel_matrices;
+};//class Tensor
+
+}//namespace algebra
+}//namespace abcdl
@@ -38,6 +38,9 @@ public:
 
 	bool load_model(const std::string& path){return true;}
 	bool write_model(const std::string& path){return true;}
+
+    //temporaries of every training step, get_stats() shows its heap allocations
+    const abcdl::algebra::ArenaAllocator& get_arena() const { return _arena; }
 private:
     size_t evaluate(const abcdl::algebra::MatSet& data, const abcdl::algebra::MatSet& label);
     void forward(const abcdl::algebra::Mat& mat);
@@ -50,6 +53,7 @@ private:
     size_t _batch_size = 1;
     real _alpha = 0.1f;
 	std::vector<abcdl::cnn::Layer*> _layers;
+    abcdl::algebra::ArenaAllocator _arena;
 
 	//abcdl::utils::ModelLoader _model_loader;
 };//class CNN
@@ -14,6 +14,7 @@
 #include "framework/ActivateFunc.h"
 #include "algebra/Matrix.h"
 #include "algebra/MatrixHelper.h"
+#include "algebra/Tensor.h"
 #include "utils/Log.h"
 
 namespace abcdl{
@@ -32,23 +33,9 @@ public:
         _layer_type(layer_type){}
 
     virtual ~Layer(){
-        for(auto& weight : _batch_weights){delete weight;}
-        _batch_weights.clear();
         delete _batch_bias;
-
-        for(auto& weight : _delta_weights){delete weight;}
-        _delta_weights.clear();
         delete _delta_bias;
-
-        for(auto& weight : _weights){delete weight;}
-        _weights.clear();
         delete _bias;
-
-        for(auto& delta : _deltas){delete delta;}
-        _deltas.clear();
-
-        for(auto& activation : _activations){delete activation;}
-        _activations.clear();
     }
 
 	size_t get_rows() const { return _rows; }
@@ -64,31 +51,32 @@ public:
     void update_gradient(const size_t batch_size,
                          const real alpha){
         real learning_rate = alpha / batch_size;
-        for(size_t i = 0; i != _weights.size(); i++){
-            _weights[i]->operator-=(_batch_weights[i]->operator*(learning_rate));
+        if(_weights.get_size() > 0){
+            _weights.get_matrix().operator-=(_batch_weights.get_matrix().operator*(learning_rate));
         }
         if(_bias->get_size() > 0){
             _bias->operator-=(_batch_bias->operator*(learning_rate));
         }
 
-        for(auto& weight : _batch_weights){
-            weight->reset();
-        }
+        _batch_weights.reset();
         _batch_bias->reset();
     }
 
-	abcdl::algebra::Mat& get_activation(size_t id) const{
-		CHECK(id < _activations.size());
-		return *_activations[id];
+    //all channels in one buffer, channel id of sample 0 is get_activation(id)
+    inline abcdl::algebra::Tensor<real>& get_activations(){ return _activations; }
+    inline abcdl::algebra::Tensor<real>& get_deltas(){ return _deltas; }
+
+	abcdl::algebra::Mat& get_activation(size_t id){
+		CHECK(id < _out_channel_size);
+		return _activations.get_channel(0, id);
 	}
-	inline abcdl::algebra::RandomMatrix<real>& get_weight(const size_t in_channel_id, const size_t out_channel_id) const{
-        size_t size = in_channel_id * _out_channel_size + out_channel_id;
-        CHECK(size < _weights.size());
-		return *_weights[size];
+	inline abcdl::algebra::Mat& get_weight(const size_t in_channel_id, const size_t out_channel_id){
+        CHECK(in_channel_id < _in_channel_size && out_channel_id < _out_channel_size);
+		return _weights.get_channel(out_channel_id, in_channel_id);
 	}
-    abcdl::algebra::Mat& get_delta(const size_t id) const {
-        CHECK(id < _deltas.size());
-        return *_deltas[id];
+    abcdl::algebra::Mat& get_delta(const size_t id){
+        CHECK(id < _out_channel_size);
+        return _deltas.get_channel(0, id);
     }
 
 protected:
@@ -96,32 +84,41 @@ protected:
 						         const size_t out_channel_id,
                                  const abcdl::algebra::Mat& weight){
 		CHECK(in_channel_id < _in_channel_size && out_channel_id < _out_channel_size);
-        _delta_weights[in_channel_id * _out_channel_size + out_channel_id]->operator=(weight);
+        set_channel(_delta_weights.get_channel(out_channel_id, in_channel_id), weight);
 	}
 
 	abcdl::algebra::Mat& get_delta_weight(const size_t in_channel_id, const size_t out_channel_id){ 
 		CHECK(in_channel_id < _in_channel_size && out_channel_id < _out_channel_size);
-        size_t size = in_channel_id * _out_channel_size + out_channel_id;
-        return *_delta_weights[size];
+        return _delta_weights.get_channel(out_channel_id, in_channel_id);
 	}
 
 	inline void set_batch_weight(const size_t in_channel_id,
 						         const size_t out_channel_id,
        						     const abcdl::algebra::Mat& weight){
 		CHECK(in_channel_id < _in_channel_size && out_channel_id < _out_channel_size);
-        _batch_weights[in_channel_id * _out_channel_size + out_channel_id]->operator+=(weight);
+        _batch_weights.get_channel(out_channel_id, in_channel_id).operator+=(weight);
 	}
 
     void set_delta(const size_t id, const abcdl::algebra::Mat& delta){
         CHECK(id < _out_channel_size);
-        _deltas[id]->operator=(delta);
+        set_channel(_deltas.get_channel(0, id), delta);
     }
 
 	void set_activation(const size_t id, const abcdl::algebra::Mat& activation){
 		CHECK(id < _out_channel_size);
-        _activations[id]->operator=(activation);
+        set_channel(_activations.get_channel(0, id), activation);
 	}
 
+    //weights are out_channel_size x in_channel_size x rows x cols
+    void initialize_weights(const size_t rows, const size_t cols){
+        _weights.resize(_out_channel_size, _in_channel_size, rows, cols);
+        _weights.get_matrix().set_data(abcdl::algebra::RandomMatrix<real>(_weights.get_matrix().rows(), _weights.get_matrix().cols(), 0.0, 0.5));
+        _delta_weights.resize(_out_channel_size, _in_channel_size, rows, cols);
+        _delta_weights.reset();
+        _batch_weights.resize(_out_channel_size, _in_channel_size, rows, cols);
+        _batch_weights.reset();
+    }
+
 protected:
     size_t _rows;
     size_t _cols;
@@ -130,22 +127,27 @@ protected:
     abcdl::framework::Layer_type _layer_type;
     abcdl::algebra::MatrixHelper<real> _helper;
 
-    std::vector<abcdl::algebra::RandomMatrix<real>*> _weights;
+    abcdl::algebra::Tensor<real> _weights;
     abcdl::algebra::Mat* _bias = new abcdl::algebra::Mat();
-    std::vector<abcdl::algebra::Mat*> _activations;
+    abcdl::algebra::Tensor<real> _activations;
 
-    std::vector<abcdl::algebra::Mat*> _delta_weights;
+    abcdl::algebra::Tensor<real> _delta_weights;
     abcdl::algebra::Mat* _delta_bias = new abcdl::algebra::Mat();
 
-    std::vector<abcdl::algebra::Mat*> _batch_weights;
+    abcdl::algebra::Tensor<real> _batch_weights;
     abcdl::algebra::Mat* _batch_bias = new abcdl::algebra::Mat();
 
-    std::vector<abcdl::algebra::Mat*> _deltas;
+    abcdl::algebra::Tensor<real> _deltas;
 private:
     inline void clear(){
-        for(auto& weight : _delta_weights){weight->reset();}
-        for(auto& delta : _deltas){delta->reset();}
-        for(auto& activation : _activations){activation->reset();}
+        _delta_weights.reset();
+        _deltas.reset();
+        _activations.reset();
+    }
+    //a channel is a view on its tensor, it can't be resized
+    inline void set_channel(abcdl::algebra::Mat& channel, const abcdl::algebra::Mat& mat){
+        CHECK(channel.rows() == mat.rows() && channel.cols() == mat.cols());
+        channel = mat;
     }
 };//class Layer
 
@@ -153,7 +155,7 @@ class InputLayer : public Layer{
 public:
     InputLayer(const size_t rows, const size_t cols) : Layer(rows, cols, 1, 1, abcdl::framework::INPUT){}
    
-    void initialize(Layer* pre_layer){_activations.push_back(new abcdl::algebra::Mat());}	
+    void initialize(Layer* pre_layer){_activations.resize(1, 1, this->_rows, this->_cols);}
 	void forward(Layer* pre_layer){}
     void backward(Layer* pre_layer, Layer* back_layer){}
 
@@ -178,6 +180,7 @@ public:
     void backward(Layer* pre_layer, Layer* back_layer);
 
     inline size_t get_scale() const{ return _scale; }
+    inline abcdl::framework::Pooling* get_pooling() const { return _pooling; }
 
 private:
     size_t _scale;
@@ -190,10 +193,12 @@ public:
      ConvolutionLayer(const size_t kernal_size,
 					  const size_t stride,
 					  const size_t out_channel_size,
-                      abcdl::framework::ActivateFunc* activate_func) : Layer(0, 0, 1, out_channel_size, abcdl::framework::CONVOLUTION){
+                      abcdl::framework::ActivateFunc* activate_func,
+                      const abcdl::algebra::Convn_type padding_type = abcdl::algebra::VALID) : Layer(0, 0, 1, out_channel_size, abcdl::framework::CONVOLUTION){
         _kernal_size = kernal_size;
         _stride = stride;
         _activate_func = activate_func;
+        _padding_type = padding_type;
     }
     ~ConvolutionLayer(){delete _activate_func;}
 	
@@ -202,11 +207,19 @@ public:
     void backward(Layer* pre_layer, Layer* back_layer);
 
     inline size_t get_stride() const { return _stride; }
+    inline abcdl::algebra::Convn_type get_padding_type() const { return _padding_type; }
+    //error of pre_layer activations, set by backward unless pre_layer is InputLayer
+    inline abcdl::algebra::Tensor<real>& get_pre_deltas(){ return _pre_deltas; }
 
 private:
     size_t _stride;
     size_t _kernal_size;
+    abcdl::algebra::Convn_type _padding_type;
     abcdl::framework::ActivateFunc* _activate_func;
+
+    //im2col of pre_layer, reused by backward
+    abcdl::algebra::Mat _patches;
+    abcdl::algebra::Tensor<real> _pre_deltas;
 };//class ConvolutionLayer
 
 class OutputLayer : public Layer{
@@ -63,10 +63,17 @@ public:
 
     void train(const abcdl::algebra::Mat& train_data, const abcdl::algebra::Mat& train_label);
     void predict(abcdl::algebra::Mat& result, const abcdl::algebra::Mat& predict_data);
+    //result row i is the output of row i of predict_data, batch rows go through the net at once,
+    //every block of rows is a view of predict_data, nothing is copied
+    void predict_batch(const abcdl::algebra::Mat& predict_data,
+                       abcdl::algebra::Mat& result,
+                       const size_t batch);
     size_t evaluate(const abcdl::algebra::Mat& test_data,
                     const abcdl::algebra::Mat& test_label,
                     real* loss);
     double auc(std::vector<std::pair<real, real>>& auc_mat);
+    //temporaries of every training step, get_stats() shows its heap allocations
+    const abcdl::algebra::ArenaAllocator& get_arena() const { return _arena; }
 
 
     bool load_model(){
@@ -91,6 +98,7 @@ private:
     std::vector<abcdl::fnn::Layer*> _layers;
     abcdl::framework::Loss* _loss;
     abcdl::utils::ModelLoader _model_loader;
+    abcdl::algebra::ArenaAllocator _arena;
 };//class FNN
 
 }//namespace fnn
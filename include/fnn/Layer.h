@@ -13,6 +13,7 @@
 #include "framework/Cost.h"
 #include "framework/ActivateFunc.h"
 #include "algebra/MatrixHelper.h"
+#include "algebra/MatrixExpression.h"
 
 namespace abcdl{
 namespace fnn{
@@ -101,6 +102,8 @@ public:
     void backward(Layer* pre_layer, Layer* next_layer){}
     
 	void set_x(const abcdl::algebra::Mat& mat);
+    //drops the view of set_x, the matrix it refers to may be gone after the step
+    void clear_x();
 };//class InputLayer
 
 class FullConnLayer : public Layer{
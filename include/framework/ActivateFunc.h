@@ -19,6 +19,8 @@ public:
     virtual ~ActivateFunc() = default;
     virtual void activate(abcdl::algebra::Mat& mat, const abcdl::algebra::Mat& z_mat) = 0;
     virtual void derivative(abcdl::algebra::Mat& mat, const abcdl::algebra::Mat& activate_mat) = 0;
+    //lets layers fuse the activation into the gemm
+    virtual abcdl::algebra::Activate_type get_activate_type() const = 0;
 protected:
     abcdl::algebra::MatrixHelper<real> helper;
 };//class ActivateFunc
@@ -31,6 +33,9 @@ public:
     void derivative(abcdl::algebra::Mat& mat, const abcdl::algebra::Mat& activate_mat) override{
         helper.sigmoid_derivative(mat, activate_mat);
     }
+    abcdl::algebra::Activate_type get_activate_type() const override{
+        return abcdl::algebra::SIGMOID;
+    }
 };//class SigmoidActivateFunc
 
 class TanhActivateFunc : public ActivateFunc{
@@ -40,6 +45,9 @@ class TanhActivateFunc : public ActivateFunc{
     void derivative(abcdl::algebra::Mat& mat, const abcdl::algebra::Mat& activate_mat) override{
         helper.tanh_derivative(mat, activate_mat);
     }
+    abcdl::algebra::Activate_type get_activate_type() const override{
+        return abcdl::algebra::TANH;
+    }
 };//class TanhActivateFunc
 
 class ReluActivateFunc : public ActivateFunc{
@@ -49,6 +57,9 @@ class ReluActivateFunc : public ActivateFunc{
     void derivative(abcdl::algebra::Mat& mat, const abcdl::algebra::Mat& activate_mat) override{
         helper.relu_derivative(mat, activate_mat);
     }
+    abcdl::algebra::Activate_type get_activate_type() const override{
+        return abcdl::algebra::RELU;
+    }
 };//class ReluActivateFunc
 
 class LeakyReluActivateFunc : public ActivateFunc{
@@ -58,6 +69,9 @@ class LeakyReluActivateFunc : public ActivateFunc{
     void derivative(abcdl::algebra::Mat& mat, const abcdl::algebra::Mat& activate_mat) override{
         helper.leaky_relu_derivative(mat, activate_mat);
     }
+    abcdl::algebra::Activate_type get_activate_type() const override{
+        return abcdl::algebra::LEAKY_RELU;
+    }
 };//class TanhActivateFunc
 
 class EluActivateFunc : public ActivateFunc{
@@ -67,6 +81,9 @@ class EluActivateFunc : public ActivateFunc{
     void derivative(abcdl::algebra::Mat& mat, const abcdl::algebra::Mat& activate_mat) override{
         helper.elu_derivative(mat, activate_mat);
     }
+    abcdl::algebra::Activate_type get_activate_type() const override{
+        return abcdl::algebra::ELU;
+    }
 };//class EluActivateFunc
 
 }//namespace framework
@@ -1,52 +1,98 @@
 /*********************************************
 * Author: Jun Jiang - jiangjun4@sina.com
 * Created: 2017-08-24 15:03
-* Last modified: 2017-08-31 20:21
+* Last modified: 2026-10-17 20:10
 * Filename: Pool.h
 * Description: CNN pooling
 **********************************************/
 #pragma once
 
+#include <vector>
 #include "algebra/Matrix.h"
+#include "algebra/Tensor.h"
+#include "utils/ParallelOperator.h"
 
 namespace abcdl{
 namespace framework{
 
+/*
+ * Pools every scale x scale window of a NCHW tensor, channels run in
+ * parallel. A window is reduced over its rows first, by a simd kernel on
+ * whole rows, then over its columns. Values past the last full window
+ * are not pooled and get no delta.
+ */
 class Pooling{
 public:
     virtual ~Pooling()= default;
-    virtual void pool(abcdl::algebra::Mat& pool,
-                      const abcdl::algebra::Mat& mat,
-                      const size_t rows,
-                      const size_t cols,
+    //pool is resized to num x channels x (rows / scale) x (cols / scale)
+    virtual void pool(abcdl::algebra::Tensor<real>& pool,
+                      const abcdl::algebra::Tensor<real>& tensor,
                       const size_t scale) = 0;
+    //delta of tensor from pool_delta, tensor and pool are the ones of the last forward
+    virtual void backward(abcdl::algebra::Tensor<real>& delta,
+                          const abcdl::algebra::Tensor<real>& pool_delta,
+                          const abcdl::algebra::Tensor<real>& tensor,
+                          const abcdl::algebra::Tensor<real>& pool,
+                          const size_t scale) = 0;
+
+protected:
+    bool resize_pool(abcdl::algebra::Tensor<real>& pool,
+                     const abcdl::algebra::Tensor<real>& tensor,
+                     const size_t scale) const;
+    bool check_delta(const abcdl::algebra::Tensor<real>& delta,
+                     const abcdl::algebra::Tensor<real>& pool_delta,
+                     const abcdl::algebra::Tensor<real>& tensor,
+                     const abcdl::algebra::Tensor<real>& pool) const;
+    size_t get_num_thread(const size_t size) const;
+
+protected:
+    abcdl::utils::ParallelOperator<real> _po;
 };//class Pooling
 
 class MeanPooling : public Pooling{
 public:
-    void pool(abcdl::algebra::Mat& pool,
-              const abcdl::algebra::Mat& mat,
-              const size_t rows,
-              const size_t cols,
+    void pool(abcdl::algebra::Tensor<real>& pool,
+              const abcdl::algebra::Tensor<real>& tensor,
               const size_t scale) override;
+    //every value of the window takes delta / (scale * scale)
+    void backward(abcdl::algebra::Tensor<real>& delta,
+                  const abcdl::algebra::Tensor<real>& pool_delta,
+                  const abcdl::algebra::Tensor<real>& tensor,
+                  const abcdl::algebra::Tensor<real>& pool,
+                  const size_t scale) override;
 };//class MeanPooling
 
 class MaxPooling : public Pooling{
 public:
-    void pool(abcdl::algebra::Mat& pool,
-              const abcdl::algebra::Mat& mat,
-              const size_t rows,
-              const size_t cols,
+    void pool(abcdl::algebra::Tensor<real>& pool,
+              const abcdl::algebra::Tensor<real>& tensor,
               const size_t scale) override;
+    //only the max of the window, saved by pool, takes the delta,
+    //a tie goes to the first column of the window, then its first row
+    void backward(abcdl::algebra::Tensor<real>& delta,
+                  const abcdl::algebra::Tensor<real>& pool_delta,
+                  const abcdl::algebra::Tensor<real>& tensor,
+                  const abcdl::algebra::Tensor<real>& pool,
+                  const size_t scale) override;
+
+    //offset in tensor of the max of every pooled value
+    inline const std::vector<size_t>& get_mask() const { return _mask; }
+
+private:
+    std::vector<size_t> _mask;
 };//class MaxPooling
 
 class L2Pooling : public Pooling{
 public:
-    void pool(abcdl::algebra::Mat& pool,
-              const abcdl::algebra::Mat& mat,
-              const size_t rows,
-              const size_t cols,
+    void pool(abcdl::algebra::Tensor<real>& pool,
+              const abcdl::algebra::Tensor<real>& tensor,
               const size_t scale) override;
+    //value x of the window takes delta * x / pool
+    void backward(abcdl::algebra::Tensor<real>& delta,
+                  const abcdl::algebra::Tensor<real>& pool_delta,
+                  const abcdl::algebra::Tensor<real>& tensor,
+                  const abcdl::algebra::Tensor<real>& pool,
+                  const size_t scale) override;
 };//class L2Pooling
 
 }//namespace framework
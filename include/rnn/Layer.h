@@ -1,12 +1,14 @@
 /***********************************************
  * Author: Jun Jiang - jiangjun4@sina.com
  * Create: 2017-09-05 15:23
- * Last modified : 2017-09-05 15:52
+ * Last modified : 2026-10-17 21:40
  * Filename      : Layer.h
  * Description   : RNN network Layer 
  **********************************************/
 #pragma once
 
+#include <vector>
+#include <random>
 #include "algebra/Matrix.h"
 #include "algebra/MatrixSet.h"
 #include "algebra/MatrixHelper.h"
@@ -16,6 +18,55 @@
 namespace abcdl{
 namespace rnn{
 
+//word indices of a sequence, x[t] is one-hot at index t without being built
+typedef std::vector<size_t> SeqIndex;
+typedef std::vector<SeqIndex> SeqIndexSet;
+/*
+ * packed batch: sequences sorted by length, the longest first, so the
+ * sequences still running at step t are always the first ones.
+ */
+typedef std::vector<const SeqIndex*> SeqBatch;
+
+enum Cell_type{
+    ELMAN = 0,
+    LSTM,
+    GRU
+};
+
+/*
+ * state of a sequence fed a word at a time, it keeps h[t] of the last word
+ * and what the cell carries to the next. Buffers are reused between steps.
+ */
+struct State{
+    abcdl::algebra::Mat state;
+    abcdl::algebra::Mat pre_state;
+    abcdl::algebra::Mat logit;
+    SeqIndex words;
+    //words taken so far
+    size_t t = 0;
+
+    void clear(){ t = 0; }
+};
+
+/*
+ * what the sampled softmax keeps between calls. A call changes it, calls
+ * running at once, as the shards of a batch do, take one each.
+ */
+struct Sampler{
+    //a seed draws the same words every run, random_device otherwise
+    Sampler() : random_engine(std::random_device{}()){}
+    explicit Sampler(const size_t seed) : random_engine(seed){}
+
+    //column of a word among the candidates of a step, feature_dim if none
+    std::vector<size_t> candidate_col;
+    std::default_random_engine random_engine;
+};
+
+/*
+ * Elman cell: s[t] = tanh(U*x[t] + W*s[t-1]), o[t] = softmax(V*s[t]).
+ * A cell with G gates keeps them stacked in U (G*hidden_dim x feature_dim)
+ * and W (G*hidden_dim x hidden_dim), so one gemm W*h[t-1] gives every gate.
+ */
 class Layer{
 public:
 	Layer(const size_t hidden_dim,
@@ -28,11 +79,21 @@ public:
         _activate_func = activate_func;
 	}
 
-	~Layer(){
+	virtual ~Layer(){
         delete _cost;
         delete _activate_func;
     }
 
+    //rows of U and W are num_gates * hidden_dim
+    virtual size_t get_num_gates() const { return 1; }
+    virtual Cell_type get_cell_type() const { return ELMAN; }
+
+    /*
+     * a single sequence, run by the cell as a packed batch of one.
+     * Row t of state is the state of step t, h[t] in its first hidden_dim
+     * columns and what a gated cell keeps after them, activation row t is o[t].
+     * Rows of train_seq_data are one-hot.
+     */
 	void farward(const abcdl::algebra::Mat& train_seq_data,
                  const abcdl::algebra::Mat& weight,
                  const abcdl::algebra::Mat& pre_weight,
@@ -51,7 +112,143 @@ public:
                   abcdl::algebra::Mat& derivate_pre_weight,
                   abcdl::algebra::Mat& derivate_act_weight);
 
+    //U * x[t] is column index[t] of U, its gradient goes to that column only
+	void farward(const SeqIndex& train_seq_index,
+                 const abcdl::algebra::Mat& weight,
+                 const abcdl::algebra::Mat& pre_weight,
+                 const abcdl::algebra::Mat& act_weight,
+                 abcdl::algebra::Mat& state,
+                 abcdl::algebra::Mat& activation);
+
+	void backward(const SeqIndex& train_seq_index,
+                  const SeqIndex& train_seq_label,
+                  abcdl::algebra::Mat& weight,
+                  abcdl::algebra::Mat& pre_weight,
+                  abcdl::algebra::Mat& act_weight,
+                  const abcdl::algebra::Mat& state,
+                  const abcdl::algebra::Mat& activation,
+                  abcdl::algebra::Mat& derivate_weight,
+                  abcdl::algebra::Mat& derivate_pre_weight,
+                  abcdl::algebra::Mat& derivate_act_weight);
+
+    /*
+     * B sequences advance together: state[t] is hidden_dim x B_t,
+     * activation[t] is B_t x feature_dim, B_t sequences are longer than t.
+     * Every step is a gemm over the batch instead of B matrix-vector products.
+     * Gated cells keep what their backward needs below the hidden_dim rows of h[t].
+     */
+	void farward(const SeqBatch& batch_index,
+                 const abcdl::algebra::Mat& weight,
+                 const abcdl::algebra::Mat& pre_weight,
+                 const abcdl::algebra::Mat& act_weight,
+                 std::vector<abcdl::algebra::Mat>& states,
+                 std::vector<abcdl::algebra::Mat>& activations);
+
+	void backward(const SeqBatch& batch_index,
+                  const SeqBatch& batch_label,
+                  abcdl::algebra::Mat& weight,
+                  abcdl::algebra::Mat& pre_weight,
+                  abcdl::algebra::Mat& act_weight,
+                  const std::vector<abcdl::algebra::Mat>& states,
+                  const std::vector<abcdl::algebra::Mat>& activations,
+                  abcdl::algebra::Mat& derivate_weight,
+                  abcdl::algebra::Mat& derivate_pre_weight,
+                  abcdl::algebra::Mat& derivate_act_weight);
+
+    //states of the batch only, no output is computed
+	void farward_state(const SeqBatch& batch_index,
+                       const abcdl::algebra::Mat& weight,
+                       const abcdl::algebra::Mat& pre_weight,
+                       std::vector<abcdl::algebra::Mat>& states);
+
+    /*
+     * sampled softmax: the softmax of step t is taken over the labels of the
+     * batch and num_sampled words drawn from a log-uniform (Zipf) distribution,
+     * the logits corrected by the log of their expected count. It costs
+     * O(B + k) rows of V instead of feature_dim, word indices being sorted by
+     * frequency as in word_to_index. Training only, the loss needs farward.
+     */
+	void backward_sampled(const SeqBatch& batch_index,
+                          const SeqBatch& batch_label,
+                          const size_t num_sampled,
+                          Sampler& sampler,
+                          abcdl::algebra::Mat& weight,
+                          abcdl::algebra::Mat& pre_weight,
+                          abcdl::algebra::Mat& act_weight,
+                          const std::vector<abcdl::algebra::Mat>& states,
+                          abcdl::algebra::Mat& derivate_weight,
+                          abcdl::algebra::Mat& derivate_pre_weight,
+                          abcdl::algebra::Mat& derivate_act_weight);
+
+    //advances state by the word index, h[t] is the first hidden_dim rows of state.state
+    void step(const size_t index,
+              const abcdl::algebra::Mat& weight,
+              const abcdl::algebra::Mat& pre_weight,
+              State& state);
+
+    //number of sequences of batch longer than t
+    static size_t batch_size(const SeqBatch& batch, const size_t t);
+
+    //h[t] of a state, its first hidden_dim rows
+    inline abcdl::algebra::MatrixView<real> hidden(const abcdl::algebra::Mat& state) const{
+        return abcdl::algebra::MatrixView<real>(state).row_range(0, _hidden_dim);
+    }
+
+protected:
+    /*
+     * one step of the cell for the word of every sequence of a batch,
+     * pre_state is the state of the step before, nullptr at t = 0,
+     * it has at least as many columns as words.
+     */
+    virtual void farward_cell(const SeqIndex& words,
+                              const abcdl::algebra::Mat& weight,
+                              const abcdl::algebra::Mat& pre_weight,
+                              const abcdl::algebra::Mat* pre_state,
+                              abcdl::algebra::Mat& state);
+
+    /*
+     * bptt of the cell from derivate_states[t], the gradient of the loss at
+     * step t to h[t] (hidden_dim x B_t), down to U and W.
+     */
+    virtual void backward_state(const SeqBatch& batch_index,
+                                abcdl::algebra::Mat& pre_weight,
+                                const std::vector<abcdl::algebra::Mat>& states,
+                                std::vector<abcdl::algebra::Mat>& derivate_states,
+                                abcdl::algebra::Mat& derivate_weight,
+                                abcdl::algebra::Mat& derivate_pre_weight);
+
+    //mat[:, b] += U[:, words[b]], first mat.rows() rows of U
+    void gather_weight(const SeqIndex& words,
+                       const abcdl::algebra::Mat& weight,
+                       abcdl::algebra::Mat& mat);
+
+    //dU[:, x[t]] += delta[:, b] for every sequence b of the batch at step t
+    void scatter_weight(const SeqBatch& batch_index,
+                        const size_t t,
+                        const abcdl::algebra::Mat& delta,
+                        abcdl::algebra::Mat& derivate_weight);
+
 private:
+    //bptt of a sequence of one-hot x[t] at seq_index[t], run by the backward_state of the cell as a batch of one
+    void backward_index(const SeqIndex& seq_index,
+                        const abcdl::algebra::Mat& derivate_output,
+                        abcdl::algebra::Mat& pre_weight,
+                        abcdl::algebra::Mat& act_weight,
+                        const abcdl::algebra::Mat& state,
+                        abcdl::algebra::Mat& derivate_weight,
+                        abcdl::algebra::Mat& derivate_pre_weight,
+                        abcdl::algebra::Mat& derivate_act_weight);
+
+    //bptt of derivate_t, the delta of step t of the batch, down to U and W
+    void backward_step(const SeqBatch& batch_index,
+                       const size_t t,
+                       abcdl::algebra::Mat& derivate_t,
+                       const abcdl::algebra::Mat& pre_weight,
+                       const std::vector<abcdl::algebra::Mat>& states,
+                       abcdl::algebra::Mat& derivate_weight,
+                       abcdl::algebra::Mat& derivate_pre_weight);
+
+protected:
 	size_t _hidden_dim;
     size_t _bptt_truncate;
 	abcdl::framework::Cost* _cost;
@@ -59,5 +256,69 @@ private:
 	abcdl::algebra::MatrixHelper<real> helper;
 };//class Layer
 
+/*
+ * LSTM cell, gates i, f, o, g stacked in that order:
+ *   [i f o g] = U*x[t] + W*h[t-1], sigmoid on i f o, tanh on g
+ *   c[t] = f .* c[t-1] + i .* g
+ *   h[t] = o .* tanh(c[t])
+ * state[t] rows: h, c, i, f, o, g. Gates keep the error from vanishing,
+ * the whole sequence is backpropagated, bptt_truncate is not used.
+ */
+class LSTMLayer : public Layer{
+public:
+	LSTMLayer(const size_t hidden_dim,
+		      const size_t bptt_truncate,
+		      abcdl::framework::Cost* cost,
+              abcdl::framework::ActivateFunc* activate_func) : Layer(hidden_dim, bptt_truncate, cost, activate_func){}
+
+    size_t get_num_gates() const { return 4; }
+    Cell_type get_cell_type() const { return LSTM; }
+
+protected:
+    void farward_cell(const SeqIndex& words,
+                      const abcdl::algebra::Mat& weight,
+                      const abcdl::algebra::Mat& pre_weight,
+                      const abcdl::algebra::Mat* pre_state,
+                      abcdl::algebra::Mat& state);
+    void backward_state(const SeqBatch& batch_index,
+                        abcdl::algebra::Mat& pre_weight,
+                        const std::vector<abcdl::algebra::Mat>& states,
+                        std::vector<abcdl::algebra::Mat>& derivate_states,
+                        abcdl::algebra::Mat& derivate_weight,
+                        abcdl::algebra::Mat& derivate_pre_weight);
+};//class LSTMLayer
+
+/*
+ * GRU cell, gates z, r, n stacked in that order, r is applied after
+ * W*h[t-1] so the three gates still share one gemm:
+ *   z = sigmoid(U_z*x[t] + W_z*h[t-1]), r = sigmoid(U_r*x[t] + W_r*h[t-1])
+ *   n = tanh(U_n*x[t] + r .* (W_n*h[t-1]))
+ *   h[t] = (1 - z) .* n + z .* h[t-1]
+ * state[t] rows: h, z, r, n, W_n*h[t-1]. The whole sequence is backpropagated.
+ */
+class GRULayer : public Layer{
+public:
+	GRULayer(const size_t hidden_dim,
+		     const size_t bptt_truncate,
+		     abcdl::framework::Cost* cost,
+             abcdl::framework::ActivateFunc* activate_func) : Layer(hidden_dim, bptt_truncate, cost, activate_func){}
+
+    size_t get_num_gates() const { return 3; }
+    Cell_type get_cell_type() const { return GRU; }
+
+protected:
+    void farward_cell(const SeqIndex& words,
+                      const abcdl::algebra::Mat& weight,
+                      const abcdl::algebra::Mat& pre_weight,
+                      const abcdl::algebra::Mat* pre_state,
+                      abcdl::algebra::Mat& state);
+    void backward_state(const SeqBatch& batch_index,
+                        abcdl::algebra::Mat& pre_weight,
+                        const std::vector<abcdl::algebra::Mat>& states,
+                        std::vector<abcdl::algebra::Mat>& derivate_states,
+                        abcdl::algebra::Mat& derivate_weight,
+                        abcdl::algebra::Mat& derivate_pre_weight);
+};//class GRULayer
+
 }//namespace rnn
 }//namespace abcdl
@@ -1,7 +1,7 @@
 /***********************************************
  * Author: Jun Jiang - jiangjun4@sina.com
  * Create: 2017-09-05 15:08
- * Last modified : 2017-09-05 15:56
+ * Last modified : 2026-10-17 21:40
  * Filename      : RNN.h
  * Description   : Recurrent Neural Network 
  **********************************************/
@@ -16,30 +16,50 @@ namespace rnn{
 
 class RNN{
 public:
-    RNN(const size_t feature_dim, const size_t hidden_dim){
+    //U and W hold the gates of cell_type stacked, num_gates * hidden_dim rows
+    RNN(const size_t feature_dim, const size_t hidden_dim, const Cell_type cell_type = ELMAN){
 
         _feature_dim    = feature_dim;
         _hidden_dim     = hidden_dim;
+        _cell_type      = cell_type;
 
-        _U.reset(hidden_dim, feature_dim, 0, 1, -std::sqrt(1.0/feature_dim), std::sqrt(1.0/feature_dim));
-        _W.reset(hidden_dim, hidden_dim, 0, 1, -std::sqrt(1.0/hidden_dim), std::sqrt(1.0/hidden_dim));
+        create_layer();
+        size_t gate_dim = _layer->get_num_gates() * hidden_dim;
+        _U.reset(gate_dim, feature_dim, 0, 1, -std::sqrt(1.0/feature_dim), std::sqrt(1.0/feature_dim));
+        _W.reset(gate_dim, hidden_dim, 0, 1, -std::sqrt(1.0/hidden_dim), std::sqrt(1.0/hidden_dim));
         _V.reset(feature_dim, hidden_dim, 0, 1, -std::sqrt(1.0/hidden_dim), std::sqrt(1.0/hidden_dim));
-
-        _layer = new abcdl::rnn::Layer(hidden_dim, _bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc());
     }
 
+    //the cell is told by the rows of U and W
     RNN(const std::string& path){
-        if(load_model(path)){
-            _feature_dim    = _U.cols();
-            _hidden_dim     = _U.rows();
-            _path           = path;
-            _layer          = new abcdl::rnn::Layer(_hidden_dim, _bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc());
-        }
+        load_model(path);
     }
     ~RNN(){delete _layer;}
 
+    //rows of the sequences are one-hot, they are turned into word indices
     void train(const abcdl::algebra::MatSet& train_seq_data,
                const abcdl::algebra::MatSet& train_seq_label); 
+    /*
+     * sequences of word indices from RNNHelper::read_seq_index, no one-hot matrix is built.
+     * A mini batch of mini_batch_size sequences is packed longest first and
+     * advanced a step at a time for the whole batch.
+     */
+    void train(const SeqIndexSet& train_seq_index,
+               const SeqIndexSet& train_seq_label);
+
+    /*
+     * streaming: feeds the word token_id to state, which keeps h[t] between
+     * calls, so a step costs the same whatever the length of the history.
+     * A new sequence starts from a cleared state.
+     */
+    void step(const size_t token_id, State& state);
+    //o[t] after token_id, 1 x feature_dim
+    void step(const size_t token_id, State& state, abcdl::algebra::Mat& activation);
+    //the top_k words of o[t] after token_id and their probabilities, the most likely first
+    void step(const size_t token_id,
+              State& state,
+              const size_t top_k,
+              std::vector<std::pair<size_t, real>>& top);
 
     bool load_model(const std::string& path);
     bool write_model(const std::string& path);
@@ -55,26 +75,70 @@ public:
     void set_alpha(const real alpha){_alpha = alpha;}
     void set_model_path(const std::string& path){_path = path;}
     void set_bptt_truncate(const size_t bptt_truncate){_bptt_truncate = bptt_truncate;}
+    /*
+     * words sampled by the softmax of a training step, 0 trains on the exact softmax.
+     * The sampler of shard k is seeded by seed + k, a run with the same seed draws the same words.
+     */
+    void set_num_sampled(const size_t num_sampled, const size_t seed = std::random_device{}()){
+        _num_sampled = num_sampled;
+        _seed = seed;
+    }
+    /*
+     * data parallel bptt: a mini batch is dealt to num_shard packed batches run
+     * by the ThreadPool, each into its own gradients, which are then summed by
+     * a tree reduction. 1 runs the mini batch as a single packed batch.
+     * Shards are coarse pool tasks, a thread waiting in the gemm of a shard
+     * does not start another shard. Every shard allocates from its own arena.
+     */
+    void set_num_shard(const size_t num_shard){_num_shard = num_shard;}
+
+    //temporaries of the weight update of every training step, get_stats() shows its heap allocations
+    const abcdl::algebra::ArenaAllocator& get_arena() const { return _arena; }
 
 private:
+    //_layer for _cell_type
+    void create_layer();
+
+    //sequences ids of train_seq_index sorted longest first into a packed batch
+    void pack(std::vector<size_t>& ids,
+              const SeqIndexSet& train_seq_index,
+              const SeqIndexSet& train_seq_label,
+              SeqBatch& batch_index,
+              SeqBatch& batch_label);
+
+    //farward and backward of a packed batch, gradients are added to the derivates, temporaries come from arena
+    void backward_batch(const SeqBatch& batch_index,
+                        const SeqBatch& batch_label,
+                        Sampler& sampler,
+                        abcdl::algebra::ArenaAllocator& arena,
+                        abcdl::algebra::Mat& derivate_weight,
+                        abcdl::algebra::Mat& derivate_pre_weight,
+                        abcdl::algebra::Mat& derivate_act_weight);
+
+    real loss(const SeqIndexSet& train_seq_index,
+              const SeqIndexSet& train_seq_label);
+
     void mini_batch_update(const abcdl::algebra::MatSet& train_seq_data,
                            const abcdl::algebra::MatSet& train_seq_label);
 
-    real loss(const abcdl::algebra::MatSet& train_seq_data,
-              const abcdl::algebra::MatSet& train_seq_label);
-
-    real total_loss(const abcdl::algebra::MatSet& train_seq_data,
-                    const abcdl::algebra::MatSet& train_seq_label);
+    real total_loss(const SeqIndexSet& train_seq_index,
+                    const SeqIndexSet& train_seq_label);
     
 	bool check_data(const abcdl::algebra::MatSet& train_seq_data,
              		const abcdl::algebra::MatSet& train_seq_label); 
+	bool check_data(const SeqIndexSet& train_seq_index,
+             		const SeqIndexSet& train_seq_label); 
 private:
     size_t _feature_dim;
     size_t _hidden_dim;
     size_t _bptt_truncate = 4; 
+    Cell_type _cell_type = ELMAN;
 
     size_t _epoch = 5;
     size_t _mini_batch_size = 10;
+    size_t _num_sampled = 0;
+    size_t _seed = 0;
+    size_t _num_shard = 1;
     real _alpha = 0.1;
 
     std::string _path = "./model/rnn.model";
@@ -84,7 +148,9 @@ private:
     abcdl::algebra::RandomMatrix<real> _W;
     abcdl::algebra::RandomMatrix<real> _V;
 
-    abcdl::rnn::Layer* _layer;
+    abcdl::rnn::Layer* _layer = nullptr;
+    abcdl::algebra::ArenaAllocator _arena;
+    abcdl::algebra::MatrixHelper<real> helper;
 };//class RNN 
 
 }//namespace rnn
@@ -146,7 +146,8 @@ bool MnistHelper<T>::read_image(const std::string& image_file,
     auto image_data_buffer = reinterpret_cast<unsigned char*>(image_buffer.get() + 16);
 
     size_t size = count * rows * cols;
-    T* data = new T[size];
+    out_mat->resize(count, rows * cols);
+    T* data = out_mat->data();
     for(size_t i = 0; i < size; i++){
         if(threshold > 0){
             data[i] = static_cast<T>(*image_data_buffer++) > threshold ? 1 : 0;
@@ -155,8 +156,6 @@ bool MnistHelper<T>::read_image(const std::string& image_file,
         }
     }
 
-    out_mat->set_shallow_data(data, count, rows * cols);
-
     return true;
 }
 
@@ -218,13 +217,12 @@ bool MnistHelper<T>::read_label(const std::string& label_file,
     //read label data
     auto label_data_buffer = reinterpret_cast<unsigned char*>(label_buffer.get() + 8);
 
-    T* labels = new T[count];
+    out_mat->resize(count, 1);
+    T* labels = out_mat->data();
     for(size_t i = 0; i < count; i++){
         labels[i] = static_cast<T>(*label_data_buffer++);
     }
 
-    out_mat->set_shallow_data(labels, count, 1);
-
     return true;
 }
 
@@ -246,16 +244,14 @@ bool MnistHelper<T>::read_vec_label(const std::string& label_file,
     //read label data
     auto label_data_buffer = reinterpret_cast<unsigned char*>(label_buffer.get() + 8);
 
-    T* labels = new T[count * vec_size];
-    memset(labels, 0, sizeof(T) * count * vec_size);
+    out_mat->reset(0, count, vec_size);
+    T* labels = out_mat->data();
 
     for(size_t i = 0; i < count; i++){
         auto label = static_cast<size_t>(*label_data_buffer++);
         labels[i * vec_size + label] = 1;
     }
 
-    out_mat->set_shallow_data(labels, count, vec_size);
-
     return true;
 }
 
@@ -9,6 +9,13 @@
 
 #include <fstream>
 #include <vector>
+#include <cstdint>
+#include <limits>
+#include <typeinfo>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "algebra/Matrix.h"
 #include "utils/Log.h"
 
@@ -22,6 +29,224 @@ public:
     size_t cols;
 };//class ModelInfo
 
+enum Model_format{
+    TEXT_MODEL = 0,
+    BINARY_MODEL
+};
+
+/*
+ * Binary model file, native byte order, offsets count from the file start:
+ *   ModelHeader | signature | ModelTensor * num_models | tensor data
+ * Every section and every tensor starts at a MODEL_ALIGNMENT boundary,
+ * so a mapped file hands out aligned tensors.
+ * checksum is fnv-1a over the 64-bit words after the header.
+ */
+static const char MODEL_MAGIC[8]        = {'A', 'B', 'C', 'D', 'L', 'M', 'D', 'L'};
+static const uint32_t MODEL_VERSION     = 1;
+static const uint64_t MODEL_ALIGNMENT   = 64;
+
+struct ModelHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_models;
+    uint64_t signature_offset;
+    uint64_t signature_size;
+    uint64_t table_offset;
+    uint64_t file_size;
+    uint64_t checksum;
+    uint64_t reserved;
+};//struct ModelHeader
+
+struct ModelTensor{
+    char type;
+    char reserved[7];
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t offset;
+};//struct ModelTensor
+
+static_assert(sizeof(ModelHeader) == 64, "ModelHeader must be 64 bytes");
+static_assert(sizeof(ModelTensor) == 32, "ModelTensor must be 32 bytes");
+
+inline uint64_t model_align(const uint64_t size){
+    return (size + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+}
+
+inline uint64_t model_checksum(const char* data, const uint64_t size){
+    uint64_t hash = 14695981039346656037ULL;
+    const uint64_t* words = (const uint64_t*)data;
+    for(uint64_t i = 0; i != size / sizeof(uint64_t); i++){
+        hash ^= words[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template<class T>
+inline char model_type(){
+    if(typeid(T) == typeid(int)){
+        return 'i';
+    }else if(typeid(T) == typeid(float)){
+        return 'f';
+    }else if(typeid(T) == typeid(double)){
+        return 'd';
+    }
+    return 0;
+}
+
+/*
+ * Read only mmap of a binary model file,
+ * get() gives a Matrix view of a tensor without copy or parse.
+ * Views are valid until close() or destruction, pages are mapped read only,
+ * writing to a view faults, copy a tensor out before changing it.
+ */
+class MappedModel{
+public:
+    MappedModel(){}
+    MappedModel(const MappedModel&) = delete;
+    MappedModel& operator = (const MappedModel&) = delete;
+    ~MappedModel(){
+        close();
+    }
+
+    bool open(const std::string& path,
+              const std::string& signature = "",
+              const bool verify_checksum = true);
+    void close();
+
+    size_t size() const{
+        return _header == nullptr ? 0 : _header->num_models;
+    }
+    const ModelTensor& get_info(const size_t idx) const{
+        return _tensors[idx];
+    }
+
+    template<class T>
+    bool get(const size_t idx, abcdl::algebra::Matrix<T>* mat) const;
+
+    static bool is_binary(const std::string& path);
+
+private:
+    char* _addr = nullptr;
+    size_t _length = 0;
+    const ModelHeader* _header = nullptr;
+    const ModelTensor* _tensors = nullptr;
+};//class MappedModel
+
+inline bool MappedModel::is_binary(const std::string& path){
+    char magic[sizeof(MODEL_MAGIC)];
+    std::ifstream in_file(path, std::ios::binary);
+    if(!in_file.read(magic, sizeof(magic))){
+        return false;
+    }
+    return memcmp(magic, MODEL_MAGIC, sizeof(magic)) == 0;
+}
+
+inline bool MappedModel::open(const std::string& path,
+                              const std::string& signature,
+                              const bool verify_checksum){
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        LOG(FATAL) << "Can't open Filename:" + path;
+        return false;
+    }
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(ModelHeader)){
+        LOG(FATAL) << "ModelLoader read model error:[file too small]";
+        ::close(fd);
+        return false;
+    }
+    _length = file_stat.st_size;
+    void* addr = mmap(nullptr, _length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(addr == MAP_FAILED){
+        LOG(FATAL) << "ModelLoader mmap error:" << path;
+        _length = 0;
+        return false;
+    }
+    _addr   = (char*)addr;
+    _header = (const ModelHeader*)_addr;
+
+    std::string error;
+    if(memcmp(_header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0){
+        error = "magic error";
+    }else if(_header->version != MODEL_VERSION){
+        error = "version error";
+    }else if(_header->file_size != _length){
+        error = "file size error";
+    }else if(_header->signature_offset > _length
+             || _header->signature_size > _length - _header->signature_offset
+             || _header->table_offset % MODEL_ALIGNMENT != 0
+             || _header->table_offset > _length
+             || _header->num_models > (_length - _header->table_offset) / sizeof(ModelTensor)){
+        //compared by subtraction, offset + size of a crafted file can wrap around
+        error = "header error";
+    }else if(std::string(_addr + _header->signature_offset, _header->signature_size) != signature){
+        error = "signature error";
+    }else if(verify_checksum && model_checksum(_addr + sizeof(ModelHeader), _length - sizeof(ModelHeader)) != _header->checksum){
+        error = "checksum error";
+    }
+
+    if(error.empty()){
+        _tensors = (const ModelTensor*)(_addr + _header->table_offset);
+        for(size_t i = 0; i != _header->num_models; i++){
+            char type = _tensors[i].type;
+            size_t type_size = (type == 'i') ? sizeof(int) : (type == 'f') ? sizeof(float) : (type == 'd') ? sizeof(double) : 0;
+            if(type_size == 0){
+                error = "data type error";
+                break;
+            }
+            //get() casts the offset to T*, the mapping itself is page aligned
+            if(_tensors[i].offset % MODEL_ALIGNMENT != 0){
+                error = "tensor alignment error";
+                break;
+            }
+            if(_tensors[i].offset > _length){
+                error = "tensor offset error";
+                break;
+            }
+            uint64_t max_size = (_length - _tensors[i].offset) / type_size;
+            if(_tensors[i].rows != 0 && _tensors[i].cols > max_size / _tensors[i].rows){
+                error = "tensor offset error";
+                break;
+            }
+        }
+    }
+
+    if(!error.empty()){
+        LOG(FATAL) << "ModelLoader read model error:[" << error << "]";
+        close();
+        return false;
+    }
+    return true;
+}
+
+inline void MappedModel::close(){
+    if(_addr != nullptr){
+        munmap(_addr, _length);
+    }
+    _addr    = nullptr;
+    _length  = 0;
+    _header  = nullptr;
+    _tensors = nullptr;
+}
+
+template<class T>
+bool MappedModel::get(const size_t idx, abcdl::algebra::Matrix<T>* mat) const{
+    if(idx >= size()){
+        LOG(FATAL) << "MappedModel get error:" << idx << " must be less than:" << size();
+        return false;
+    }
+    const ModelTensor& info = _tensors[idx];
+    if(info.type != model_type<T>()){
+        LOG(FATAL) << "MappedModel get error:[data type " << info.type << " must be:" << model_type<T>() << "]";
+        return false;
+    }
+    mat->set_view_data((T*)(_addr + info.offset), info.rows, info.cols);
+    return true;
+}
+
 class ModelLoader{
 public:
     ModelLoader(){}
@@ -64,11 +289,27 @@ public:
     bool read(const std::string& path,
               std::vector<abcdl::algebra::Matrix<T>*>* models,
               const std::string& signature = "");
+
+    //format of write, read detects the format of a file
+    void set_format(const Model_format format){ _format = format; }
+    Model_format get_format() const{ return _format; }
+
 private:
     std::string _path;
+    Model_format _format = BINARY_MODEL;
+
     template<class T>
     bool generate_header(const std::vector<abcdl::algebra::Matrix<T>*> models,
                          std::vector<ModelInfo>* infos);
+    template<class T>
+    bool write_binary(const std::vector<const T*>& datas,
+                      const std::vector<ModelInfo>& infos,
+                      const std::string& path,
+                      const std::string& signature);
+    template<class T>
+    bool read_binary(const std::string& path,
+                     std::vector<abcdl::algebra::Matrix<T>*>* models,
+                     const std::string& signature);
 };//class ModelLoader
 
 template<class T>
@@ -85,34 +326,29 @@ bool ModelLoader::write(std::vector<abcdl::algebra::Matrix<T>*> models,
     std::vector<ModelInfo> infos;
 
     if(!generate_header(old_models, &infos) || !generate_header(models, &infos)){
+        for(auto& model : old_models){
+            delete model;
+        }
         return false;
     }
-     
-    /**
-    std::ofstream out_file(path, std::ios::binary);
-    std::ofstream out_file(path, std::ios::out);
 
-    out_file.write(signature.c_str(), sizeof(char)*signature.size());
-    out_file.write((char*)&num_models, sizeof(size_t));
-    for(auto&& info : infos){
-        out_file.write(&info.type, sizeof(char));
-        out_file.write((char*)&info.rows, sizeof(size_t));
-        out_file.write((char*)&info.cols, sizeof(size_t));
-    }
-
-    size_t num_old_models = old_models.size();
-    for(size_t i = 0; i != num_old_models; i++){
-        out_file.write((char*)old_models[i]->data(), sizeof(T) * infos[i].rows * infos[i].cols);
-    }
-
-    num_models = models.size();
-    for(size_t i = 0; i != num_models; i++){
-        ModelInfo info = infos[i+num_old_models];
-        out_file.write((char*)models[i]->data(), sizeof(T) * info.rows * info.cols);
+    if(_format == BINARY_MODEL){
+        std::vector<const T*> datas;
+        for(auto& model : old_models){
+            datas.push_back(model->data());
+        }
+        for(auto& model : models){
+            datas.push_back(model->data());
+        }
+        bool result = write_binary(datas, infos, path, signature);
+        for(auto& model : old_models){
+            delete model;
+        }
+        return result;
     }
-    **/
-
+     
     std::ofstream out_file(path, std::ios::out);
+    out_file.precision(std::numeric_limits<T>::max_digits10);
     out_file << signature << std::endl;
     out_file << num_models << std::endl;
     for(auto&& info : infos){
@@ -138,6 +374,9 @@ bool ModelLoader::write(std::vector<abcdl::algebra::Matrix<T>*> models,
     }
     out_file.close();
 
+    for(auto& model : old_models){
+        delete model;
+    }
     return true;
 }
 template<class T>
@@ -147,14 +386,17 @@ bool ModelLoader::write(abcdl::algebra::Matrix<T>* model,
                         bool is_append){
     std::vector<abcdl::algebra::Matrix<T>*> models;
     models.push_back(model);
-    return write(models, path, is_append, signature);
+    return write(models, path, signature, is_append);
 }
 
 template<class T>
 bool ModelLoader::read(const std::string& path,
                        std::vector<abcdl::algebra::Matrix<T>*>* models,
                        const std::string& signature){
-    //std::ifstream in_file(path, std::ios::binary);
+    if(MappedModel::is_binary(path)){
+        return read_binary(path, models, signature);
+    }
+
     std::ifstream in_file(path, std::ios::in);
     if(!in_file){
         LOG(FATAL) << "Can't open Filename:" + path;
@@ -165,22 +407,17 @@ bool ModelLoader::read(const std::string& path,
     std::string read_signature(signature.size(), ' ');
 
     in_file >> read_signature;
-    //in_file.read(&read_signature[0], sizeof(char) * signature.size());
     if(read_signature != signature){
         LOG(FATAL) << "ModelLoader read model error:[signature error]";
         in_file.close();
         return false;
     }
 
-    //in_file.read((char*)(&num_models), sizeof(size_t));
     in_file >> num_models;
 
     std::vector<ModelInfo> infos;
     for(size_t i = 0; i != num_models; i++){
         ModelInfo info;
-        //in_file.read(&info.type, sizeof(char));
-        //in_file.read((char*)(&info.rows), sizeof(size_t));
-        //in_file.read((char*)(&info.cols), sizeof(size_t));
         in_file >> info.type;
         in_file >> info.rows;
         in_file >> info.cols;
@@ -192,13 +429,12 @@ bool ModelLoader::read(const std::string& path,
         ModelInfo info = infos[i];
         size_t size      = info.rows * info.cols;
         
-        T* data = new T[size];
-        //in_file.read((char*)data, sizeof(T) * size);
+        auto mat = new abcdl::algebra::Matrix<T>();
+        mat->resize(info.rows, info.cols);
+        T* data = mat->data();
         for(size_t j = 0; j < size; j++){
             in_file >> data[j];
         }
-        auto mat = new abcdl::algebra::Matrix<T>();
-        mat->set_shallow_data(data, info.rows, info.cols);
         models->push_back(mat);
     }
 
@@ -212,13 +448,8 @@ bool ModelLoader::generate_header(const std::vector<abcdl::algebra::Matrix<T>*>
         ModelInfo info;
         info.rows = model->rows();
         info.cols = model->cols();
-        if(typeid(T) == typeid(int)){
-            info.type = 'i';
-        }else if(typeid(T) == typeid(float)){
-            info.type = 'f';
-        }else if(typeid(T) == typeid(double)){
-            info.type = 'd';
-        }else{
+        info.type = model_type<T>();
+        if(info.type == 0){
             LOG(FATAL) << "ModelLoader not support data type";
             return false;
         }
@@ -226,5 +457,80 @@ bool ModelLoader::generate_header(const std::vector<abcdl::algebra::Matrix<T>*>
     }
     return true;
 }
+
+template<class T>
+bool ModelLoader::write_binary(const std::vector<const T*>& datas,
+                               const std::vector<ModelInfo>& infos,
+                               const std::string& path,
+                               const std::string& signature){
+    size_t num_models = infos.size();
+    ModelHeader header;
+    memset(&header, 0, sizeof(ModelHeader));
+    memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header.version          = MODEL_VERSION;
+    header.num_models       = num_models;
+    header.signature_offset = sizeof(ModelHeader);
+    header.signature_size   = signature.size();
+    header.table_offset     = model_align(header.signature_offset + header.signature_size);
+
+    std::vector<ModelTensor> tensors(num_models);
+    uint64_t offset = model_align(header.table_offset + num_models * sizeof(ModelTensor));
+    for(size_t i = 0; i != num_models; i++){
+        memset(&tensors[i], 0, sizeof(ModelTensor));
+        tensors[i].type   = infos[i].type;
+        tensors[i].rows   = infos[i].rows;
+        tensors[i].cols   = infos[i].cols;
+        tensors[i].offset = offset;
+        offset = model_align(offset + sizeof(T) * infos[i].rows * infos[i].cols);
+    }
+    header.file_size = model_align(offset);
+
+    //padding bytes stay 0, so the checksum is stable
+    std::vector<char> buffer(header.file_size, 0);
+    char* data = buffer.data();
+    memcpy(&data[header.signature_offset], signature.data(), signature.size());
+    if(num_models != 0){
+        memcpy(&data[header.table_offset], tensors.data(), sizeof(ModelTensor) * num_models);
+    }
+    for(size_t i = 0; i != num_models; i++){
+        memcpy(&data[tensors[i].offset], datas[i], sizeof(T) * infos[i].rows * infos[i].cols);
+    }
+    header.checksum = model_checksum(&data[sizeof(ModelHeader)], header.file_size - sizeof(ModelHeader));
+    memcpy(data, &header, sizeof(ModelHeader));
+
+    std::ofstream out_file(path, std::ios::binary);
+    if(!out_file){
+        LOG(FATAL) << "Can't open Filename:" + path;
+        return false;
+    }
+    out_file.write(data, header.file_size);
+    out_file.close();
+    return out_file.good();
+}
+
+template<class T>
+bool ModelLoader::read_binary(const std::string& path,
+                              std::vector<abcdl::algebra::Matrix<T>*>* models,
+                              const std::string& signature){
+    MappedModel mapped_model;
+    if(!mapped_model.open(path, signature)){
+        return false;
+    }
+
+    models->clear();
+    abcdl::algebra::Matrix<T> view;
+    for(size_t i = 0; i != mapped_model.size(); i++){
+        if(!mapped_model.get(i, &view)){
+            for(auto& model : *models){
+                delete model;
+            }
+            models->clear();
+            return false;
+        }
+        //copy out, the mapping is gone after return
+        models->push_back(new abcdl::algebra::Matrix<T>(view));
+    }
+    return true;
+}
 }//namespace utils
 }//namespace abcdl
@@ -9,292 +9,284 @@
 
 #include <cmath>
 #include <vector>
-#include <thread>
+#include <algorithm>
 #include <functional>
 #include "utils/TypeDef.h"
 #include "utils/Log.h"
+#include "utils/ThreadPool.h"
 
 namespace abcdl{
 namespace utils{
 
-static size_t s_num_thread = std::thread::hardware_concurrency();
-
 template<class T>
 class ParallelOperator{
 public:
+    /*
+     * num_thread 0 follows the size of the process-wide ThreadPool,
+     * which can be changed at runtime by ThreadPool::set_num_thread.
+     */
     ParallelOperator(){
-		_num_thread = s_num_thread;
-		//LOG(INFO) << _num_thread << " threads are parallel operator.";
+		_num_thread = 0;
     }
 
     explicit ParallelOperator(const size_t num_thread){
 		_num_thread = num_thread;
     }
 
+    template<class F>
     void parallel_mul2one(T* op1,
                           const size_t num_op1,
-                          const std::function<void(T*)> &f) const{
+                          const F& f) const{
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-
-        for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&op1, &f](size_t start_idx, size_t end_idx){
-                    for(size_t ti = start_idx; ti != end_idx; ti++){
-                        f(&op1[ti]);
-                    }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
-
-        for(auto& thread : threads){
-            thread.join();
-        }
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [op1, &f](size_t start_idx, size_t end_idx){
+                for(size_t ti = start_idx; ti != end_idx; ti++){
+                    f(&op1[ti]);
+                }
+            }
+        );
     }
 
+    template<class F>
     void parallel_mul2one(T* op1,
                           const size_t num_op1,
                           const T& op2,
-                          const std::function<void(T*, const T&)> &f) const{
+                          const F& f) const{
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-
-        for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&op1, &op2, &f](size_t start_idx, size_t end_idx){
-                    for(size_t ti = start_idx; ti != end_idx; ti++){
-                        f(&op1[ti], op2);
-                    }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
-
-        for(auto& thread : threads){
-            thread.join();
-        }
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [op1, op2, &f](size_t start_idx, size_t end_idx){
+                for(size_t ti = start_idx; ti != end_idx; ti++){
+                    f(&op1[ti], op2);
+                }
+            }
+        );
     }
 
+    template<class F>
     void parallel_mul2one_copy(T* result_data,
                                const T* op1,
                                const size_t num_op1,
-                               const std::function<void(T*, const T&)> &f) const{
+                               const F& f) const{
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-
-        for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&result_data, &op1, &f](size_t start_idx, size_t end_idx){
-                    for(size_t ti = start_idx; ti != end_idx; ti++){
-                        f(&result_data[ti], op1[ti]);
-                    }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
-
-        for(auto& thread : threads){
-            thread.join();
-        }
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [result_data, op1, &f](size_t start_idx, size_t end_idx){
+                for(size_t ti = start_idx; ti != end_idx; ti++){
+                    f(&result_data[ti], op1[ti]);
+                }
+            }
+        );
     }
 
+    template<class F>
     void parallel_mul2one_copy(T* result_data,
                                const T* op1,
                                const size_t num_op1,
                                const T& op2,
-                               const std::function<void(T*, const T&, const T&)> &f) const{
+                               const F& f) const{
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-
-        for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&result_data, &op1, &f, &op2](size_t start_idx, size_t end_idx){
-                    for(size_t ti = start_idx; ti != end_idx; ti++){
-                        f(&result_data[ti], op1[ti], op2);
-                    }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
-
-        for(auto& thread : threads){
-            thread.join();
-        }
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [result_data, op1, &f, op2](size_t start_idx, size_t end_idx){
+                for(size_t ti = start_idx; ti != end_idx; ti++){
+                    f(&result_data[ti], op1[ti], op2);
+                }
+            }
+        );
     }
 
+    template<class F>
     void parallel_mul2mul(T* op1,
                           const size_t num_op1,
                           const T* op2,
                           const size_t num_op2,
-                          const std::function<void(T*, const T&)> &f) const{
+                          const F& f) const{
         CHECK(num_op1 == num_op2);
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-
-        for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&op1, &op2, &f](size_t start_idx, size_t end_idx){
-                    for(size_t ti = start_idx; ti != end_idx; ti++){
-                        f(&op1[ti], op2[ti]);
-                    }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
-
-        for(auto& thread : threads){
-            thread.join();
-        }
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [op1, op2, &f](size_t start_idx, size_t end_idx){
+                for(size_t ti = start_idx; ti != end_idx; ti++){
+                    f(&op1[ti], op2[ti]);
+                }
+            }
+        );
     }
     
-	void parallel_mul2mul_repeat(T* op1,
+    template<class F>
+    void parallel_mul2mul_repeat(T* op1,
                                  const size_t num_op1,
                                  const T* op2,
                                  const size_t num_op2,
-                                 const std::function<void(T*, const T&)> &f) const{
+                                 const F& f) const{
         CHECK(num_op1 % num_op2 == 0);
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-
-        for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&op1, &op2, &num_op2, &f](size_t start_idx, size_t end_idx){
-                    for(size_t ti = start_idx; ti != end_idx; ti++){
-                        f(&op1[ti], op2[ti % num_op2]);
-                    }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
-
-        for(auto& thread : threads){
-            thread.join();
-        }
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [op1, op2, num_op2, &f](size_t start_idx, size_t end_idx){
+                for(size_t ti = start_idx; ti != end_idx; ti++){
+                    f(&op1[ti], op2[ti % num_op2]);
+                }
+            }
+        );
     }
 
+    template<class F>
     void parallel_mul2mul_cross(T* result_data,
                                 const T* op1,
                                 const size_t num_op1,
                                 const T* op2,
                                 const size_t num_op2,
-                                const std::function<void(T*, const T&, const T&)> &f) const{
+                                const F& f) const{
         CHECK(num_op1 > 0 && num_op2 > 0);
         size_t block_size = get_block_size(num_op1 * num_op2);
         size_t num_thread = get_num_thread(num_op1 * num_op2, block_size);
-        std::vector<std::thread> threads(num_thread);
-        block_size = num_op1 / num_thread;
-        if(num_op1 % num_thread != 0){
-            block_size += 1;
-        }
-
-        for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&result_data, &op1, &op2, num_op2, &f](size_t start_idx, size_t end_idx){
-                    size_t idx = start_idx * num_op2;
-                    for(size_t ti = start_idx; ti != end_idx; ti++){
-                        for(size_t tj = 0; tj != num_op2; tj++){
-                            f(&result_data[idx++], op1[ti], op2[tj]);
-                        }
+        parallel_range(num_op1, num_thread,
+            [result_data, op1, op2, num_op2, &f](size_t start_idx, size_t end_idx){
+                size_t idx = start_idx * num_op2;
+                for(size_t ti = start_idx; ti != end_idx; ti++){
+                    for(size_t tj = 0; tj != num_op2; tj++){
+                        f(&result_data[idx++], op1[ti], op2[tj]);
                     }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
+                }
+            }
+        );
+    }
 
-        for(auto& thread : threads){
-            thread.join();
-        }
+    /*
+     * kernel works on a continuous range of the arrays at once,
+     * it's called once per block, see algebra/MatrixKernel.h
+     */
+    void parallel_kernel(T* result_data,
+                         const T* op1,
+                         const size_t num_op1,
+                         void (*kernel)(T*, const T*, const size_t)) const{
+        size_t block_size = get_block_size(num_op1);
+        size_t num_thread = get_num_thread(num_op1, block_size);
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [result_data, op1, kernel](size_t start_idx, size_t end_idx){
+                kernel(&result_data[start_idx], &op1[start_idx], end_idx - start_idx);
+            }
+        );
+    }
+
+    void parallel_kernel(T* result_data,
+                         const T* op1,
+                         const size_t num_op1,
+                         const T& op2,
+                         void (*kernel)(T*, const T*, const T, const size_t)) const{
+        size_t block_size = get_block_size(num_op1);
+        size_t num_thread = get_num_thread(num_op1, block_size);
+        T value = op2;
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [result_data, op1, value, kernel](size_t start_idx, size_t end_idx){
+                kernel(&result_data[start_idx], &op1[start_idx], value, end_idx - start_idx);
+            }
+        );
+    }
+
+    void parallel_kernel(T* result_data,
+                         const T* op1,
+                         const T* op2,
+                         const size_t num_op1,
+                         void (*kernel)(T*, const T*, const T*, const size_t)) const{
+        size_t block_size = get_block_size(num_op1);
+        size_t num_thread = get_num_thread(num_op1, block_size);
+        parallel_range(num_op1, num_thread, ALIGN_SIZE,
+            [result_data, op1, op2, kernel](size_t start_idx, size_t end_idx){
+                kernel(&result_data[start_idx], &op1[start_idx], &op2[start_idx], end_idx - start_idx);
+            }
+        );
     }
 
+    template<class F>
     void parallel_reduce_mul2one(T* result_value,
                                  const T* op1,
                          		 const size_t num_op1,
-                         		 const std::function<void(T*, const T&)> &f) const{
+                         		 const F& f) const{
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-		T* data = new T[num_thread];
-
+        std::vector<T> data(num_thread);
+        std::vector<char> valid(num_thread, 0);
+
+        parallel_block(num_op1, num_thread,
+            [op1, &data, &valid, &f](size_t i, size_t start_idx, size_t end_idx){
+                if(start_idx == end_idx){
+                    return;
+                }
+                T value = op1[start_idx];
+                for(size_t ti = start_idx + 1; ti < end_idx; ti++){
+                    f(&value, op1[ti]);
+                }
+                data[i] = value;
+                valid[i] = 1;
+            }
+        );
+
+        //merge the partial result of blocks in order
         for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&op1, &result_value, &data, i, &f](size_t start_idx, size_t end_idx){
-					for(size_t ti = start_idx; ti != end_idx; ti++){
-            			if(ti == start_idx){
-							data[i] = op1[ti];
-						}else{
-    						f(&data[i], op1[ti]);
-                        }
-                    }
-					f(result_value, data[i]);
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
+            if(valid[i]){
+                f(result_value, data[i]);
+            }
         }
-
-        for(auto& thread : threads){
-            thread.join();
-        }
-		delete[] data;
     }
     
-	void parallel_reduce_mul2one(T* result_value,
+    template<class F>
+    void parallel_reduce_mul2one(T* result_value,
                                  size_t* result_idx,
                                  const T* op1,
                          		 const size_t num_op1,
-                         		 const std::function<void(T*, const T&, size_t*, const size_t)> &f) const{
+                         		 const F& f) const{
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-		T* data = new T[num_thread];
-		size_t* indices = new size_t[num_thread];
+        std::vector<T> data(num_thread);
+        std::vector<size_t> indices(num_thread);
+        std::vector<char> valid(num_thread, 0);
+
+        parallel_block(num_op1, num_thread,
+            [op1, &data, &indices, &valid, &f](size_t i, size_t start_idx, size_t end_idx){
+                if(start_idx == end_idx){
+                    return;
+                }
+                T value = op1[start_idx];
+                size_t idx = start_idx;
+                for(size_t ti = start_idx + 1; ti < end_idx; ti++){
+                    f(&value, op1[ti], &idx, ti);
+                }
+                data[i] = value;
+                indices[i] = idx;
+                valid[i] = 1;
+            }
+        );
 
         for(size_t i = 0; i != num_thread; i++){
-            threads[i] = std::thread(
-                [&op1, &result_value, &result_idx, &data, &indices, i, &f](size_t start_idx, size_t end_idx){
-					for(size_t ti = start_idx; ti != end_idx; ti++){
-            			if(ti == start_idx){
-							data[i] = op1[ti];
-                            indices[i] = ti;
-						}else{
-    						f(&data[i], op1[ti], &indices[i], ti);
-                        }
-                    }
-					f(result_value, data[i], result_idx, indices[i]);
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
-
-        for(auto& thread : threads){
-            thread.join();
+            if(valid[i]){
+                f(result_value, data[i], result_idx, indices[i]);
+            }
         }
-		delete[] data;
-        delete[] indices;
     }
 
+    template<class F>
     void parallel_reduce_boolean(bool* result_value,
                                  const T* op1,
                              	 const size_t num_op1,
-                         		 const std::function<void(bool*, const T&)> &f) const{
-        *result_value = true;
+                         		 const F& f) const{
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-        
-        bool* values = new bool[num_thread];
-        for(size_t i = 0; i != num_thread; i++){
-            bool* value = &values[i];
-            *value = true;
-            threads[i] = std::thread(
-                [&value, &op1, &f](size_t start_idx, size_t end_idx){
-					for(size_t ti = start_idx; ti != end_idx && *value; ti++){
-    					f(value, op1[ti]);
-                    }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
+        std::vector<char> values(num_thread, 1);
+
+        parallel_block(num_op1, num_thread,
+            [&values, op1, &f](size_t i, size_t start_idx, size_t end_idx){
+                bool value = true;
+                for(size_t ti = start_idx; ti < end_idx && value; ti++){
+                    f(&value, op1[ti]);
+                }
+                values[i] = value;
+            }
+        );
 
-        for(auto& thread : threads){
-            thread.join();
-        }
         bool reduce_result = true;
         for(size_t i = 0; i < num_thread && reduce_result; i++){
            reduce_result = reduce_result && values[i]; 
@@ -302,34 +294,28 @@ public:
         *result_value = reduce_result;
     }
 
+    template<class F>
     void parallel_reduce_boolean(bool* result_value,
                                  const T* op1,
                             	 const size_t num_op1,
                                  const T* op2,
                             	 const size_t num_op2,
-                         		 const std::function<void(bool*, const T&, const T&)> &f) const{
+                         		 const F& f) const{
         CHECK(num_op1 == num_op2);
-        *result_value = true;
         size_t block_size = get_block_size(num_op1);
         size_t num_thread = get_num_thread(num_op1, block_size);
-        std::vector<std::thread> threads(num_thread);
-
-        bool* values = new bool[num_thread];
-        for(size_t i = 0; i != num_thread; i++){
-            bool* value = &values[i];
-            *value = true;
-            threads[i] = std::thread(
-                [&value, &op1, &op2, &f](size_t start_idx, size_t end_idx){
-					for(size_t ti = start_idx; ti != end_idx && *value; ti++){
-    					f(value, op1[ti], op2[ti]);
-                    }
-                }, i * block_size, std::min(num_op1, (i + 1) * block_size)
-            );
-        }
+        std::vector<char> values(num_thread, 1);
+
+        parallel_block(num_op1, num_thread,
+            [&values, op1, op2, &f](size_t i, size_t start_idx, size_t end_idx){
+                bool value = true;
+                for(size_t ti = start_idx; ti < end_idx && value; ti++){
+                    f(&value, op1[ti], op2[ti]);
+                }
+                values[i] = value;
+            }
+        );
 
-        for(auto& thread : threads){
-            thread.join();
-        }
         bool reduce_result = true;
         for(size_t i = 0; i < num_thread && reduce_result; i++){
            reduce_result = reduce_result && values[i]; 
@@ -337,17 +323,48 @@ public:
         *result_value = reduce_result;
     }
 
+    /*
+     * split [0, size) into num_block continuous ranges and run them on the thread pool,
+     * f(start_idx, end_idx) is called once per range.
+     */
+    void parallel_range(const size_t size,
+                        const size_t num_block,
+                        const std::function<void(size_t, size_t)> &f) const{
+        parallel_range(size, num_block, 1, f);
+    }
+    /*
+     * ranges start at a multiple of align_size, for element ranges of an aligned
+     * buffer ALIGN_SIZE keeps two threads from writing the same cache line.
+     */
+    void parallel_range(const size_t size,
+                        const size_t num_block,
+                        const size_t align_size,
+                        const std::function<void(size_t, size_t)> &f) const{
+        parallel_block(size, num_block,
+            [&f](size_t i, size_t start_idx, size_t end_idx){
+                if(start_idx < end_idx){
+                    f(start_idx, end_idx);
+                }
+            },
+            align_size
+        );
+    }
+
     inline size_t get_block_size(const size_t size) const{
-        size_t block_size = size / _num_thread;
-        if( size % _num_thread != 0){
+        size_t num_thread = get_num_thread();
+        size_t block_size = size / num_thread;
+        if( size % num_thread != 0){
             block_size += 1;
         }
         return block_size < _min_block_size ? std::min(size, _min_block_size) : block_size;
     }
 
     inline size_t get_num_thread(const size_t size, const size_t block_size) const{
+        if(block_size == 0){
+            return 1;
+        }
         if(block_size > _min_block_size){
-            return _num_thread;
+            return get_num_thread();
         }
         size_t num_thread = size / block_size;
         if(size % block_size != 0){
@@ -356,7 +373,41 @@ public:
         return num_thread;
     }
 
+    inline size_t get_num_thread() const{
+        return _num_thread == 0 ? ThreadPool::get_instance().get_num_thread() : _num_thread;
+    }
+
+private:
+    /*
+     * f(block_id, start_idx, end_idx), block size is rounded up so that
+     * the last blocks may be empty.
+     */
+    void parallel_block(const size_t size,
+                        const size_t num_block,
+                        const std::function<void(size_t, size_t, size_t)> &f,
+                        const size_t align_size = 1) const{
+        if(num_block == 0){
+            return;
+        }
+        size_t block_size = size / num_block;
+        if(size % num_block != 0){
+            block_size += 1;
+        }
+        if(align_size > 1 && block_size % align_size != 0){
+            block_size += align_size - block_size % align_size;
+        }
+        ThreadPool::get_instance().parallel_run(num_block,
+            [&f, size, block_size](size_t i){
+                size_t start_idx = std::min(size, i * block_size);
+                f(i, start_idx, std::min(size, start_idx + block_size));
+            }
+        );
+    }
+
 private:
+    //elements of a cache line, an aligned buffer splits at line boundaries
+    static const size_t ALIGN_SIZE = ABCDL_ALIGNMENT > sizeof(T) ? ABCDL_ALIGNMENT / sizeof(T) : 1;
+
     size_t _num_thread;
     size_t _min_block_size = 1024;
 };//class ParallelOperator
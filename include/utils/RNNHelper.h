@@ -37,10 +37,20 @@ public:
 					   const std::string& label_file,
 					   abcdl::algebra::MatSet& train_seq_label,
                        int limit = -1);
+
+	//word indices of every sequence, x[t] is one-hot at index t
+	bool read_seq_index(const std::string& data_file,
+					    std::vector<std::vector<size_t>>& train_seq_index,
+					    const std::string& label_file,
+					    std::vector<std::vector<size_t>>& train_seq_label,
+                        int limit = -1);
 private:
 	bool read_data(const std::string& data_file,
                    abcdl::algebra::MatSet& matset,
                    int limit = -1);
+	bool read_index(const std::string& data_file,
+                    std::vector<std::vector<size_t>>& seq_index,
+                    int limit = -1);
 
 private:
 	size_t _feature_dim;
@@ -105,6 +115,45 @@ bool RNNHelper::read_data(const std::string& data_file,
 	return true;
 }
 
+bool RNNHelper::read_seq_index(const std::string& data_file,
+				   		       std::vector<std::vector<size_t>>& train_seq_index,
+					  	 	   const std::string& label_file,
+					  		   std::vector<std::vector<size_t>>& train_seq_label,
+                               int limit){
+    return read_index(data_file, train_seq_index, limit) && read_index(label_file, train_seq_label, limit);
+}
+
+bool RNNHelper::read_index(const std::string& data_file,
+                           std::vector<std::vector<size_t>>& seq_index,
+                           int limit){
+	std::ifstream in_file(data_file.c_str());
+	if(!in_file.is_open()){
+		LOG(FATAL) << "Open file failed:" << data_file.c_str();
+		return false;
+	}
+		
+	std::string data;
+    abcdl::utils::StringHelper helper;
+	while(getline(in_file, data)){
+		auto line_data = helper.split(data, "\t");
+        std::vector<size_t> index;
+        index.reserve(line_data.size());
+        for(auto& word : line_data){
+            size_t value = helper.str2int(word);
+            if(value >= _feature_dim){
+                LOG(FATAL) << "Word index out of feature dim:" << value;
+                return false;
+            }
+            index.push_back(value);
+        }
+        seq_index.push_back(index);
+        if(limit > 0 && (int)seq_index.size() >= limit){
+            break;
+        }
+	}
+	in_file.close();
+	return true;
+}
 
 }//namespace
 }//namespace abcdl
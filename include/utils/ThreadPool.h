@@ -0,0 +1,98 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 10:12
+ * Last modified : 2026-10-17 10:12
+ * Filename      : ThreadPool.h
+ * Description   : process-wide persistent thread pool,
+ *                 per-worker deque with work stealing
+ **********************************************/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace abcdl{
+namespace utils{
+
+class ThreadPool{
+public:
+    /*
+     * process-wide pool, worker size is taken from env ABCDL_NUM_THREAD
+     * or std::thread::hardware_concurrency() when not set.
+     */
+    static ThreadPool& get_instance();
+
+    /*
+     * resize the pool at runtime, blocks until running tasks finished.
+     * must not be called from inside a pool task.
+     */
+    void set_num_thread(const size_t num_thread);
+    size_t get_num_thread() const { return _num_thread.load(); }
+
+    /*
+     * run f(0)...f(num_task - 1) and wait until all of them finished.
+     * the calling thread executes tasks too, so it's safe to call
+     * parallel_run from inside a running task.
+     */
+    void parallel_run(const size_t num_task, const std::function<void(size_t)>& f);
+
+    /*
+     * as parallel_run for large tasks that run parallel_run themselves.
+     * A thread waiting inside a task only helps with fine tasks, so a coarse
+     * task never starts on the stack of another one, idle workers take them.
+     */
+    void parallel_run_coarse(const size_t num_task, const std::function<void(size_t)>& f);
+
+private:
+    struct TaskGroup{
+        const std::function<void(size_t)>* func;
+        std::atomic<size_t> num_pending;
+        bool coarse;
+    };
+
+    struct Task{
+        TaskGroup* group;
+        size_t idx;
+    };
+
+    struct Worker{
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+
+    ThreadPool();
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    void start(const size_t num_thread);
+    void stop();
+    void run(const size_t num_task, const std::function<void(size_t)>& f, const bool coarse);
+    void work(const size_t worker_id);
+    //take_coarse false leaves the tasks of coarse groups queued
+    bool pop_task(const size_t worker_id, Task* task, const bool take_coarse);
+    void run_task(const Task& task);
+
+private:
+    std::atomic<size_t> _num_thread;
+    std::atomic<size_t> _num_queued;
+    std::atomic<size_t> _num_coarse_queued;
+    std::atomic<size_t> _next_worker;
+    bool _stop = false;
+
+    std::vector<Worker*> _workers;
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _task_cond;
+    std::condition_variable _done_cond;
+    std::mutex _resize_mutex;
+};//class ThreadPool
+
+}//namespace utils
+}//namespace abcdl
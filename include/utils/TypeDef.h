@@ -27,6 +27,11 @@ namespace utils{
     #define SOFTMAX_MIN -64.0
 #endif
 
+//bytes every matrix buffer is aligned to by default, a cache line
+#ifndef ABCDL_ALIGNMENT
+#define ABCDL_ALIGNMENT 64
+#endif
+
 #define EXP_MAX 40.0
 #define SIGMOID_MIN -13.0
 #define SIGMOID_MAX 40.0
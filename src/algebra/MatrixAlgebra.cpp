@@ -7,6 +7,7 @@
  **********************************************/
 #include "algebra/Matrix.h"
 #include "algebra/MatrixHelper.h"
+#include <algorithm>
 
 namespace abcdl{
 namespace algebra{
@@ -161,7 +162,12 @@ template<class T>
 Matrix<size_t> Matrix<T>::argmax(Axis_type axis_type) const{
     size_t size = (axis_type == Axis_type::ROW)? _rows : _cols;
    	size_t end_idx = (axis_type == Axis_type::ROW) ? _cols : _rows;
-    size_t* idx_data = new size_t[size];
+    size_t rows = (axis_type == Axis_type::ROW) ? size : 1;
+    size_t cols = (axis_type == Axis_type::ROW) ? 1 : size;
+
+	abcdl::algebra::Matrix<size_t> mat;
+    mat.resize(rows, cols);
+    size_t* idx_data = mat.data();
     for(size_t i = 0; i != size; i++){
         T max_value = 0;
         size_t max_idx = 0;
@@ -175,12 +181,6 @@ Matrix<size_t> Matrix<T>::argmax(Axis_type axis_type) const{
         idx_data[i] = max_idx;
     }
 
-    size_t rows = (axis_type == Axis_type::ROW) ? size : 1;
-    size_t cols = (axis_type == Axis_type::ROW) ? 1 : size;
-
-	abcdl::algebra::Matrix<size_t> mat;
-	mat.set_shallow_data(idx_data, rows, cols);
-
     return mat;
 }
 
@@ -233,11 +233,54 @@ size_t Matrix<T>::argmin() const{
 template<class T>
 T Matrix<T>::sum() const{
 	T sum = 0;
-	auto lambda = [](T* a, const T& b){if(b != 0){ *a += b;} };
+	auto lambda = [](T* a, const T& b){ *a += b; };
 	_po.parallel_reduce_mul2one(&sum, _data, get_size(), lambda);
 	return sum;   
 }
 
+template<class T>
+Matrix<T> Matrix<T>::sum(Axis_type type) const{
+    size_t size = get_size();
+    size_t rows = _rows;
+    size_t cols = _cols;
+    const T* data = _data;
+    size_t num_thread = _po.get_num_thread(size, _po.get_block_size(size));
+
+    Matrix<T> sum_mat;
+    if(type == Axis_type::ROW){
+        sum_mat.resize(rows, 1);
+        T* sum_data = sum_mat.data();
+        if(rows != 0){
+            _po.parallel_range(rows, std::min(rows, num_thread),
+                [cols, data, sum_data](size_t start_idx, size_t end_idx){
+                    for(size_t i = start_idx; i != end_idx; i++){
+                        T total = 0;
+                        for(size_t j = 0; j != cols; j++){
+                            total += data[i * cols + j];
+                        }
+                        sum_data[i] = total;
+                    }
+                }
+            );
+        }
+    }else{
+        sum_mat.resize(1, cols);
+        T* sum_data = sum_mat.data();
+        memset(sum_data, 0, sizeof(T) * cols);
+        //rows are read in memory order, every range owns a slice of cols
+        if(cols != 0){
+            _po.parallel_range(cols, std::min(cols, num_thread),
+                [rows, cols, data, sum_data](size_t start_idx, size_t end_idx){
+                    for(size_t i = 0; i != rows; i++){
+                        MatrixKernel<T>::add(&sum_data[start_idx], &sum_data[start_idx], &data[i * cols + start_idx], end_idx - start_idx);
+                    }
+                }
+            );
+        }
+    }
+    return sum_mat;
+}
+
 template<class T>
 real Matrix<T>::mean() const{
 	return ((real)sum())/get_size();
@@ -245,22 +288,21 @@ real Matrix<T>::mean() const{
 
 template<class T>
 Matrix<real> Matrix<T>::mean(Axis_type type) const{
-    size_t size = 0;
     real count = 0;
     size_t mean_row = 0;
     size_t mean_col = 0;
     if(type == Axis_type::ROW){
-        size = _rows;
         count = _cols;
         mean_row = _rows;
         mean_col = 1;
     }else{
-        size = _cols;
         count = _rows;
         mean_row = 1;
         mean_col = _cols;
     }
-    real* data = new real[size];
+    Matrix<real> mean_mat;
+    mean_mat.resize(mean_row, mean_col);
+    real* data = mean_mat.data();
 
     if(type == Axis_type::ROW){
         for(size_t i = 0; i < _rows; i++){
@@ -280,8 +322,6 @@ Matrix<real> Matrix<T>::mean(Axis_type type) const{
         }
     }
 
-    Matrix<real> mean_mat;
-    mean_mat.set_shallow_data(data, mean_row, mean_col);
     return mean_mat;
 }
 
@@ -0,0 +1,259 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 15:20
+ * Last modified : 2026-10-17 15:20
+ * Filename      : MatrixAllocator.cpp
+ * Description   : pluggable storage allocators of Matrix buffers
+ **********************************************/
+#include "algebra/MatrixAllocator.h"
+#include "utils/Log.h"
+#include <new>
+#include <stdlib.h>
+
+namespace abcdl{
+namespace algebra{
+
+static thread_local Allocator* t_current_allocator = nullptr;
+
+Allocator::Allocator(const size_t alignment){
+    //a power of two, posix_memalign needs a multiple of sizeof(void*)
+    _alignment = sizeof(void*);
+    while(_alignment < alignment){
+        _alignment <<= 1;
+    }
+}
+
+void* Allocator::heap_allocate(const size_t bytes) const{
+    void* ptr = nullptr;
+    if(posix_memalign(&ptr, _alignment, bytes) != 0){
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void Allocator::heap_free(void* ptr){
+    free(ptr);
+}
+
+Allocator* Allocator::get_current(){
+    return t_current_allocator == nullptr ? get_default() : t_current_allocator;
+}
+
+void Allocator::set_current(Allocator* allocator){
+    t_current_allocator = allocator;
+}
+
+Allocator* Allocator::get_default(){
+    //never destroyed, matrices with static storage give buffers back at exit
+    static PoolAllocator* pool = new PoolAllocator();
+    return pool;
+}
+
+AllocatorStats Allocator::get_stats() const{
+    AllocatorStats stats;
+    stats.num_allocate      = _num_allocate;
+    stats.num_deallocate    = _num_deallocate;
+    stats.num_heap_allocate = _num_heap_allocate;
+    stats.num_heap_free     = _num_heap_free;
+    stats.bytes_in_use      = _bytes_in_use;
+    stats.peak_bytes_in_use = _peak_bytes_in_use;
+    return stats;
+}
+
+void Allocator::reset_stats(){
+    _num_allocate      = 0;
+    _num_deallocate    = 0;
+    _num_heap_allocate = 0;
+    _num_heap_free     = 0;
+    _peak_bytes_in_use = _bytes_in_use.load();
+}
+
+void Allocator::count_allocate(const size_t bytes){
+    _num_allocate++;
+    size_t bytes_in_use = (_bytes_in_use += bytes);
+    size_t peak = _peak_bytes_in_use;
+    while(bytes_in_use > peak && !_peak_bytes_in_use.compare_exchange_weak(peak, bytes_in_use)){}
+}
+
+void Allocator::count_heap_allocate(const size_t num){
+    _num_heap_allocate += num;
+}
+
+void Allocator::count_deallocate(const size_t bytes){
+    _num_deallocate++;
+    _bytes_in_use -= bytes;
+}
+
+void Allocator::count_heap_free(const size_t num){
+    _num_heap_free += num;
+}
+
+void* HeapAllocator::allocate(const size_t bytes){
+    if(bytes == 0){
+        return nullptr;
+    }
+    count_allocate(bytes);
+    count_heap_allocate();
+    return heap_allocate(bytes);
+}
+
+void HeapAllocator::deallocate(void* ptr, const size_t bytes){
+    if(ptr == nullptr){
+        return;
+    }
+    count_deallocate(bytes);
+    count_heap_free();
+    heap_free(ptr);
+}
+
+PoolAllocator::~PoolAllocator(){
+    release();
+}
+
+size_t PoolAllocator::size_class(const size_t bytes){
+    size_t id = MIN_CLASS;
+    while((static_cast<size_t>(1) << id) < bytes){
+        id++;
+    }
+    return id;
+}
+
+void* PoolAllocator::allocate(const size_t bytes){
+    if(bytes == 0){
+        return nullptr;
+    }
+    size_t id = size_class(bytes);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        void* block = _free_list[id];
+        if(block != nullptr){
+            _free_list[id] = *static_cast<void**>(block);
+            _cached_bytes -= static_cast<size_t>(1) << id;
+            count_allocate(bytes);
+            return block;
+        }
+    }
+    count_allocate(bytes);
+    count_heap_allocate();
+    return heap_allocate(static_cast<size_t>(1) << id);
+}
+
+void PoolAllocator::deallocate(void* ptr, const size_t bytes){
+    if(ptr == nullptr){
+        return;
+    }
+    size_t id = size_class(bytes);
+    count_deallocate(bytes);
+    std::lock_guard<std::mutex> lock(_mutex);
+    *static_cast<void**>(ptr) = _free_list[id];
+    _free_list[id] = ptr;
+    _cached_bytes += static_cast<size_t>(1) << id;
+}
+
+void PoolAllocator::release(){
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(size_t id = 0; id != NUM_CLASS; id++){
+        while(_free_list[id] != nullptr){
+            void* block = _free_list[id];
+            _free_list[id] = *static_cast<void**>(block);
+            heap_free(block);
+            count_heap_free();
+        }
+    }
+    _cached_bytes = 0;
+}
+
+ArenaAllocator::ArenaAllocator(const size_t chunk_bytes,
+                               const size_t alignment) : Allocator(alignment){
+    _min_chunk_bytes = chunk_bytes == 0 ? get_alignment() : chunk_bytes;
+}
+
+ArenaAllocator::~ArenaAllocator(){
+    if(_num_live != 0){
+        LOG(WARNING) << "arena destroyed with live buffers:" << _num_live;
+    }
+    for(auto& chunk : _chunks){
+        heap_free(chunk.data);
+    }
+}
+
+size_t ArenaAllocator::get_chunk_bytes() const{
+    size_t chunk_bytes = 0;
+    for(auto& chunk : _chunks){
+        chunk_bytes += chunk.size;
+    }
+    return chunk_bytes;
+}
+
+void* ArenaAllocator::allocate(const size_t bytes){
+    if(bytes == 0){
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    void* ptr = nullptr;
+    size_t alignment = get_alignment();
+    //first fit in the current chunk or one of the chunks after it, chunks start aligned
+    while(_chunk_id < _chunks.size()){
+        Chunk& chunk = _chunks[_chunk_id];
+        size_t start = (_offset + alignment - 1) & ~(alignment - 1);
+        if(start + bytes <= chunk.size){
+            _offset = start + bytes;
+            ptr = chunk.data + start;
+            break;
+        }
+        _chunk_id++;
+        _offset = 0;
+    }
+    if(ptr == nullptr){
+        ptr = new_chunk(bytes);
+    }
+    _num_live++;
+    count_allocate(bytes);
+    return ptr;
+}
+
+void* ArenaAllocator::new_chunk(const size_t bytes){
+    Chunk chunk;
+    chunk.size = bytes > _min_chunk_bytes ? bytes : _min_chunk_bytes;
+    chunk.data = static_cast<char*>(heap_allocate(chunk.size));
+    count_heap_allocate();
+    _chunks.push_back(chunk);
+    _chunk_id = _chunks.size() - 1;
+    _offset = bytes;
+    return chunk.data;
+}
+
+void ArenaAllocator::deallocate(void* ptr, const size_t bytes){
+    if(ptr == nullptr){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    CHECK(_num_live > 0);
+    _num_live--;
+    count_deallocate(bytes);
+}
+
+bool ArenaAllocator::reset(){
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_num_live != 0){
+        LOG(WARNING) << "arena reset refused, live buffers:" << _num_live;
+        return false;
+    }
+    //one chunk big enough for the whole step replaces a chain of chunks
+    if(_chunks.size() > 1){
+        size_t chunk_bytes = 0;
+        for(auto& chunk : _chunks){
+            chunk_bytes += chunk.size;
+            heap_free(chunk.data);
+        }
+        count_heap_free(_chunks.size());
+        _chunks.clear();
+        new_chunk(chunk_bytes);
+    }
+    _chunk_id = 0;
+    _offset   = 0;
+    return true;
+}
+
+}//namespace algebra
+}//namespace abcdl
@@ -9,6 +9,7 @@
 #include "algebra/Matrix.h"
 #include "algebra/MatrixHelper.h"
 #include <random>
+#include <algorithm>
 #include <string.h>
 #include <iostream>
 #include <stdio.h>
@@ -20,14 +21,13 @@ template<class T>
 Matrix<T>::Matrix(){
     _rows = 0;
     _cols = 0;
-    _data = nullptr;
 }
 
 template<class T>
 Matrix<T>::Matrix(const size_t rows, const size_t cols){
     _rows = rows;
     _cols = cols;
-    _data = new T[_rows * _cols];
+    reserve_data(_rows * _cols);
     memset(_data, 0, sizeof(T) * _rows * _cols);
 }
 
@@ -37,7 +37,7 @@ Matrix<T>::Matrix(const T& value,
                   const size_t cols){
     _rows = rows;
     _cols = cols;
-    _data = new T[_rows * _cols];
+    reserve_data(_rows * _cols);
     if(value == 0 || value == static_cast<T>(-1)){
         memset(_data, value, sizeof(T) * _rows * _cols);
     }else{
@@ -52,28 +52,54 @@ Matrix<T>::Matrix(const T* data,
                   const size_t cols){
     _rows = rows;
     _cols = cols;
-    _data = new T[_rows * _cols];
+    reserve_data(_rows * _cols);
     memcpy(_data, data, sizeof(T) * _rows * _cols);
 }
 
 template<class T>
 Matrix<T>::~Matrix(){
-    if(_data != nullptr){
-        delete[] _data;
-        _data = nullptr;
-    }
+    release_data();
 }
 
 template<class T>
 void Matrix<T>::set_shallow_data(T* data,
                                  const size_t rows,
                                  const size_t cols){
-    if(_data != nullptr){
-        delete[] _data;
+    if(data != _data){
+        release_data();
+    }
+    _data = data;
+    _rows = rows;
+    _cols = cols;
+    _capacity = rows * cols;
+}
+
+template<class T>
+void Matrix<T>::set_allocated_data(T* data,
+                                   const size_t rows,
+                                   const size_t cols){
+    if(data != _data){
+        release_data();
     }
     _data = data;
     _rows = rows;
     _cols = cols;
+    _capacity = rows * cols;
+    _data_allocator = _allocator;
+}
+
+template<class T>
+void Matrix<T>::set_view_data(T* data,
+                              const size_t rows,
+                              const size_t cols){
+    if(data != _data){
+        release_data();
+    }
+    _data = data;
+    _rows = rows;
+    _cols = cols;
+    _capacity = rows * cols;
+    _own_data = false;
 }
 
 template<class T>
@@ -88,9 +114,29 @@ void Matrix<T>::get_row(Matrix<T>* mat,
                         const size_t row_id,
                         const size_t row_size) const{
     CHECK(row_id + row_size <= _rows);
-	T* data = new T[row_size * _cols];
-	memcpy(data, &_data[row_id * _cols], sizeof(T) * row_size * _cols);
-	mat->set_shallow_data(data, row_size, _cols);
+    if(row_id + row_size > _rows){
+        return;
+    }
+    size_t cols = _cols;
+    const T* src_data = &_data[row_id * cols];
+    //mat may be this, rows only move towards the front
+	mat->resize(row_size, cols);
+	memmove(mat->data(), src_data, sizeof(T) * row_size * cols);
+}
+
+template<class T>
+void Matrix<T>::get_rows(Matrix<T>* mat, const std::vector<size_t>& row_ids) const{
+    size_t row_size = row_ids.size();
+    mat->resize(row_size, _cols);
+    T* data = mat->data();
+    for(size_t i = 0; i != row_size; i++){
+        if(row_ids[i] >= _rows){
+            LOG(FATAL) << "get rows error:" << row_ids[i] << " must be less than:" << _rows;
+            memset(&data[i * _cols], 0, sizeof(T) * _cols);
+            continue;
+        }
+        memcpy(&data[i * _cols], &_data[row_ids[i] * _cols], sizeof(T) * _cols);
+    }
 }
 
 template<class T>
@@ -118,7 +164,7 @@ void Matrix<T>::insert_row(const size_t row_id, const Matrix<T>& mat){
 
     CHECK(_cols == mat.cols());
 
-    T* data = new T[(_rows + mat.rows()) * _cols];
+    T* data = allocate_data((_rows + mat.rows()) * _cols);
 
     if(row_id > 0){
         memcpy(data, _data, sizeof(T) * row_id * _cols);
@@ -127,7 +173,7 @@ void Matrix<T>::insert_row(const size_t row_id, const Matrix<T>& mat){
     if(row_id < _rows){
         memcpy(&data[(row_id + mat.rows()) * _cols], &_data[row_id * _cols], sizeof(T) * (_rows - row_id) * _cols);
     }
-    set_shallow_data(data, _rows + mat.rows(), _cols);
+    set_allocated_data(data, _rows + mat.rows(), _cols);
 }
 
 template<class T>
@@ -136,10 +182,7 @@ void Matrix<T>::swap_row(const size_t row_id1, const size_t row_id2){
     if(row_id1 == row_id2){
         return;
     }
-    T* data = new T[_cols];
-    memcpy(&data, &_data[row_id1 * _cols], sizeof(T) * _cols);
-    memcpy(&_data[row_id1 * _cols], &_data[row_id2 * _cols], sizeof(T) * _cols);
-    memcpy(&_data[row_id2 * _cols], &data, sizeof(T) * _cols);
+    std::swap_ranges(&_data[row_id1 * _cols], &_data[(row_id1 + 1) * _cols], &_data[row_id2 * _cols]);
 }
 
 template<class T>
@@ -154,11 +197,18 @@ void Matrix<T>::get_col(Matrix<T>* mat,
                         const size_t col_id,
                         const size_t col_size) const{
     CHECK(col_id + col_size <= _cols);
-	T* data = new T[_rows * col_size];
-	for(size_t i = 0; i != _rows; i++){
-		memcpy(&data[i * col_size], &_data[i * col_size + col_id], sizeof(T) * col_size);
+    if(col_id + col_size > _cols){
+        return;
+    }
+    size_t rows = _rows;
+    size_t cols = _cols;
+    const T* src_data = _data;
+    //mat may be this, rows only move towards the front
+	mat->resize(rows, col_size);
+	T* data = mat->data();
+	for(size_t i = 0; i != rows; i++){
+		memmove(&data[i * col_size], &src_data[i * cols + col_id], sizeof(T) * col_size);
 	}
-	mat->set_shallow_data(data, _rows, col_size);
 }
 
 template<class T>
@@ -198,7 +248,7 @@ void Matrix<T>::insert_col(const size_t col_id, const Matrix<T>& mat){
     size_t new_cols = _cols + sub_cols;
     T* sub_data   = mat.data();
 
-    T* data = new T[_rows * new_cols];
+    T* data = allocate_data(_rows * new_cols);
     for(size_t i = 0; i != _rows; i++){
         if(col_id > 0){
             memcpy(&data[i * new_cols], &_data[i * _cols], sizeof(T) * sub_cols);
@@ -209,7 +259,7 @@ void Matrix<T>::insert_col(const size_t col_id, const Matrix<T>& mat){
         }
     }
 
-    set_shallow_data(data, _rows, new_cols);
+    set_allocated_data(data, _rows, new_cols);
 }
 
 template<class T>
@@ -240,14 +290,7 @@ void Matrix<T>::reset(const T& value,
                       const size_t rows,
                       const size_t cols){
     size_t size = rows * cols;
-    if(get_size() != size){
-        if(_data != nullptr){
-            delete[] _data;
-        }
-        _data = new T[size];
-        _rows = rows;
-        _cols = cols;
-    }
+    resize(rows, cols);
 
     if(value == 0 || value == static_cast<T>(-1)){
         memset(_data, value, sizeof(T) * size);
@@ -272,11 +315,6 @@ Matrix<T>& Matrix<T>::transpose(){
 	return *this;
 }
 
-template<class T>
-void Matrix<T>::for_each(const std::function<void(T*)> &func){ 
-    _po.parallel_mul2one(_data, get_size(), func);
-}
-
 template<class T>
 void Matrix<T>::display(const std::string& split, const bool with_title) const{
     if(with_title) printf("[%ld*%ld][\n", _rows, _cols);
@@ -323,32 +361,30 @@ void RandomMatrix<T>::reset(){
     T* data = this->_data;
     size_t block_size = this->_po.get_block_size(size);
     size_t num_thread = this->_po.get_num_thread(size, block_size);
-    std::vector<std::thread> threads(num_thread);
-    std::default_random_engine engine(std::chrono::system_clock::now().time_since_epoch().count());
-    std::normal_distribution<T> distribution(_mean_value, _stddev);
-
-    for(size_t i = 0; i != num_thread; i++){
-        threads[i] = std::thread(
-            [&data, max, min, scale, &distribution, &engine](size_t start_idx, size_t end_idx){
-                for(size_t ti = start_idx; ti != end_idx; ti++){
-                    T value = static_cast<T>(distribution(engine));
-                    if(max == min || value == max || value == min){
-                        data[ti] = value;
-                    }else if(value > max){
-                        real step = (value - min)/scale;
-                        value = min + (step - (int)step) * scale;
-                    }else{
-                        real step = (max - value)/scale;
-                        value = min + (step - (int)step) * scale;
-                    }
+    size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+    T mean_value = _mean_value;
+    T stddev = _stddev;
+
+    //every range owns its engine, the pool runs ranges concurrently
+    this->_po.parallel_range(size, num_thread,
+        [&data, max, min, scale, seed, mean_value, stddev](size_t start_idx, size_t end_idx){
+            std::default_random_engine engine(seed + start_idx);
+            std::normal_distribution<T> distribution(mean_value, stddev);
+            for(size_t ti = start_idx; ti != end_idx; ti++){
+                T value = static_cast<T>(distribution(engine));
+                //values out of [min, max] are folded back into it
+                if(max == min || value == max || value == min){
+                }else if(value > max){
+                    real step = (value - min)/scale;
+                    value = min + (step - (int)step) * scale;
+                }else{
+                    real step = (max - value)/scale;
+                    value = min + (step - (int)step) * scale;
                 }
-            }, i * block_size, std::min(size, (i + 1) * block_size)
-        );
-    }
-
-    for(auto& thread : threads){
-        thread.join();
-    }
+                data[ti] = value;
+            }
+        }
+    );
 }
 
 template<class T>
@@ -358,15 +394,7 @@ void RandomMatrix<T>::reset(size_t rows,
                             const T& stddev,
                             const T& min,
                             const T& max){
-    if(rows * cols != this->_rows * this->_cols){
-        if(this->_data != nullptr){
-            delete[] this->_data;
-        }
-        this->_data = new T[rows * cols];
-    }
-
-    this->_rows = rows;
-    this->_cols = cols;
+    this->resize(rows, cols);
     _mean_value = mean_value;
     _stddev     = stddev;
     _min        = min;
@@ -0,0 +1,297 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 18:30
+ * Last modified : 2026-10-17 18:30
+ * Filename      : MatrixFFT.cpp
+ * Description   : fft convolution with cached kernal spectra
+ **********************************************/
+#include "algebra/MatrixFFT.h"
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+namespace abcdl{
+namespace algebra{
+
+/*
+ * a P x Q fft convolution takes about the time of P * Q * log2(P * Q)
+ * direct multiply-adds, the kernal spectrum being cached.
+ */
+static const size_t FFT_COST = 1;
+
+static inline size_t next_pow2(const size_t n){
+    size_t size = 2;
+    while(size < n){
+        size <<= 1;
+    }
+    return size;
+}
+
+static inline size_t log2_size(const size_t n){
+    size_t id = 0;
+    while((static_cast<size_t>(1) << id) < n){
+        id++;
+    }
+    return id;
+}
+
+//plain complex multiply, std::complex checks for inf and nan
+template<class C>
+static inline C mul(const C& a, const C& b){
+    return C(a.real() * b.real() - a.imag() * b.imag(),
+             a.real() * b.imag() + a.imag() * b.real());
+}
+
+template<class T>
+bool MatrixFFT<T>::is_preferred(const size_t rows,
+                                const size_t cols,
+                                const size_t kernal_row,
+                                const size_t kernal_col,
+                                const size_t conv_row,
+                                const size_t conv_col){
+    if(!std::is_floating_point<T>::value){
+        return false;
+    }
+    size_t fft_row = next_pow2(rows + kernal_row - 1);
+    size_t fft_col = next_pow2(cols + kernal_col - 1);
+
+    size_t direct_cost = conv_row * conv_col * kernal_row * kernal_col;
+    size_t fft_cost = fft_row * fft_col * log2_size(fft_row * fft_col);
+    return direct_cost > FFT_COST * fft_cost;
+}
+
+template<class T>
+void MatrixFFT<T>::convn(T* result,
+                         const size_t conv_row,
+                         const size_t conv_col,
+                         const T* data,
+                         const size_t rows,
+                         const size_t cols,
+                         const T* kernal,
+                         const size_t kernal_row,
+                         const size_t kernal_col,
+                         const size_t stride,
+                         const size_t pad_row,
+                         const size_t pad_col){
+    //linear convolution with the flipped kernal is the correlation of convn
+    size_t linear_row = rows + kernal_row - 1;
+    size_t linear_col = cols + kernal_col - 1;
+    size_t fft_row = next_pow2(linear_row);
+    size_t fft_col = next_pow2(linear_col);
+    size_t half_col = fft_col / 2 + 1;
+
+    rfft2(_spectrum, data, rows, cols, fft_row, fft_col);
+    const std::vector<Complex>& spectrum = kernal_spectrum(kernal, kernal_row, kernal_col, fft_row, fft_col);
+    for(size_t i = 0; i != fft_row * half_col; i++){
+        _spectrum[i] = mul(_spectrum[i], spectrum[i]);
+    }
+    irfft2(_values, _spectrum, fft_row, fft_col);
+
+    //FULL starts at the first overlap, VALID at the first full overlap, SAME between
+    size_t row_offset = kernal_row - 1 - pad_row;
+    size_t col_offset = kernal_col - 1 - pad_col;
+    R scale = static_cast<R>(1) / (fft_row * (fft_col / 2));
+    for(size_t i = 0; i != conv_row; i++){
+        size_t row = i * stride + row_offset;
+        for(size_t j = 0; j != conv_col; j++){
+            size_t col = j * stride + col_offset;
+            if(row < linear_row && col < linear_col){
+                result[i * conv_col + j] = static_cast<T>(_values[row * fft_col + col] * scale);
+            }else{
+                result[i * conv_col + j] = 0;
+            }
+        }
+    }
+}
+
+template<class T>
+const std::vector<typename MatrixFFT<T>::Complex>& MatrixFFT<T>::kernal_spectrum(const T* kernal,
+                                                                                 const size_t kernal_row,
+                                                                                 const size_t kernal_col,
+                                                                                 const size_t fft_row,
+                                                                                 const size_t fft_col){
+    size_t size = kernal_row * kernal_col;
+    Spectrum* entry = nullptr;
+    for(auto& spectrum : _spectra){
+        if(spectrum.kernal == kernal &&
+           spectrum.kernal_row == kernal_row &&
+           spectrum.kernal_col == kernal_col &&
+           spectrum.fft_row == fft_row &&
+           spectrum.fft_col == fft_col){
+            //same weights, nothing updated them since the spectrum was made
+            if(memcmp(spectrum.values.data(), kernal, sizeof(T) * size) == 0){
+                return spectrum.spectrum;
+            }
+            entry = &spectrum;
+            break;
+        }
+    }
+
+    if(entry == nullptr){
+        if(_spectra.size() >= MAX_CACHE_SIZE){
+            _spectra.clear();
+        }
+        _spectra.push_back(Spectrum());
+        entry = &_spectra.back();
+        entry->kernal     = kernal;
+        entry->kernal_row = kernal_row;
+        entry->kernal_col = kernal_col;
+        entry->fft_row    = fft_row;
+        entry->fft_col    = fft_col;
+    }
+    entry->values.assign(kernal, kernal + size);
+
+    std::vector<T> flipped(size);
+    for(size_t i = 0; i != size; i++){
+        flipped[i] = kernal[size - 1 - i];
+    }
+    rfft2(entry->spectrum, flipped.data(), kernal_row, kernal_col, fft_row, fft_col);
+    return entry->spectrum;
+}
+
+template<class T>
+void MatrixFFT<T>::rfft2(std::vector<Complex>& spectrum,
+                         const T* data,
+                         const size_t rows,
+                         const size_t cols,
+                         const size_t fft_row,
+                         const size_t fft_col){
+    size_t half = fft_col / 2;
+    size_t half_col = half + 1;
+    spectrum.assign(fft_row * half_col, Complex(0, 0));
+    _buffer.resize(std::max(half, fft_row));
+    const std::vector<Complex>& w = twiddles(fft_col);
+
+    /*
+     * a real row of n values is one complex fft of n / 2:
+     * z[k] = x[2k] + i x[2k + 1], X[k] = E[k] + w^k O[k].
+     */
+    for(size_t r = 0; r != rows; r++){
+        const T* row = &data[r * cols];
+        for(size_t k = 0; k != half; k++){
+            R even = 2 * k < cols ? static_cast<R>(row[2 * k]) : 0;
+            R odd  = 2 * k + 1 < cols ? static_cast<R>(row[2 * k + 1]) : 0;
+            _buffer[k] = Complex(even, odd);
+        }
+        fft(_buffer.data(), half, false);
+
+        Complex* x = &spectrum[r * half_col];
+        for(size_t k = 0; k <= half; k++){
+            Complex z  = _buffer[k % half];
+            Complex zc = std::conj(_buffer[(half - k) % half]);
+            Complex e  = (z + zc) * static_cast<R>(0.5);
+            Complex o  = (z - zc) * Complex(0, -0.5);
+            //w^(n / 2) = -1
+            x[k] = k == half ? e - o : e + mul(w[k], o);
+        }
+    }
+
+    //rows past the data are 0, columns still need them
+    for(size_t c = 0; c != half_col; c++){
+        for(size_t r = 0; r != fft_row; r++){
+            _buffer[r] = spectrum[r * half_col + c];
+        }
+        fft(_buffer.data(), fft_row, false);
+        for(size_t r = 0; r != fft_row; r++){
+            spectrum[r * half_col + c] = _buffer[r];
+        }
+    }
+}
+
+template<class T>
+void MatrixFFT<T>::irfft2(std::vector<R>& values,
+                          std::vector<Complex>& spectrum,
+                          const size_t fft_row,
+                          const size_t fft_col){
+    size_t half = fft_col / 2;
+    size_t half_col = half + 1;
+    values.resize(fft_row * fft_col);
+    _buffer.resize(std::max(half, fft_row));
+    const std::vector<Complex>& w = twiddles(fft_col);
+
+    for(size_t c = 0; c != half_col; c++){
+        for(size_t r = 0; r != fft_row; r++){
+            _buffer[r] = spectrum[r * half_col + c];
+        }
+        fft(_buffer.data(), fft_row, true);
+        for(size_t r = 0; r != fft_row; r++){
+            spectrum[r * half_col + c] = _buffer[r];
+        }
+    }
+
+    //E[k] and O[k] back from X[k] and X[n / 2 - k], then z = E + i O
+    for(size_t r = 0; r != fft_row; r++){
+        const Complex* x = &spectrum[r * half_col];
+        for(size_t k = 0; k != half; k++){
+            Complex xc = std::conj(x[half - k]);
+            Complex e  = (x[k] + xc) * static_cast<R>(0.5);
+            Complex o  = mul(x[k] - xc, std::conj(w[k])) * static_cast<R>(0.5);
+            _buffer[k] = e + mul(Complex(0, 1), o);
+        }
+        fft(_buffer.data(), half, true);
+
+        R* row = &values[r * fft_col];
+        for(size_t k = 0; k != half; k++){
+            row[2 * k]     = _buffer[k].real();
+            row[2 * k + 1] = _buffer[k].imag();
+        }
+    }
+}
+
+template<class T>
+void MatrixFFT<T>::fft(Complex* data, const size_t n, const bool inverse){
+    if(n <= 1){
+        return;
+    }
+
+    //bit reversed order
+    for(size_t i = 1, j = 0; i < n; i++){
+        size_t bit = n >> 1;
+        for(; j & bit; bit >>= 1){
+            j ^= bit;
+        }
+        j ^= bit;
+        if(i < j){
+            std::swap(data[i], data[j]);
+        }
+    }
+
+    const std::vector<Complex>& w = twiddles(n);
+    for(size_t len = 2; len <= n; len <<= 1){
+        size_t half = len >> 1;
+        size_t step = n / len;
+        for(size_t i = 0; i < n; i += len){
+            for(size_t k = 0; k != half; k++){
+                Complex t = mul(inverse ? std::conj(w[k * step]) : w[k * step], data[i + k + half]);
+                data[i + k + half] = data[i + k] - t;
+                data[i + k] += t;
+            }
+        }
+    }
+}
+
+template<class T>
+const std::vector<typename MatrixFFT<T>::Complex>& MatrixFFT<T>::twiddles(const size_t n){
+    size_t id = log2_size(n);
+    if(_twiddles.size() <= id){
+        _twiddles.resize(id + 1);
+    }
+    std::vector<Complex>& w = _twiddles[id];
+    if(w.empty() && n > 1){
+        w.resize(n / 2);
+        const double pi = std::acos(-1.0);
+        for(size_t k = 0; k != n / 2; k++){
+            double angle = -2 * pi * k / n;
+            w[k] = Complex(static_cast<R>(std::cos(angle)), static_cast<R>(std::sin(angle)));
+        }
+    }
+    return w;
+}
+
+template class MatrixFFT<int>;
+template class MatrixFFT<float>;
+template class MatrixFFT<double>;
+template class MatrixFFT<size_t>;
+
+}//namespace algebra
+}//namespace abcdl
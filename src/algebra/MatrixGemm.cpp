@@ -0,0 +1,379 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 11:02
+ * Last modified : 2026-10-17 11:02
+ * Filename      : MatrixGemm.cpp
+ * Description   : packed, cache blocked matrix multiply
+ **********************************************/
+#include "algebra/MatrixGemm.h"
+#include "algebra/Matrix.h"
+#include "algebra/MatrixKernel.h"
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+namespace abcdl{
+namespace algebra{
+
+//below this many multiply-adds packing costs more than it saves
+static const size_t SMALL_GEMM_SIZE = 32 * 32 * 32;
+
+/*
+ * epilogue of one row of C, buffer holds n values,
+ * used where C is written row by row.
+ */
+template<class T>
+static inline void row_epilogue(T* c_row,
+                                const size_t n,
+                                const GemmEpilogue<T>& epilogue,
+                                T* buffer){
+    if(epilogue.scale != nullptr){
+        const T* scale = epilogue.scale;
+        if(epilogue.kernel != nullptr){
+            epilogue.kernel(buffer, scale, n);
+            scale = buffer;
+        }
+        for(size_t j = 0; j != n; j++){
+            c_row[j] *= scale[j];
+        }
+    }else{
+        if(epilogue.bias != nullptr){
+            for(size_t j = 0; j != n; j++){
+                c_row[j] += epilogue.bias[j];
+            }
+        }
+        if(epilogue.kernel != nullptr){
+            epilogue.kernel(c_row, c_row, n);
+        }
+    }
+}
+
+/*
+ * epilogue of a MR * NR accumulator tile, m * n of it is valid.
+ * The kernel runs once over the whole tile, padding values are 0.
+ */
+template<class T, size_t MR, size_t NR>
+static inline void tile_epilogue(T* ab,
+                                 const size_t m,
+                                 const size_t n,
+                                 const GemmEpilogue<T>& epilogue){
+    if(epilogue.scale != nullptr){
+        T scale[MR * NR];
+        for(size_t i = 0; i != MR * NR; i++){
+            scale[i] = 0;
+        }
+        for(size_t i = 0; i != m; i++){
+            memcpy(&scale[i * NR], &epilogue.scale[i * epilogue.ld_scale], sizeof(T) * n);
+        }
+        if(epilogue.kernel != nullptr){
+            epilogue.kernel(scale, scale, MR * NR);
+        }
+        for(size_t i = 0; i != MR * NR; i++){
+            ab[i] *= scale[i];
+        }
+    }else{
+        if(epilogue.bias != nullptr){
+            for(size_t i = 0; i != m; i++){
+                for(size_t j = 0; j != n; j++){
+                    ab[i * NR + j] += epilogue.bias[j];
+                }
+            }
+        }
+        if(epilogue.kernel != nullptr){
+            epilogue.kernel(ab, ab, MR * NR);
+        }
+    }
+}
+
+/*
+ * MR * NR accumulators are kept in registers for the whole kc loop,
+ * a is a packed MR-row panel and b a packed NR-col panel of A and B.
+ * epilogue is not nullptr only on the last kc panel.
+ */
+template<class T, size_t MR, size_t NR>
+static inline void micro_kernel(const size_t kc,
+                                const T* a,
+                                const T* b,
+                                T* c,
+                                const size_t ldc,
+                                const size_t m,
+                                const size_t n,
+                                const bool accumulate,
+                                const GemmEpilogue<T>* epilogue){
+    //simd register tile of the instruction set picked at startup
+    T ab[MR * NR];
+    MatrixKernel<T>::gemm_tile(ab, a, b, kc);
+
+    if(epilogue != nullptr){
+        if(accumulate){
+            for(size_t i = 0; i != m; i++){
+                for(size_t j = 0; j != n; j++){
+                    ab[i * NR + j] += c[i * ldc + j];
+                }
+            }
+        }
+        tile_epilogue<T, MR, NR>(ab, m, n, *epilogue);
+        for(size_t i = 0; i != m; i++){
+            memcpy(&c[i * ldc], &ab[i * NR], sizeof(T) * n);
+        }
+        return;
+    }
+
+    for(size_t i = 0; i != m; i++){
+        T* c_row = &c[i * ldc];
+        const T* ab_row = &ab[i * NR];
+        if(accumulate){
+            for(size_t j = 0; j != n; j++){
+                c_row[j] += ab_row[j];
+            }
+        }else{
+            for(size_t j = 0; j != n; j++){
+                c_row[j] = ab_row[j];
+            }
+        }
+    }
+}
+
+template<class T>
+void MatrixGemm<T>::gemm(const size_t m,
+                         const size_t n,
+                         const size_t k,
+                         const T* a,
+                         const size_t rs_a,
+                         const size_t cs_a,
+                         const T* b,
+                         const size_t rs_b,
+                         const size_t cs_b,
+                         T* c,
+                         const size_t ldc) const{
+    gemm(m, n, k, a, rs_a, cs_a, b, rs_b, cs_b, c, ldc, GemmEpilogue<T>());
+}
+
+template<class T>
+void MatrixGemm<T>::gemm(const size_t m,
+                         const size_t n,
+                         const size_t k,
+                         const T* a,
+                         const size_t rs_a,
+                         const size_t cs_a,
+                         const T* b,
+                         const size_t rs_b,
+                         const size_t cs_b,
+                         T* c,
+                         const size_t ldc,
+                         const GemmEpilogue<T>& epilogue) const{
+    if(m == 0 || n == 0){
+        return;
+    }
+    if(k == 0){
+        std::vector<T> buffer(n);
+        for(size_t i = 0; i != m; i++){
+            memset(&c[i * ldc], 0, sizeof(T) * n);
+            if(!epilogue.empty()){
+                row_epilogue(&c[i * ldc], n, epilogue.offset(i, 0), buffer.data());
+            }
+        }
+        return;
+    }
+
+    const size_t MR = GemmBlock<T>::MR;
+    const size_t NR = GemmBlock<T>::NR;
+    const size_t MC = GemmBlock<T>::MC;
+    const size_t KC = GemmBlock<T>::KC;
+    const size_t NC = GemmBlock<T>::NC;
+
+    if(m < MR || m * n * k <= SMALL_GEMM_SIZE){
+        small_gemm(m, n, k, a, rs_a, cs_a, b, rs_b, cs_b, c, ldc, epilogue);
+        return;
+    }
+
+    /*
+     * packed B is shared by all threads of one (jc, pc) block, it must not
+     * be thread local: a waiting thread may run another gemm of the pool.
+     */
+    size_t max_nc = std::min(NC, n);
+    //panels come from the allocator, aligned like any matrix buffer
+    Matrix<T> packed_b;
+    packed_b.resize(1, KC * ((max_nc + NR - 1) / NR) * NR);
+
+    size_t num_row_block = (m + MR - 1) / MR;
+
+    for(size_t jc = 0; jc < n; jc += NC){
+        size_t nc = std::min(NC, n - jc);
+        for(size_t pc = 0; pc < k; pc += KC){
+            size_t kc = std::min(KC, k - pc);
+            bool accumulate = (pc != 0);
+            const GemmEpilogue<T>* last_epilogue = (pc + kc == k && !epilogue.empty()) ? &epilogue : nullptr;
+            pack_b(kc, nc, &b[pc * rs_b + jc * cs_b], rs_b, cs_b, packed_b.data());
+
+            size_t size = m * nc * kc;
+            size_t num_thread = std::min(num_row_block, _po.get_num_thread(size, _po.get_block_size(size)));
+            const T* packed_b_data = packed_b.data();
+
+            //split rows of C over threads, every range starts at a MR boundary
+            _po.parallel_range(num_row_block, num_thread,
+                [this, MR, MC, KC, m, nc, kc, pc, jc, a, rs_a, cs_a, c, ldc, accumulate, packed_b_data, last_epilogue](size_t start_idx, size_t end_idx){
+                    //kept by the thread across calls, so it must not come from an arena of the caller
+                    AllocatorScope scope(nullptr);
+                    static thread_local Matrix<T> packed_a;
+                    if(packed_a.get_size() < MC * KC){
+                        packed_a.resize(1, MC * KC);
+                    }
+                    size_t row_start = start_idx * MR;
+                    size_t row_end = std::min(m, end_idx * MR);
+                    for(size_t ic = row_start; ic < row_end; ic += MC){
+                        size_t mc = std::min(MC, row_end - ic);
+                        pack_a(mc, kc, &a[ic * rs_a + pc * cs_a], rs_a, cs_a, packed_a.data());
+                        if(last_epilogue != nullptr){
+                            GemmEpilogue<T> block_epilogue = last_epilogue->offset(ic, jc);
+                            macro_kernel(mc, nc, kc, packed_a.data(), packed_b_data, &c[ic * ldc + jc], ldc, accumulate, &block_epilogue);
+                        }else{
+                            macro_kernel(mc, nc, kc, packed_a.data(), packed_b_data, &c[ic * ldc + jc], ldc, accumulate, nullptr);
+                        }
+                    }
+                }
+            );
+        }
+    }
+}
+
+template<class T>
+void MatrixGemm<T>::small_gemm(const size_t m,
+                               const size_t n,
+                               const size_t k,
+                               const T* a,
+                               const size_t rs_a,
+                               const size_t cs_a,
+                               const T* b,
+                               const size_t rs_b,
+                               const size_t cs_b,
+                               T* c,
+                               const size_t ldc,
+                               const GemmEpilogue<T>& epilogue) const{
+    size_t size = m * n * k;
+    size_t num_thread = std::min(m, _po.get_num_thread(size, _po.get_block_size(size)));
+
+    //i-k-j order streams rows of B instead of striding over its columns
+    _po.parallel_range(m, num_thread,
+        [n, k, a, rs_a, cs_a, b, rs_b, cs_b, c, ldc, &epilogue](size_t start_idx, size_t end_idx){
+            std::vector<T> buffer(epilogue.scale != nullptr ? n : 0);
+            for(size_t i = start_idx; i != end_idx; i++){
+                T* c_row = &c[i * ldc];
+                memset(c_row, 0, sizeof(T) * n);
+                for(size_t p = 0; p != k; p++){
+                    const T a_value = a[i * rs_a + p * cs_a];
+                    if(a_value == 0){
+                        continue;
+                    }
+                    const T* b_row = &b[p * rs_b];
+                    if(cs_b == 1){
+                        for(size_t j = 0; j != n; j++){
+                            c_row[j] += a_value * b_row[j];
+                        }
+                    }else{
+                        for(size_t j = 0; j != n; j++){
+                            c_row[j] += a_value * b_row[j * cs_b];
+                        }
+                    }
+                }
+                //the row was just written, it is still in L1
+                if(!epilogue.empty()){
+                    row_epilogue(c_row, n, epilogue.offset(i, 0), buffer.data());
+                }
+            }
+        }
+    );
+}
+
+template<class T>
+void MatrixGemm<T>::pack_a(const size_t mc,
+                           const size_t kc,
+                           const T* a,
+                           const size_t rs_a,
+                           const size_t cs_a,
+                           T* packed) const{
+    const size_t MR = GemmBlock<T>::MR;
+    //MR-row panels, column p of a panel is MR continuous values, tail rows are 0
+    for(size_t i = 0; i < mc; i += MR){
+        size_t mr = std::min(MR, mc - i);
+        for(size_t p = 0; p != kc; p++){
+            for(size_t ii = 0; ii != mr; ii++){
+                packed[ii] = a[(i + ii) * rs_a + p * cs_a];
+            }
+            for(size_t ii = mr; ii != MR; ii++){
+                packed[ii] = 0;
+            }
+            packed += MR;
+        }
+    }
+}
+
+template<class T>
+void MatrixGemm<T>::pack_b(const size_t kc,
+                           const size_t nc,
+                           const T* b,
+                           const size_t rs_b,
+                           const size_t cs_b,
+                           T* packed) const{
+    const size_t NR = GemmBlock<T>::NR;
+    //NR-col panels, row p of a panel is NR continuous values, tail cols are 0
+    for(size_t j = 0; j < nc; j += NR){
+        size_t nr = std::min(NR, nc - j);
+        for(size_t p = 0; p != kc; p++){
+            const T* b_row = &b[p * rs_b + j * cs_b];
+            if(cs_b == 1){
+                memcpy(packed, b_row, sizeof(T) * nr);
+            }else{
+                for(size_t jj = 0; jj != nr; jj++){
+                    packed[jj] = b_row[jj * cs_b];
+                }
+            }
+            for(size_t jj = nr; jj != NR; jj++){
+                packed[jj] = 0;
+            }
+            packed += NR;
+        }
+    }
+}
+
+template<class T>
+void MatrixGemm<T>::macro_kernel(const size_t mc,
+                                 const size_t nc,
+                                 const size_t kc,
+                                 const T* packed_a,
+                                 const T* packed_b,
+                                 T* c,
+                                 const size_t ldc,
+                                 const bool accumulate,
+                                 const GemmEpilogue<T>* epilogue) const{
+    const size_t MR = GemmBlock<T>::MR;
+    const size_t NR = GemmBlock<T>::NR;
+    for(size_t j = 0; j < nc; j += NR){
+        size_t nr = std::min(NR, nc - j);
+        for(size_t i = 0; i < mc; i += MR){
+            size_t mr = std::min(MR, mc - i);
+            if(epilogue != nullptr){
+                GemmEpilogue<T> tile_epilogue = epilogue->offset(i, j);
+                micro_kernel<T, GemmBlock<T>::MR, GemmBlock<T>::NR>(kc,
+                    &packed_a[i * kc],
+                    &packed_b[j * kc],
+                    &c[i * ldc + j],
+                    ldc, mr, nr, accumulate, &tile_epilogue);
+            }else{
+                micro_kernel<T, GemmBlock<T>::MR, GemmBlock<T>::NR>(kc,
+                    &packed_a[i * kc],
+                    &packed_b[j * kc],
+                    &c[i * ldc + j],
+                    ldc, mr, nr, accumulate, nullptr);
+            }
+        }
+    }
+}
+
+template class MatrixGemm<int>;
+template class MatrixGemm<float>;
+template class MatrixGemm<double>;
+template class MatrixGemm<size_t>;
+
+}//namespace algebra
+}//namespace abcdl
@@ -9,6 +9,8 @@
 #include "algebra/MatrixHelper.h"
 #include <cmath>
 #include <string.h>
+#include <functional>
+#include <algorithm>
 
 namespace abcdl{
 namespace algebra{
@@ -25,48 +27,192 @@ template<class T>
 void MatrixHelper<T>::dot(Matrix<T>& mat,
 						  const Matrix<T>& mat_a,
 						  const Matrix<T>& mat_b){
-    size_t row_a = mat_a.rows();
-    size_t col_a = mat_a.cols();
-    size_t row_b = mat_b.rows();
-    size_t col_b = mat_b.cols();
+    dot(mat, MatrixView<T>(mat_a), MatrixView<T>(mat_b));
+}
+
+template<class T>
+Matrix<T> MatrixHelper<T>::dot(const MatrixView<T>& view_a, const MatrixView<T>& view_b){
+    Matrix<T> mat;
+    dot(mat, view_a, view_b);
+    return mat;
+}
+
+template<class T>
+void MatrixHelper<T>::dot(Matrix<T>& mat,
+                          const MatrixView<T>& view_a,
+                          const MatrixView<T>& view_b){
+    size_t row_a = view_a.rows();
+    size_t col_a = view_a.cols();
+    size_t row_b = view_b.rows();
+    size_t col_b = view_b.cols();
 
     CHECK(col_a == row_b);
+    if(col_a != row_b){
+        return;
+    }
 
-    T* data   = new T[row_a * col_b];
-    T* data_a = mat_a.data();
-    T* data_b = mat_b.data();
+    T* data = result_data(mat, row_a, col_b, view_a, view_b);
+    _gemm.gemm(row_a, col_b, col_a,
+               view_a.data(), view_a.row_stride(), view_a.col_stride(),
+               view_b.data(), view_b.row_stride(), view_b.col_stride(),
+               data, col_b);
+    if(data != mat.data()){
+        mat.set_allocated_data(data, row_a, col_b);
+    }
+}
 
-    size_t size = row_a * col_b * col_a;
-    size_t num_thread = _po.get_num_thread(size, _po.get_block_size(size));
-    size_t block_size = row_a / num_thread;
-    if(row_a % num_thread != 0){
-        block_size += 1;
+template<class T>
+void MatrixHelper<T>::dot(PaddedMatrix<T>& mat,
+                          const MatrixView<T>& view_a,
+                          const MatrixView<T>& view_b){
+    CHECK(view_a.cols() == view_b.rows());
+    if(view_a.cols() != view_b.rows()){
+        return;
+    }
+
+    mat.resize(view_a.rows(), view_b.cols());
+    _gemm.gemm(view_a.rows(), view_b.cols(), view_a.cols(),
+               view_a.data(), view_a.row_stride(), view_a.col_stride(),
+               view_b.data(), view_b.row_stride(), view_b.col_stride(),
+               mat.data(), mat.pitch());
+}
+
+template<class T>
+void MatrixHelper<T>::dot_bias_activate(Matrix<T>& mat,
+                                        const Matrix<T>& mat_a,
+                                        const Matrix<T>& mat_b,
+                                        const Matrix<T>& bias,
+                                        const Activate_type type){
+    dot_bias_activate(mat, MatrixView<T>(mat_a), MatrixView<T>(mat_b), bias, type);
+}
+
+template<class T>
+void MatrixHelper<T>::dot_bias_activate(Matrix<T>& mat,
+                                        const MatrixView<T>& view_a,
+                                        const MatrixView<T>& view_b,
+                                        const Matrix<T>& bias,
+                                        const Activate_type type){
+    size_t row_a = view_a.rows();
+    size_t col_a = view_a.cols();
+    size_t col_b = view_b.cols();
+
+    CHECK(col_a == view_b.rows());
+    CHECK(bias.get_size() == col_b);
+    if(col_a != view_b.rows() || bias.get_size() != col_b){
+        return;
     }
 
-    std::vector<std::thread> threads(num_thread);
-    for(size_t i = 0; i != num_thread; i++){
-        threads[i] = std::thread(
-            [&data, &data_a, &data_b, &col_a, &col_b](size_t start_idx, size_t end_idx){
-				for(size_t ti = start_idx; ti < end_idx; ti++){
-					size_t a_init_idx = ti * col_a;
-					for(size_t tj = 0; tj != col_b; tj++){
-						T value = 0;
-						size_t a_idx = a_init_idx;
-						for(size_t tk = 0; tk != col_a; tk++){
-							value += data_a[a_idx++] * data_b[tk * col_b + tj];
-						}
-						data[ti * col_b + tj] = value;
-					}
-				}
-            }, i * block_size , std::min(row_a, (i + 1) * block_size)
-        );
+    GemmEpilogue<T> epilogue;
+    epilogue.bias   = bias.data();
+    epilogue.kernel = activate_kernel(type);
+
+    T* data = result_data(mat, row_a, col_b, view_a, view_b);
+    _gemm.gemm(row_a, col_b, col_a,
+               view_a.data(), view_a.row_stride(), view_a.col_stride(),
+               view_b.data(), view_b.row_stride(), view_b.col_stride(),
+               data, col_b, epilogue);
+    if(data != mat.data()){
+        mat.set_allocated_data(data, row_a, col_b);
     }
+}
 
-    for(auto& thread : threads){
-        thread.join();
+template<class T>
+void MatrixHelper<T>::dot_transpose_derivative(Matrix<T>& mat,
+                                               const Matrix<T>& delta,
+                                               const Matrix<T>& weight,
+                                               const Matrix<T>& activate_data,
+                                               const Activate_type type){
+    size_t rows  = delta.rows();
+    size_t depth = delta.cols();
+    size_t cols  = weight.rows();
+
+    CHECK(depth == weight.cols());
+    CHECK(activate_data.rows() == rows && activate_data.cols() == cols);
+    if(depth != weight.cols() || activate_data.rows() != rows || activate_data.cols() != cols){
+        return;
     }
 
-    mat.set_shallow_data(data, row_a, col_b);
+    //derivative of LINEAR is 1, nothing to multiply
+    GemmEpilogue<T> epilogue;
+    epilogue.kernel = derivative_kernel(type);
+    if(epilogue.kernel != nullptr){
+        epilogue.scale    = activate_data.data();
+        epilogue.ld_scale = cols;
+    }
+
+    //weight.T(p, j) = weight(j, p), read by swapping the strides
+    T* data = result_data(mat, rows, cols, MatrixView<T>(delta), MatrixView<T>(weight), &activate_data);
+    _gemm.gemm(rows, cols, depth, delta.data(), depth, 1, weight.data(), 1, depth, data, cols, epilogue);
+    if(data != mat.data()){
+        mat.set_allocated_data(data, rows, cols);
+    }
+}
+
+template<class T>
+static bool is_overlap(const Matrix<T>& mat, const T* data, const size_t size){
+    if(mat.data() == nullptr || data == nullptr || size == 0){
+        return false;
+    }
+    std::less<const T*> less;
+    return less(data, mat.data() + mat.get_capacity()) && less(mat.data(), data + size);
+}
+
+template<class T>
+T* MatrixHelper<T>::result_data(Matrix<T>& mat,
+                                const size_t rows,
+                                const size_t cols,
+                                const MatrixView<T>& view_a,
+                                const MatrixView<T>& view_b,
+                                const Matrix<T>* mat_c){
+    auto view_size = [](const MatrixView<T>& view) -> size_t{
+        if(view.rows() == 0 || view.cols() == 0){
+            return 0;
+        }
+        return (view.rows() - 1) * view.row_stride() + (view.cols() - 1) * view.col_stride() + 1;
+    };
+    if(is_overlap(mat, view_a.data(), view_size(view_a))
+       || is_overlap(mat, view_b.data(), view_size(view_b))
+       || (mat_c != nullptr && is_overlap(mat, mat_c->data(), mat_c->get_size()))){
+        return mat.allocate_data(rows * cols);
+    }
+    mat.resize(rows, cols);
+    return mat.data();
+}
+
+template<class T>
+typename MatrixHelper<T>::Kernel MatrixHelper<T>::activate_kernel(const Activate_type type) const{
+    switch(type){
+        case SIGMOID:
+            return &MatrixKernel<T>::sigmoid;
+        case TANH:
+            return &MatrixKernel<T>::tanh;
+        case RELU:
+            return &MatrixKernel<T>::relu;
+        case LEAKY_RELU:
+            return &MatrixKernel<T>::leaky_relu;
+        case ELU:
+            return &MatrixKernel<T>::elu;
+        default:
+            return nullptr;
+    }
+}
+
+template<class T>
+typename MatrixHelper<T>::Kernel MatrixHelper<T>::derivative_kernel(const Activate_type type) const{
+    switch(type){
+        case SIGMOID:
+            return &MatrixKernel<T>::sigmoid_derivative;
+        case TANH:
+            return &MatrixKernel<T>::tanh_derivative;
+        case RELU:
+            return &MatrixKernel<T>::relu_derivative;
+        case LEAKY_RELU:
+            return &MatrixKernel<T>::leaky_relu_derivative;
+        case ELU:
+            return &MatrixKernel<T>::elu_derivative;
+        default:
+            return nullptr;
+    }
 }
 
 template<class T>
@@ -84,10 +230,10 @@ void MatrixHelper<T>::outer(Matrix<T>& mat,
     size_t size_b = mat_b.get_size();
     T* data_a = mat_a.data();
     T* data_b = mat_b.data();
-    T* data   = new T[size_a * size_b];
+    T* data   = mat.allocate_data(size_a * size_b);
     auto lambda = [](T* a, const T& b, const T& c){*a = b * c;};
     _po.parallel_mul2mul_cross(data, data_a, size_a, data_b, size_b, lambda);
-    mat.set_shallow_data(data, size_a, size_b);
+    mat.set_allocated_data(data, size_a, size_b);
 }
 
 template<class T>
@@ -95,157 +241,158 @@ void MatrixHelper<T>::pow(Matrix<T>& mat,
 						  const Matrix<T>& mat_a,
 						  const T& exponent){
     auto lambda = [](T* a, const T& b, const T& c){*a = std::pow(b, c);};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
+    mat.resize(mat_a.rows(), mat_a.cols());
     _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), exponent, lambda);
 }
 
 template<class T>
 void MatrixHelper<T>::log(Matrix<T>& mat, const Matrix<T>& mat_a){
     auto lambda = [](T* a, const T& b){ *a = std::log(b);};
-    if(mat.get_size() == mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
+    mat.resize(mat_a.rows(), mat_a.cols());
     _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
 }
 
 template<class T>
 void MatrixHelper<T>::exp(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ *a = std::exp(std::min(b, (T)EXP_MAX));};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::exp);
 }
 
 template<class T>
 void MatrixHelper<T>::sqrt(Matrix<T>& mat, const Matrix<T>& mat_a){
     auto lambda = [](T* a, const T& b){ *a = std::sqrt(b);};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
+    mat.resize(mat_a.rows(), mat_a.cols());
     _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
 }
 
 template<class T>
 void MatrixHelper<T>::sin(Matrix<T>& mat, const Matrix<T>& mat_a){
     auto lambda = [](T* a, const T& b){ *a = std::sin(b);};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
+    mat.resize(mat_a.rows(), mat_a.cols());
     _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
 }
 
 template<class T>
 void MatrixHelper<T>::cos(Matrix<T>& mat, const Matrix<T>& mat_a){
     auto lambda = [](T* a, const T& b){ *a = std::cos(b);};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
+    mat.resize(mat_a.rows(), mat_a.cols());
     _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
 }
 
 template<class T>
 void MatrixHelper<T>::sigmoid(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ *a = 1 / (1 + std::exp(-(std::min((T)SIGMOID_MAX, std::max(b, (T)SIGMOID_MIN)))));};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::sigmoid);
 }
 
 template<class T>
 void MatrixHelper<T>::sigmoid_derivative(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ *a = b * (1 - b);};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::sigmoid_derivative);
 }
 
 template<class T>
 void MatrixHelper<T>::softmax(Matrix<T>& mat, const Matrix<T>& mat_a){
     T max = mat_a.max();
-    if(&mat != &mat_a){
-        mat.set_data(mat_a.data(), mat_a.rows(), mat_a.cols());
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), max, &MatrixKernel<T>::softmax_exp);
+    mat /=  mat.sum();
+}
+
+template<class T>
+void MatrixHelper<T>::softmax(Matrix<T>& mat, const Matrix<T>& mat_a, const Axis_type axis_type){
+    size_t rows = mat_a.rows();
+    size_t cols = mat_a.cols();
+    mat.resize(rows, cols);
+    if(rows == 0 || cols == 0){
+        return;
+    }
+    T* data = mat.data();
+    const T* data_a = mat_a.data();
+
+    if(axis_type == COL){
+        for(size_t j = 0; j != cols; j++){
+            T max = data_a[j];
+            for(size_t i = 1; i < rows; i++){
+                max = std::max(max, data_a[i * cols + j]);
+            }
+            T sum = 0;
+            for(size_t i = 0; i != rows; i++){
+                MatrixKernel<T>::softmax_exp(&data[i * cols + j], &data_a[i * cols + j], max, 1);
+                sum += data[i * cols + j];
+            }
+            for(size_t i = 0; i != rows; i++){
+                data[i * cols + j] /= sum;
+            }
+        }
+        return;
     }
 
-    auto lambda = [](T* a, const T& max){*a = std::exp(std::max((*a - max), (T)SOFTMAX_MIN));};
-    _po.parallel_mul2one(mat.data(), mat.get_size(), max, lambda);
-    mat /=  mat.sum();
+    size_t size = mat_a.get_size();
+    size_t num_thread = _po.get_num_thread(size, _po.get_block_size(size));
+    _po.parallel_range(rows, num_thread,
+        [&](size_t start_idx, size_t end_idx){
+            for(size_t i = start_idx; i < end_idx; i++){
+                const T* row_a = &data_a[i * cols];
+                T* row = &data[i * cols];
+                T max = *std::max_element(row_a, row_a + cols);
+                MatrixKernel<T>::softmax_exp(row, row_a, max, cols);
+                T sum = 0;
+                for(size_t j = 0; j != cols; j++){
+                    sum += row[j];
+                }
+                MatrixKernel<T>::div_scalar(row, row, sum, cols);
+            }
+        }
+    );
 }
 
 template<class T>
 void MatrixHelper<T>::tanh(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ *a = 2.0 /(1.0 + std::exp(std::min((T)EXP_MAX, -2 * b))) - 1.0;};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::tanh);
 }
 
 template<class T>
 void MatrixHelper<T>::tanh_derivative(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ T tanh = std::exp(std::min((T)EXP_MAX, -2 * b)); *a = 1 - tanh * tanh;};
-    if(mat.get_size() != mat_a.get_size()){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::tanh_derivative);
 }
 
 template<class T>
 void MatrixHelper<T>::relu(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ if(b < 0) {*a = 0;} };
-    if(&mat != &mat_a){
-        mat.set_data(mat_a.data(), mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::relu);
 }
 
 template<class T>
 void MatrixHelper<T>::relu_derivative(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ if(b > 0) {*a = 1;} };
-    if(&mat != &mat_a){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::relu_derivative);
 }
 
 template<class T>
 void MatrixHelper<T>::leaky_relu(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ if(b < 0) {*a = (T)(0.01 * b);} };
-    if(&mat != &mat_a){
-        mat.set_data(mat_a.data(), mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::leaky_relu);
 }
 
 template<class T>
 void MatrixHelper<T>::leaky_relu_derivative(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ if(b >= 0){*a = (T)1;} else{*a = (T)0.01;} };
-    if(&mat != &mat_a){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::leaky_relu_derivative);
 }
 
 template<class T>
 void MatrixHelper<T>::elu(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ if(b >= 0) {*a = b;} else{*a = std::exp(std::min((T)EXP_MAX, b)) - 1;} };
-    if(&mat != &mat_a){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::elu);
 }
 
 template<class T>
 void MatrixHelper<T>::elu_derivative(Matrix<T>& mat, const Matrix<T>& mat_a){
-    auto lambda = [](T* a, const T& b){ if(b >= 0) {*a = 1;} else{*a = std::exp(std::min((T)EXP_MAX, b));} };
-    if(&mat != &mat_a){
-        mat.reset(0, mat_a.rows(), mat_a.cols());
-    }
-    _po.parallel_mul2one_copy(mat.data(), mat_a.data(), mat_a.get_size(), lambda);
+    mat.resize(mat_a.rows(), mat_a.cols());
+    _po.parallel_kernel(mat.data(), mat_a.data(), mat_a.get_size(), &MatrixKernel<T>::elu_derivative);
 }
 
 template<class T>
@@ -262,33 +409,48 @@ void MatrixHelper<T>::expand(Matrix<T>& result,
     size_t size  = row * col;
 
     size_t num_thread = _po.get_num_thread(size, _po.get_block_size(size));
-    size_t block_size = row / num_thread;
-    if(row % num_thread != 0){
-        block_size += 1;
-    }
-
-    std::vector<std::thread> threads(num_thread);
     T* data = mat.data();
-    T* new_data = new T[size];
+    T* new_data = result.allocate_data(size);
     memset(new_data, 0, sizeof(T) * size);
 
-    for(size_t i = 0; i != num_thread; i++){
-        threads[i] = std::thread(
-            [&data, &new_data,&col, &col_a, &row_dim, &col_dim](size_t start_idx, size_t end_idx){
-				for(size_t ti = start_idx; ti < end_idx; ti++){
-					for(size_t tj = 0; tj != col; tj++){
-                        new_data[ti * col + tj] = data[ti / row_dim * col_a + tj / col_dim];
-					}
-				}
-            }, i * block_size , std::min(row, (i + 1) * block_size)
-        );
+    _po.parallel_range(row, num_thread,
+        [&data, &new_data,&col, &col_a, &row_dim, &col_dim](size_t start_idx, size_t end_idx){
+            for(size_t ti = start_idx; ti < end_idx; ti++){
+                for(size_t tj = 0; tj != col; tj++){
+                    new_data[ti * col + tj] = data[ti / row_dim * col_a + tj / col_dim];
+                }
+            }
+        }
+    );
+
+    result.set_allocated_data(new_data, row, col);
+}
+
+template<class T>
+bool MatrixHelper<T>::conv_dim(const size_t size,
+                               const size_t kernal_size,
+                               const size_t stride,
+                               const Convn_type type,
+                               size_t* conv_size,
+                               size_t* padding){
+    if(kernal_size == 0 || stride == 0){
+        return false;
     }
 
-    for(auto& thread : threads){
-        thread.join();
+    if(type == SAME){
+        *conv_size = (size + stride - 1) / stride;
+        size_t total = *conv_size == 0 ? 0 : (*conv_size - 1) * stride + kernal_size;
+        *padding = total > size ? (total - size) / 2 : 0;
+        return true;
     }
 
-    result.set_shallow_data(new_data, row, col);
+    *padding = type == FULL ? kernal_size - 1 : 0;
+    size_t data_size = size + 2 * (*padding);
+    if(data_size < kernal_size){
+        return false;
+    }
+    *conv_size = (data_size - kernal_size) % stride == 0 ? (data_size - kernal_size) / stride + 1 : (data_size - kernal_size) / stride + 2;
+    return true;
 }
 
 template<class T>
@@ -302,91 +464,217 @@ bool MatrixHelper<T>::convn(Matrix<T>& result,
     size_t kernal_row = kernal.rows();
     size_t kernal_col = kernal.cols();
 
-    size_t data_row;
-    size_t data_col;
-
-    T* data;
-    T* new_data;
-    T* src_data = mat.data();
-
-    if(type == FULL && kernal_row * kernal_col != 1){
-        data_row = mat.rows() + 2 * (kernal_row - 1);
-        data_col = mat.cols() + 2 * (kernal_col - 1);
-
-        data = new T[data_row * data_col];
-        memset(data, 0, sizeof(T) * data_row * data_col);
-
-        //padding 0, (kernal_row - 1)*(kernal_col - 1)
-        for(size_t i = 0; i != rows; i++){
-            memcpy(&data[(i + kernal_row - 1) * data_col + kernal_col - 1], &src_data[i * cols], sizeof(T)* cols);
-        }
-    }else if(type == VALID){
-        data_row = rows;
-        data_col = cols;
-        data     = src_data;
-        
-        if(data_row < kernal_row || data_col < kernal_col){
-            LOG(FATAL) << "Convn error: kernal size large than mat.";
-            return false;
-        }
-    }else{
-        //todo
-        LOG(FATAL) << "todo:not support SAME type";
+    size_t conv_row;
+    size_t conv_col;
+    size_t pad_row;
+    size_t pad_col;
+    if(!conv_dim(rows, kernal_row, stride, type, &conv_row, &pad_row) ||
+       !conv_dim(cols, kernal_col, stride, type, &conv_col, &pad_col)){
+        LOG(FATAL) << "Convn error: kernal size large than mat.";
         return false;
     }
 
+    T* new_data = result.allocate_data(conv_row * conv_col);
+    T* data = mat.data();
+    T* kernal_data = kernal.data();
 
-    size_t conv_row = (data_row - kernal_row) % stride == 0 ? (data_row - kernal_row) / stride + 1 : (data_row - kernal_row) / stride + 2;
-    size_t conv_col = (data_col - kernal_col) % stride == 0 ? (data_col - kernal_col) / stride + 1 : (data_col - kernal_col) / stride + 2;
+    //3 x 3 kernal at stride 1 by winograd
+    if(MatrixWinograd<T>::is_supported(kernal_row, kernal_col, stride)){
+        _winograd.convn(new_data, conv_row, conv_col, data, rows, cols, kernal_data, pad_row, pad_col);
+        result.set_allocated_data(new_data, conv_row, conv_col);
+        return true;
+    }
 
-    new_data = new T[conv_row * conv_col];
-    T* kernal_data = kernal.data();
+    //large kernals and large FULL convolutions by fft
+    if(MatrixFFT<T>::is_preferred(rows, cols, kernal_row, kernal_col, conv_row, conv_col)){
+        _fft.convn(new_data, conv_row, conv_col, data, rows, cols, kernal_data, kernal_row, kernal_col, stride, pad_row, pad_col);
+        result.set_allocated_data(new_data, conv_row, conv_col);
+        return true;
+    }
     
     size_t size = conv_row * conv_col * kernal_row * kernal_col;
     size_t num_thread = _po.get_num_thread(size, _po.get_block_size(size));
-    size_t block_size = conv_row / num_thread;
-    if(conv_row % num_thread != 0){
-        block_size += 1;
-    }
 
-    std::vector<std::thread> threads(num_thread);
-    for(size_t i = 0; i != num_thread; i++){
-        threads[i] = std::thread(
-            [&data, &new_data, &kernal_data, &data_row, &data_col, &kernal_row, &kernal_col, &conv_col, &stride](size_t start_idx, size_t end_idx){
-				for(size_t ti = start_idx; ti < end_idx; ti++){
-                    for(size_t tj = 0; tj != conv_col; tj++){
-                        T sum = 0;
+    /*
+     * the padding is never built, positions out of mat read 0.
+     * Windows inside mat, all but a border, run without bound checks.
+     */
+    _po.parallel_range(conv_row, num_thread,
+        [&](size_t start_idx, size_t end_idx){
+            for(size_t ti = start_idx; ti < end_idx; ti++){
+                size_t top = ti * stride;
+                bool row_inside = top >= pad_row && top - pad_row + kernal_row <= rows;
+                for(size_t tj = 0; tj != conv_col; tj++){
+                    size_t left = tj * stride;
+                    T sum = 0;
+                    if(row_inside && left >= pad_col && left - pad_col + kernal_col <= cols){
+                        const T* window = &data[(top - pad_row) * cols + left - pad_col];
+                        for(size_t k_i = 0; k_i != kernal_row; k_i++){
+                            for(size_t k_j = 0; k_j != kernal_col; k_j++){
+                                sum += window[k_i * cols + k_j] * kernal_data[k_i * kernal_col + k_j];
+                            }
+                        }
+                    }else{
                         for(size_t k_i = 0; k_i != kernal_row; k_i++){
-                           size_t row = ti * stride + k_i;
+                            size_t row = top + k_i;
+                            if(row < pad_row || row - pad_row >= rows){
+                                continue;
+                            }
                             for(size_t k_j = 0; k_j != kernal_col; k_j++){
-                                size_t col = tj * stride + k_j;
-                                //skip out of range, in other word, fill 0
-                                if(row < data_row && col < data_col){
-                                    T a = data[row * data_col + col];
-                                    T b = kernal_data[k_i * kernal_col + k_j];
-                                    if(a != 0 && b != 0){
-                                        sum += a * b;
-                                    }
+                                size_t col = left + k_j;
+                                if(col < pad_col || col - pad_col >= cols){
+                                    continue;
                                 }
+                                sum += data[(row - pad_row) * cols + col - pad_col] * kernal_data[k_i * kernal_col + k_j];
                             }
                         }
-                        new_data[ti * conv_col + tj] = sum;
                     }
-				}
-            }, i * block_size , std::min(conv_row, (i + 1) * block_size)
-        );
+                    new_data[ti * conv_col + tj] = sum;
+                }
+            }
+        }
+    );
+
+    result.set_allocated_data(new_data, conv_row, conv_col);
+
+    return true;
+}
+
+template<class T>
+bool MatrixHelper<T>::im2col(Matrix<T>& result,
+                             const Tensor<T>& tensor,
+                             const size_t n,
+                             const size_t kernal_row,
+                             const size_t kernal_col,
+                             const size_t stride,
+                             const Convn_type type){
+    size_t rows = tensor.rows();
+    size_t cols = tensor.cols();
+    if(n >= tensor.num() || tensor.channels() == 0){
+        LOG(FATAL) << "Im2col error: no channel.";
+        return false;
     }
 
-    for(auto& thread : threads){
-        thread.join();
+    //same output dim as convn
+    size_t conv_row;
+    size_t conv_col;
+    size_t pad_row;
+    size_t pad_col;
+    if(!conv_dim(rows, kernal_row, stride, type, &conv_row, &pad_row) ||
+       !conv_dim(cols, kernal_col, stride, type, &conv_col, &pad_col)){
+        LOG(FATAL) << "Im2col error: kernal size large than mat.";
+        return false;
     }
+    size_t conv_size = conv_row * conv_col;
+    size_t kernal_size = kernal_row * kernal_col;
 
-    result.set_shallow_data(new_data, conv_row, conv_col);
+    result.resize(tensor.channels() * kernal_size, conv_size);
+    T* new_data = result.data();
 
-    if(type == abcdl::algebra::FULL){
-    	delete[] data;
+    size_t size = result.get_size();
+    size_t num_thread = _po.get_num_thread(size, _po.get_block_size(size));
+
+    //row (channel, k_i, k_j) of result holds that kernal element of every output position
+    _po.parallel_range(result.rows(), num_thread,
+        [&](size_t start_idx, size_t end_idx){
+            for(size_t i = start_idx; i < end_idx; i++){
+                MatrixView<T> view = tensor.view(n, i / kernal_size);
+                const T* src_data = view.data();
+                size_t row_stride = view.row_stride();
+                size_t col_stride = view.col_stride();
+                size_t k_i = i % kernal_size / kernal_col;
+                size_t k_j = i % kernal_col;
+                T* data = &new_data[i * conv_size];
+                for(size_t ti = 0; ti != conv_row; ti++){
+                    size_t row = ti * stride + k_i;
+                    //padding and out of range are filled 0
+                    if(row < pad_row || row - pad_row >= rows){
+                        memset(&data[ti * conv_col], 0, sizeof(T) * conv_col);
+                        continue;
+                    }
+                    const T* src_row = &src_data[(row - pad_row) * row_stride];
+                    for(size_t tj = 0; tj != conv_col; tj++){
+                        size_t col = tj * stride + k_j;
+                        data[ti * conv_col + tj] = col >= pad_col && col - pad_col < cols ? src_row[(col - pad_col) * col_stride] : 0;
+                    }
+                }
+            }
+        }
+    );
+
+    return true;
+}
+
+template<class T>
+bool MatrixHelper<T>::col2im(Tensor<T>& tensor,
+                             const size_t n,
+                             const Matrix<T>& patches,
+                             const size_t kernal_row,
+                             const size_t kernal_col,
+                             const size_t stride,
+                             const Convn_type type){
+    size_t rows = tensor.rows();
+    size_t cols = tensor.cols();
+    size_t channels = tensor.channels();
+
+    size_t conv_row;
+    size_t conv_col;
+    size_t pad_row;
+    size_t pad_col;
+    if(n >= tensor.num() ||
+       !conv_dim(rows, kernal_row, stride, type, &conv_row, &pad_row) ||
+       !conv_dim(cols, kernal_col, stride, type, &conv_col, &pad_col)){
+        LOG(FATAL) << "Col2im error: kernal size large than mat.";
+        return false;
+    }
+    size_t conv_size = conv_row * conv_col;
+    size_t kernal_size = kernal_row * kernal_col;
+    if(patches.rows() != channels * kernal_size || patches.cols() != conv_size){
+        LOG(FATAL) << "Col2im error: patches dim must be " << channels * kernal_size << " x " << conv_size;
+        return false;
     }
 
+    const T* patch_data = patches.data();
+    size_t size = patches.get_size();
+    size_t num_thread = _po.get_num_thread(size, _po.get_block_size(size));
+
+    //a channel only takes its own rows of patches, so threads split the channels
+    _po.parallel_range(channels, num_thread,
+        [&](size_t start_idx, size_t end_idx){
+            for(size_t c = start_idx; c < end_idx; c++){
+                //views are read only, the channel is written through the tensor
+                MatrixView<T> view = tensor.view(n, c);
+                T* dst_data = &tensor.data()[tensor.offset(n, c, 0, 0)];
+                size_t row_stride = view.row_stride();
+                size_t col_stride = view.col_stride();
+                for(size_t i = 0; i != rows; i++){
+                    for(size_t j = 0; j != cols; j++){
+                        dst_data[i * row_stride + j * col_stride] = 0;
+                    }
+                }
+
+                for(size_t k = 0; k != kernal_size; k++){
+                    size_t k_i = k / kernal_col;
+                    size_t k_j = k % kernal_col;
+                    const T* data = &patch_data[(c * kernal_size + k) * conv_size];
+                    for(size_t ti = 0; ti != conv_row; ti++){
+                        size_t row = ti * stride + k_i;
+                        if(row < pad_row || row - pad_row >= rows){
+                            continue;
+                        }
+                        T* dst_row = &dst_data[(row - pad_row) * row_stride];
+                        for(size_t tj = 0; tj != conv_col; tj++){
+                            size_t col = tj * stride + k_j;
+                            if(col >= pad_col && col - pad_col < cols){
+                                dst_row[(col - pad_col) * col_stride] += data[ti * conv_col + tj];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    );
+
     return true;
 }
 
@@ -409,31 +697,20 @@ void MatrixHelper<T>::transpose(Matrix<T>& mat, const Matrix<T>& mat_a){
 	}
 
     T* src_data       = mat_a.data();
-    T* data           = new T[mat_a.get_size()];
+    T* data           = mat.allocate_data(mat_a.get_size());
     size_t num_thread = _po.get_num_thread(mat_a.get_size(), _po.get_block_size(mat_a.get_size()));
-    size_t block_size = cols / num_thread;
-    if(cols % num_thread != 0){
-        block_size += 1;
-    }
-        
-    std::vector<std::thread> threads(num_thread);
-    for(size_t i = 0; i != num_thread; i++){
-        threads[i] = std::thread(
-            [&data, &src_data, rows, cols](size_t start_idx, size_t end_idx){
-				for(size_t ti = start_idx; ti < end_idx; ti++){
-		    		for(size_t tj = 0; tj != rows; tj++){
-                        data[ti * rows + tj] = src_data[tj * cols + ti];
-	    			}
-		    	}
-            }, i * block_size , std::min(cols, (i + 1) * block_size)
-        );
-    }
 
-    for(auto& thread : threads){
-        thread.join();
-    }
+    _po.parallel_range(cols, num_thread,
+        [&data, &src_data, rows, cols](size_t start_idx, size_t end_idx){
+            for(size_t ti = start_idx; ti < end_idx; ti++){
+                for(size_t tj = 0; tj != rows; tj++){
+                    data[ti * rows + tj] = src_data[tj * cols + ti];
+                }
+            }
+        }
+    );
 
-    mat.set_shallow_data(data, cols, rows);
+    mat.set_allocated_data(data, cols, rows);
 }
 
 
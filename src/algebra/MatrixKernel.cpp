@@ -0,0 +1,647 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 13:20
+ * Last modified : 2026-10-17 13:20
+ * Filename      : MatrixKernel.cpp
+ * Description   : elementwise kernels, SSE4.2/AVX2/AVX-512
+ *                 code is picked at runtime by cpuid
+ **********************************************/
+#include "algebra/MatrixKernel.h"
+#include "algebra/MatrixGemm.h"
+#include <string.h>
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+#include <immintrin.h>
+#include "utils/TypeDef.h"
+
+namespace abcdl{
+namespace algebra{
+
+template<class T>
+struct KernelTable{
+    void (*add)(T*, const T*, const T*, const size_t);
+    void (*sub)(T*, const T*, const T*, const size_t);
+    void (*mul)(T*, const T*, const T*, const size_t);
+    void (*div)(T*, const T*, const T*, const size_t);
+    void (*add_scalar)(T*, const T*, const T, const size_t);
+    void (*sub_scalar)(T*, const T*, const T, const size_t);
+    void (*mul_scalar)(T*, const T*, const T, const size_t);
+    void (*div_scalar)(T*, const T*, const T, const size_t);
+    void (*exp)(T*, const T*, const size_t);
+    void (*softmax_exp)(T*, const T*, const T, const size_t);
+    void (*sigmoid)(T*, const T*, const size_t);
+    void (*sigmoid_derivative)(T*, const T*, const size_t);
+    void (*tanh)(T*, const T*, const size_t);
+    void (*tanh_derivative)(T*, const T*, const size_t);
+    void (*relu)(T*, const T*, const size_t);
+    void (*relu_derivative)(T*, const T*, const size_t);
+    void (*leaky_relu)(T*, const T*, const size_t);
+    void (*leaky_relu_derivative)(T*, const T*, const size_t);
+    void (*elu)(T*, const T*, const size_t);
+    void (*elu_derivative)(T*, const T*, const size_t);
+    void (*max_index)(T*, T*, const T*, const T, const size_t);
+    void (*square_add)(T*, const T*, const size_t);
+    void (*gemm_tile)(T*, const T*, const T*, const size_t);
+    Simd_type simd_type;
+};
+
+/*
+ * scalar kernels, same formulas the matrix helpers used before,
+ * they serve non float types and cpus without SSE4.2.
+ */
+namespace scalar{
+
+template<class T>
+void add(T* c, const T* a, const T* b, const size_t size){
+    for(size_t i = 0; i != size; i++){ c[i] = a[i] + b[i]; }
+}
+
+template<class T>
+void sub(T* c, const T* a, const T* b, const size_t size){
+    for(size_t i = 0; i != size; i++){ c[i] = a[i] - b[i]; }
+}
+
+template<class T>
+void mul(T* c, const T* a, const T* b, const size_t size){
+    for(size_t i = 0; i != size; i++){ c[i] = a[i] * b[i]; }
+}
+
+template<class T>
+void div(T* c, const T* a, const T* b, const size_t size){
+    for(size_t i = 0; i != size; i++){ c[i] = a[i] / b[i]; }
+}
+
+template<class T>
+void add_scalar(T* c, const T* a, const T b, const size_t size){
+    for(size_t i = 0; i != size; i++){ c[i] = a[i] + b; }
+}
+
+template<class T>
+void sub_scalar(T* c, const T* a, const T b, const size_t size){
+    for(size_t i = 0; i != size; i++){ c[i] = a[i] - b; }
+}
+
+template<class T>
+void mul_scalar(T* c, const T* a, const T b, const size_t size){
+    for(size_t i = 0; i != size; i++){ c[i] = a[i] * b; }
+}
+
+template<class T>
+void div_scalar(T* c, const T* a, const T b, const size_t size){
+    for(size_t i = 0; i != size; i++){ c[i] = a[i] / b; }
+}
+
+template<class T>
+void exp(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = std::exp(std::min(a[i], (T)EXP_MAX));
+    }
+}
+
+template<class T>
+void softmax_exp(T* c, const T* a, const T max_value, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = std::exp(std::max((a[i] - max_value), (T)SOFTMAX_MIN));
+    }
+}
+
+template<class T>
+void sigmoid(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = 1 / (1 + std::exp(-(std::min((T)SIGMOID_MAX, std::max(a[i], (T)SIGMOID_MIN)))));
+    }
+}
+
+template<class T>
+void sigmoid_derivative(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = a[i] * (1 - a[i]);
+    }
+}
+
+template<class T>
+void tanh(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = 2.0 /(1.0 + std::exp(std::min((T)EXP_MAX, -2 * a[i]))) - 1.0;
+    }
+}
+
+template<class T>
+void tanh_derivative(T* c, const T* a, const size_t size){
+    //a is tanh(z) as for sigmoid_derivative
+    for(size_t i = 0; i != size; i++){
+        c[i] = 1 - a[i] * a[i];
+    }
+}
+
+template<class T>
+void relu(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = a[i] < 0 ? 0 : a[i];
+    }
+}
+
+template<class T>
+void relu_derivative(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = a[i] > 0 ? 1 : 0;
+    }
+}
+
+template<class T>
+void leaky_relu(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = a[i] < 0 ? (T)(0.01 * a[i]) : a[i];
+    }
+}
+
+template<class T>
+void leaky_relu_derivative(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = a[i] >= 0 ? (T)1 : (T)0.01;
+    }
+}
+
+template<class T>
+void elu(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = a[i] >= 0 ? a[i] : (T)(std::exp(std::min((T)EXP_MAX, a[i])) - 1);
+    }
+}
+
+template<class T>
+void elu_derivative(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] = a[i] >= 0 ? (T)1 : (T)std::exp(std::min((T)EXP_MAX, a[i]));
+    }
+}
+
+template<class T>
+void max_index(T* c, T* index, const T* a, const T id, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        if(a[i] > c[i]){
+            c[i] = a[i];
+            index[i] = id;
+        }
+    }
+}
+
+template<class T>
+void square_add(T* c, const T* a, const size_t size){
+    for(size_t i = 0; i != size; i++){
+        c[i] += a[i] * a[i];
+    }
+}
+
+template<class T>
+void gemm_tile(T* ab, const T* a, const T* b, const size_t kc){
+    const size_t MR = GemmBlock<T>::MR;
+    const size_t NR = GemmBlock<T>::NR;
+    //a local tile, ab could alias a and b for the compiler
+    T c[MR * NR];
+    for(size_t i = 0; i != MR * NR; i++){
+        c[i] = 0;
+    }
+    for(size_t p = 0; p != kc; p++){
+        for(size_t i = 0; i != MR; i++){
+            const T a_value = a[i];
+            for(size_t j = 0; j != NR; j++){
+                c[i * NR + j] += a_value * b[j];
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+    memcpy(ab, c, sizeof(T) * MR * NR);
+}
+
+template<class T>
+void fill_table(KernelTable<T>* table){
+    table->add = &add<T>;
+    table->sub = &sub<T>;
+    table->mul = &mul<T>;
+    table->div = &div<T>;
+    table->add_scalar = &add_scalar<T>;
+    table->sub_scalar = &sub_scalar<T>;
+    table->mul_scalar = &mul_scalar<T>;
+    table->div_scalar = &div_scalar<T>;
+    table->exp = &exp<T>;
+    table->softmax_exp = &softmax_exp<T>;
+    table->sigmoid = &sigmoid<T>;
+    table->sigmoid_derivative = &sigmoid_derivative<T>;
+    table->tanh = &tanh<T>;
+    table->tanh_derivative = &tanh_derivative<T>;
+    table->relu = &relu<T>;
+    table->relu_derivative = &relu_derivative<T>;
+    table->leaky_relu = &leaky_relu<T>;
+    table->leaky_relu_derivative = &leaky_relu_derivative<T>;
+    table->elu = &elu<T>;
+    table->elu_derivative = &elu_derivative<T>;
+    table->max_index = &max_index<T>;
+    table->square_add = &square_add<T>;
+    table->gemm_tile = &gemm_tile<T>;
+}
+
+}//namespace scalar
+
+/*
+ * every instruction set gets its own namespace and target pragma,
+ * so none of its code leaks into functions called on older cpus.
+ * vector values only pass between inlined functions of one namespace,
+ * the abi note gcc gives for them does not apply.
+ */
+#pragma GCC diagnostic ignored "-Wpsabi"
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+namespace sse4_2{
+
+struct VecFloat{
+    typedef float scalar;
+    typedef __m128 reg;
+    typedef __m128 mask;
+    static const size_t WIDTH = 4;
+
+    static inline reg zero(){ return _mm_setzero_ps(); }
+    static inline reg set1(const scalar a){ return _mm_set1_ps(a); }
+    static inline reg load(const scalar* a){ return _mm_loadu_ps(a); }
+    static inline void store(scalar* c, reg a){ _mm_storeu_ps(c, a); }
+    static inline reg add(reg a, reg b){ return _mm_add_ps(a, b); }
+    static inline reg sub(reg a, reg b){ return _mm_sub_ps(a, b); }
+    static inline reg mul(reg a, reg b){ return _mm_mul_ps(a, b); }
+    static inline reg div(reg a, reg b){ return _mm_div_ps(a, b); }
+    static inline reg min(reg a, reg b){ return _mm_min_ps(a, b); }
+    static inline reg max(reg a, reg b){ return _mm_max_ps(a, b); }
+    static inline reg fmadd(reg a, reg b, reg c){ return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static inline reg round(reg a){ return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    //2^n for integral n, n + 127 is moved into the exponent bits
+    static inline reg pow2n(reg n){
+        __m128i bits = _mm_castps_si128(_mm_add_ps(n, _mm_set1_ps(8388608.0f + 127.0f)));
+        return _mm_castsi128_ps(_mm_slli_epi32(bits, 23));
+    }
+    static inline mask lt(reg a, reg b){ return _mm_cmplt_ps(a, b); }
+    static inline mask ge(reg a, reg b){ return _mm_cmpge_ps(a, b); }
+    static inline mask gt(reg a, reg b){ return _mm_cmpgt_ps(a, b); }
+    static inline reg select(mask m, reg a, reg b){ return _mm_blendv_ps(b, a, m); }
+};
+
+struct VecDouble{
+    typedef double scalar;
+    typedef __m128d reg;
+    typedef __m128d mask;
+    static const size_t WIDTH = 2;
+
+    static inline reg zero(){ return _mm_setzero_pd(); }
+    static inline reg set1(const scalar a){ return _mm_set1_pd(a); }
+    static inline reg load(const scalar* a){ return _mm_loadu_pd(a); }
+    static inline void store(scalar* c, reg a){ _mm_storeu_pd(c, a); }
+    static inline reg add(reg a, reg b){ return _mm_add_pd(a, b); }
+    static inline reg sub(reg a, reg b){ return _mm_sub_pd(a, b); }
+    static inline reg mul(reg a, reg b){ return _mm_mul_pd(a, b); }
+    static inline reg div(reg a, reg b){ return _mm_div_pd(a, b); }
+    static inline reg min(reg a, reg b){ return _mm_min_pd(a, b); }
+    static inline reg max(reg a, reg b){ return _mm_max_pd(a, b); }
+    static inline reg fmadd(reg a, reg b, reg c){ return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static inline reg round(reg a){ return _mm_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static inline reg pow2n(reg n){
+        __m128i bits = _mm_castpd_si128(_mm_add_pd(n, _mm_set1_pd(4503599627370496.0 + 1023.0)));
+        return _mm_castsi128_pd(_mm_slli_epi64(bits, 52));
+    }
+    static inline mask lt(reg a, reg b){ return _mm_cmplt_pd(a, b); }
+    static inline mask ge(reg a, reg b){ return _mm_cmpge_pd(a, b); }
+    static inline mask gt(reg a, reg b){ return _mm_cmpgt_pd(a, b); }
+    static inline reg select(mask m, reg a, reg b){ return _mm_blendv_pd(b, a, m); }
+};
+
+#include "algebra/MatrixKernelSimd.h"
+
+}//namespace sse4_2
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace avx2{
+
+struct VecFloat{
+    typedef float scalar;
+    typedef __m256 reg;
+    typedef __m256 mask;
+    static const size_t WIDTH = 8;
+
+    static inline reg zero(){ return _mm256_setzero_ps(); }
+    static inline reg set1(const scalar a){ return _mm256_set1_ps(a); }
+    static inline reg load(const scalar* a){ return _mm256_loadu_ps(a); }
+    static inline void store(scalar* c, reg a){ _mm256_storeu_ps(c, a); }
+    static inline reg add(reg a, reg b){ return _mm256_add_ps(a, b); }
+    static inline reg sub(reg a, reg b){ return _mm256_sub_ps(a, b); }
+    static inline reg mul(reg a, reg b){ return _mm256_mul_ps(a, b); }
+    static inline reg div(reg a, reg b){ return _mm256_div_ps(a, b); }
+    static inline reg min(reg a, reg b){ return _mm256_min_ps(a, b); }
+    static inline reg max(reg a, reg b){ return _mm256_max_ps(a, b); }
+    static inline reg fmadd(reg a, reg b, reg c){ return _mm256_fmadd_ps(a, b, c); }
+    static inline reg round(reg a){ return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static inline reg pow2n(reg n){
+        __m256i bits = _mm256_castps_si256(_mm256_add_ps(n, _mm256_set1_ps(8388608.0f + 127.0f)));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(bits, 23));
+    }
+    static inline mask lt(reg a, reg b){ return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline mask ge(reg a, reg b){ return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static inline mask gt(reg a, reg b){ return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline reg select(mask m, reg a, reg b){ return _mm256_blendv_ps(b, a, m); }
+};
+
+struct VecDouble{
+    typedef double scalar;
+    typedef __m256d reg;
+    typedef __m256d mask;
+    static const size_t WIDTH = 4;
+
+    static inline reg zero(){ return _mm256_setzero_pd(); }
+    static inline reg set1(const scalar a){ return _mm256_set1_pd(a); }
+    static inline reg load(const scalar* a){ return _mm256_loadu_pd(a); }
+    static inline void store(scalar* c, reg a){ _mm256_storeu_pd(c, a); }
+    static inline reg add(reg a, reg b){ return _mm256_add_pd(a, b); }
+    static inline reg sub(reg a, reg b){ return _mm256_sub_pd(a, b); }
+    static inline reg mul(reg a, reg b){ return _mm256_mul_pd(a, b); }
+    static inline reg div(reg a, reg b){ return _mm256_div_pd(a, b); }
+    static inline reg min(reg a, reg b){ return _mm256_min_pd(a, b); }
+    static inline reg max(reg a, reg b){ return _mm256_max_pd(a, b); }
+    static inline reg fmadd(reg a, reg b, reg c){ return _mm256_fmadd_pd(a, b, c); }
+    static inline reg round(reg a){ return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static inline reg pow2n(reg n){
+        __m256i bits = _mm256_castpd_si256(_mm256_add_pd(n, _mm256_set1_pd(4503599627370496.0 + 1023.0)));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+    }
+    static inline mask lt(reg a, reg b){ return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static inline mask ge(reg a, reg b){ return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static inline mask gt(reg a, reg b){ return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static inline reg select(mask m, reg a, reg b){ return _mm256_blendv_pd(b, a, m); }
+};
+
+#include "algebra/MatrixKernelSimd.h"
+
+}//namespace avx2
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+//_mm512_undefined_ps() of gcc headers is reported as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+namespace avx512{
+
+struct VecFloat{
+    typedef float scalar;
+    typedef __m512 reg;
+    typedef __mmask16 mask;
+    static const size_t WIDTH = 16;
+
+    static inline reg zero(){ return _mm512_setzero_ps(); }
+    static inline reg set1(const scalar a){ return _mm512_set1_ps(a); }
+    static inline reg load(const scalar* a){ return _mm512_loadu_ps(a); }
+    static inline void store(scalar* c, reg a){ _mm512_storeu_ps(c, a); }
+    static inline reg add(reg a, reg b){ return _mm512_add_ps(a, b); }
+    static inline reg sub(reg a, reg b){ return _mm512_sub_ps(a, b); }
+    static inline reg mul(reg a, reg b){ return _mm512_mul_ps(a, b); }
+    static inline reg div(reg a, reg b){ return _mm512_div_ps(a, b); }
+    static inline reg min(reg a, reg b){ return _mm512_min_ps(a, b); }
+    static inline reg max(reg a, reg b){ return _mm512_max_ps(a, b); }
+    static inline reg fmadd(reg a, reg b, reg c){ return _mm512_fmadd_ps(a, b, c); }
+    static inline reg round(reg a){ return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static inline reg pow2n(reg n){
+        __m512i bits = _mm512_castps_si512(_mm512_add_ps(n, _mm512_set1_ps(8388608.0f + 127.0f)));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(bits, 23));
+    }
+    static inline mask lt(reg a, reg b){ return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static inline mask ge(reg a, reg b){ return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+    static inline mask gt(reg a, reg b){ return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static inline reg select(mask m, reg a, reg b){ return _mm512_mask_blend_ps(m, b, a); }
+};
+
+struct VecDouble{
+    typedef double scalar;
+    typedef __m512d reg;
+    typedef __mmask8 mask;
+    static const size_t WIDTH = 8;
+
+    static inline reg zero(){ return _mm512_setzero_pd(); }
+    static inline reg set1(const scalar a){ return _mm512_set1_pd(a); }
+    static inline reg load(const scalar* a){ return _mm512_loadu_pd(a); }
+    static inline void store(scalar* c, reg a){ _mm512_storeu_pd(c, a); }
+    static inline reg add(reg a, reg b){ return _mm512_add_pd(a, b); }
+    static inline reg sub(reg a, reg b){ return _mm512_sub_pd(a, b); }
+    static inline reg mul(reg a, reg b){ return _mm512_mul_pd(a, b); }
+    static inline reg div(reg a, reg b){ return _mm512_div_pd(a, b); }
+    static inline reg min(reg a, reg b){ return _mm512_min_pd(a, b); }
+    static inline reg max(reg a, reg b){ return _mm512_max_pd(a, b); }
+    static inline reg fmadd(reg a, reg b, reg c){ return _mm512_fmadd_pd(a, b, c); }
+    static inline reg round(reg a){ return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static inline reg pow2n(reg n){
+        __m512i bits = _mm512_castpd_si512(_mm512_add_pd(n, _mm512_set1_pd(4503599627370496.0 + 1023.0)));
+        return _mm512_castsi512_pd(_mm512_slli_epi64(bits, 52));
+    }
+    static inline mask lt(reg a, reg b){ return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static inline mask ge(reg a, reg b){ return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+    static inline mask gt(reg a, reg b){ return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+    static inline reg select(mask m, reg a, reg b){ return _mm512_mask_blend_pd(m, b, a); }
+};
+
+#include "algebra/MatrixKernelSimd.h"
+
+}//namespace avx512
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+static Simd_type detect_simd_type(){
+    Simd_type simd_type = SIMD_NONE;
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")){
+        simd_type = SIMD_AVX512;
+    }else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        simd_type = SIMD_AVX2;
+    }else if(__builtin_cpu_supports("sse4.2")){
+        simd_type = SIMD_SSE4_2;
+    }
+
+    //ABCDL_SIMD only lowers the level, it never enables what the cpu lacks
+    char* env_value = getenv("ABCDL_SIMD");
+    if(env_value != nullptr){
+        Simd_type env_type = simd_type;
+        if(strcmp(env_value, "none") == 0){
+            env_type = SIMD_NONE;
+        }else if(strcmp(env_value, "sse4.2") == 0){
+            env_type = SIMD_SSE4_2;
+        }else if(strcmp(env_value, "avx2") == 0){
+            env_type = SIMD_AVX2;
+        }else if(strcmp(env_value, "avx512") == 0){
+            env_type = SIMD_AVX512;
+        }
+        simd_type = std::min(simd_type, env_type);
+    }
+    return simd_type;
+}
+
+template<class T>
+static void fill_simd_table(KernelTable<T>* table, const Simd_type simd_type){
+    table->simd_type = SIMD_NONE;
+}
+
+static void fill_simd_table(KernelTable<float>* table, const Simd_type simd_type){
+    table->simd_type = simd_type;
+    switch(simd_type){
+        //the lanes of AVX-512 are wider than NR, avx2 keeps the gemm tile
+        case SIMD_AVX512: avx2::fill_table<avx2::VecFloat>(table); avx512::fill_table<avx512::VecFloat>(table); break;
+        case SIMD_AVX2: avx2::fill_table<avx2::VecFloat>(table); break;
+        case SIMD_SSE4_2: sse4_2::fill_table<sse4_2::VecFloat>(table); break;
+        default: break;
+    }
+}
+
+static void fill_simd_table(KernelTable<double>* table, const Simd_type simd_type){
+    table->simd_type = simd_type;
+    switch(simd_type){
+        case SIMD_AVX512: avx2::fill_table<avx2::VecDouble>(table); avx512::fill_table<avx512::VecDouble>(table); break;
+        case SIMD_AVX2: avx2::fill_table<avx2::VecDouble>(table); break;
+        case SIMD_SSE4_2: sse4_2::fill_table<sse4_2::VecDouble>(table); break;
+        default: break;
+    }
+}
+
+template<class T>
+static const KernelTable<T>& get_table(){
+    static const KernelTable<T> table = []{
+        KernelTable<T> t;
+        scalar::fill_table<T>(&t);
+        fill_simd_table(&t, detect_simd_type());
+        return t;
+    }();
+    return table;
+}
+
+template<class T>
+Simd_type MatrixKernel<T>::get_simd_type(){
+    return get_table<T>().simd_type;
+}
+
+template<class T>
+void MatrixKernel<T>::add(T* c, const T* a, const T* b, const size_t size){
+    get_table<T>().add(c, a, b, size);
+}
+
+template<class T>
+void MatrixKernel<T>::sub(T* c, const T* a, const T* b, const size_t size){
+    get_table<T>().sub(c, a, b, size);
+}
+
+template<class T>
+void MatrixKernel<T>::mul(T* c, const T* a, const T* b, const size_t size){
+    get_table<T>().mul(c, a, b, size);
+}
+
+template<class T>
+void MatrixKernel<T>::div(T* c, const T* a, const T* b, const size_t size){
+    get_table<T>().div(c, a, b, size);
+}
+
+template<class T>
+void MatrixKernel<T>::add_scalar(T* c, const T* a, const T b, const size_t size){
+    get_table<T>().add_scalar(c, a, b, size);
+}
+
+template<class T>
+void MatrixKernel<T>::sub_scalar(T* c, const T* a, const T b, const size_t size){
+    get_table<T>().sub_scalar(c, a, b, size);
+}
+
+template<class T>
+void MatrixKernel<T>::mul_scalar(T* c, const T* a, const T b, const size_t size){
+    get_table<T>().mul_scalar(c, a, b, size);
+}
+
+template<class T>
+void MatrixKernel<T>::div_scalar(T* c, const T* a, const T b, const size_t size){
+    get_table<T>().div_scalar(c, a, b, size);
+}
+
+template<class T>
+void MatrixKernel<T>::exp(T* c, const T* a, const size_t size){
+    get_table<T>().exp(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::softmax_exp(T* c, const T* a, const T max_value, const size_t size){
+    get_table<T>().softmax_exp(c, a, max_value, size);
+}
+
+template<class T>
+void MatrixKernel<T>::sigmoid(T* c, const T* a, const size_t size){
+    get_table<T>().sigmoid(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::sigmoid_derivative(T* c, const T* a, const size_t size){
+    get_table<T>().sigmoid_derivative(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::tanh(T* c, const T* a, const size_t size){
+    get_table<T>().tanh(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::tanh_derivative(T* c, const T* a, const size_t size){
+    get_table<T>().tanh_derivative(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::relu(T* c, const T* a, const size_t size){
+    get_table<T>().relu(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::relu_derivative(T* c, const T* a, const size_t size){
+    get_table<T>().relu_derivative(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::leaky_relu(T* c, const T* a, const size_t size){
+    get_table<T>().leaky_relu(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::leaky_relu_derivative(T* c, const T* a, const size_t size){
+    get_table<T>().leaky_relu_derivative(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::elu(T* c, const T* a, const size_t size){
+    get_table<T>().elu(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::elu_derivative(T* c, const T* a, const size_t size){
+    get_table<T>().elu_derivative(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::max_index(T* c, T* index, const T* a, const T id, const size_t size){
+    get_table<T>().max_index(c, index, a, id, size);
+}
+
+template<class T>
+void MatrixKernel<T>::square_add(T* c, const T* a, const size_t size){
+    get_table<T>().square_add(c, a, size);
+}
+
+template<class T>
+void MatrixKernel<T>::gemm_tile(T* ab, const T* a, const T* b, const size_t kc){
+    get_table<T>().gemm_tile(ab, a, b, kc);
+}
+
+template class MatrixKernel<int>;
+template class MatrixKernel<float>;
+template class MatrixKernel<double>;
+template class MatrixKernel<size_t>;
+
+}//namespace algebra
+}//namespace abcdl
@@ -7,11 +7,55 @@
  **********************************************/
 
 #include <string.h>
+#include <algorithm>
 #include "algebra/Matrix.h"
+#include "algebra/MatrixKernel.h"
 
 namespace abcdl{
 namespace algebra{
 
+/*
+ * result = mat_a (op) mat_b, mat_b has the shape of mat_a, or is a row vector
+ * repeated over the rows, or a col vector repeated over the cols.
+ */
+template<class T>
+static void broadcast_kernel(const abcdl::utils::ParallelOperator<T>& po,
+                             T* result_data,
+                             const Matrix<T>& mat_a,
+                             const Matrix<T>& mat_b,
+                             void (*kernel)(T*, const T*, const T*, const size_t),
+                             void (*scalar_kernel)(T*, const T*, const T, const size_t)){
+    size_t rows = mat_a.rows();
+    size_t cols = mat_a.cols();
+    size_t size = rows * cols;
+    const T* data_a = mat_a.data();
+    const T* data_b = mat_b.data();
+
+    if(mat_b.get_size() == size){
+        po.parallel_kernel(result_data, data_a, data_b, size, kernel);
+        return;
+    }
+
+    bool is_row_vector = (mat_b.rows() == 1 && mat_b.cols() == cols);
+    bool is_col_vector = (mat_b.cols() == 1 && mat_b.rows() == rows);
+    if(!is_row_vector && !is_col_vector){
+        return;
+    }
+
+    size_t num_thread = std::min(rows, po.get_num_thread(size, po.get_block_size(size)));
+    po.parallel_range(rows, num_thread,
+        [result_data, data_a, data_b, cols, is_row_vector, kernel, scalar_kernel](size_t start_idx, size_t end_idx){
+            for(size_t i = start_idx; i != end_idx; i++){
+                if(is_row_vector){
+                    kernel(&result_data[i * cols], &data_a[i * cols], data_b, cols);
+                }else{
+                    scalar_kernel(&result_data[i * cols], &data_a[i * cols], data_b[i], cols);
+                }
+            }
+        }
+    );
+}
+
 template<class T>
 T& Matrix<T>::operator [] (const size_t idx) const{
     CHECK(idx < get_size());
@@ -44,12 +88,7 @@ template<class T>
 Matrix<T>& Matrix<T>::operator = (const Matrix<T>& mat){
     if(this != &mat){
         size_t size = mat.get_size();
-        if(get_size() != size){
-            if(_data != nullptr){
-                delete[] _data;
-            }
-        	_data = new T[size];
-        }
+        reserve_data(size);
 
         _rows = mat.rows();
         _cols = mat.cols();
@@ -59,12 +98,40 @@ Matrix<T>& Matrix<T>::operator = (const Matrix<T>& mat){
     return *this;
 }
 
+template<class T>
+Matrix<T>& Matrix<T>::operator = (Matrix<T>&& mat){
+    if(this == &mat){
+        return *this;
+    }
+    /*
+     * a buffer of another allocator is copied, an arena buffer must not
+     * outlive its step inside a matrix bound to the pool.
+     * A view is copied into as well, it keeps referring to its data.
+     */
+    if(!_own_data || (mat._own_data && mat._data_allocator != nullptr && mat._data_allocator != _allocator)){
+        return *this = static_cast<const Matrix<T>&>(mat);
+    }
+    release_data();
+    _rows           = mat._rows;
+    _cols           = mat._cols;
+    _data           = mat._data;
+    _capacity       = mat._capacity;
+    _own_data       = mat._own_data;
+    _data_allocator = mat._data_allocator;
+    mat._rows           = 0;
+    mat._cols           = 0;
+    mat._data           = nullptr;
+    mat._capacity       = 0;
+    mat._own_data       = true;
+    mat._data_allocator = nullptr;
+    return *this;
+}
+
 template<class T>
 Matrix<T> Matrix<T>::operator + (const T& value) const{
     auto new_mat = clone();
     if (value != 0){
-        auto lambda = [](T* a, const T& b){*a += b;};
-        _po.parallel_mul2one(new_mat.data(), new_mat.get_size(), value, lambda);
+        _po.parallel_kernel(new_mat.data(), new_mat.data(), new_mat.get_size(), value, &MatrixKernel<T>::add_scalar);
     }
     return new_mat;
 }
@@ -80,26 +147,14 @@ Matrix<T> Matrix<T>::operator + (const Matrix<T>& mat) const{
           || (_cols == mat.cols() && mat.rows() == 1)
           || (_rows == mat.rows() && mat.cols() == 1));
 
-    Matrix<T> new_mat = clone();
-
-    if(equal_shape(mat) || (_cols == mat.cols() && mat.rows() == 1)){
-        auto lambda = [](T* a, const T& b){*a += b;};
-        _po.parallel_mul2mul_repeat(new_mat.data(), new_mat.get_size(), mat.data(), mat.get_size(), lambda);
-    }else{
-        for(size_t i = 0; i < _rows; i++){
-            T value = mat.get_data(i, 0);
-            for(size_t j = 0; j < _cols; j++){
-                new_mat.set_data(get_data(i, j) + value, i, j);
-            }
-        }
-    }
+    auto new_mat = clone();
+    broadcast_kernel(_po, new_mat.data(), new_mat, mat, &MatrixKernel<T>::add, &MatrixKernel<T>::add_scalar);
     return new_mat;
 }
 
 template<class T>
 Matrix<T>& Matrix<T>::operator += (const T& value){
-    auto lambda = [](T* a, const T& b){*a += b;};
-    _po.parallel_mul2one(_data, get_size(), value, lambda);
+    _po.parallel_kernel(_data, _data, get_size(), value, &MatrixKernel<T>::add_scalar);
     return *this;
 }
 template<class T>
@@ -113,25 +168,14 @@ Matrix<T>& Matrix<T>::operator += (const Matrix<T>& mat){
           || (_cols == mat.cols() && mat.rows() == 1)
           || (_rows == mat.rows() && mat.cols() == 1));
     
-    if(equal_shape(mat) || (_cols == mat.cols() && mat.rows() == 1)){
-        auto lambda = [](T* a, const T& b){*a += b;};
-        _po.parallel_mul2mul_repeat(_data, get_size(), mat.data(), mat.get_size(), lambda);
-    }else{
-        for(size_t i = 0; i < _rows; i++){
-            T value = mat.get_data(i, 0);
-            for(size_t j = 0; j < _cols; j++){
-                set_data(get_data(i, j) + value, i, j);
-            }
-        }
-    }
+    broadcast_kernel(_po, _data, *this, mat, &MatrixKernel<T>::add, &MatrixKernel<T>::add_scalar);
     return *this;
 }
 
 template<class T>
 Matrix<T> Matrix<T>::operator - (const T& value) const{
-    auto lambda = [](T* a, const T& b){*a -= b;};
     auto new_mat = clone();
-    _po.parallel_mul2one(new_mat.data(), new_mat.get_size(), value, lambda);
+    _po.parallel_kernel(new_mat.data(), new_mat.data(), new_mat.get_size(), value, &MatrixKernel<T>::sub_scalar);
     return new_mat;
 }
 
@@ -142,24 +186,13 @@ Matrix<T> Matrix<T>::operator - (const Matrix<T>& mat) const{
           || (_rows == mat.rows() && mat.cols() == 1));
     
     auto new_mat = clone();
-    if(equal_shape(mat) || (_cols == mat.cols() && mat.rows() == 1)){
-        auto lambda = [](T* a, const T& b){*a -= b;};
-        _po.parallel_mul2mul_repeat(new_mat.data(), new_mat.get_size(), mat.data(), mat.get_size(), lambda);
-    }else{
-        for(size_t i = 0; i < _rows; i++){
-            T value = mat.get_data(i, 0);
-            for(size_t j = 0; j < _cols; j++){
-                new_mat.set_data(get_data(i, j) - value, i, j);
-            }
-        }
-    }
+    broadcast_kernel(_po, new_mat.data(), new_mat, mat, &MatrixKernel<T>::sub, &MatrixKernel<T>::sub_scalar);
     return new_mat;
 }
 
 template<class T>
 Matrix<T>& Matrix<T>::operator -= (const T& value){
-    auto lambda = [](T* a, const T& b){*a -= b;};
-    _po.parallel_mul2one(_data, get_size(), value, lambda);    
+    _po.parallel_kernel(_data, _data, get_size(), value, &MatrixKernel<T>::sub_scalar);
 	return *this;
 }
 
@@ -169,25 +202,14 @@ Matrix<T>& Matrix<T>::operator -= (const Matrix<T>& mat){
           || (_cols == mat.cols() && mat.rows() == 1)
           || (_rows == mat.rows() && mat.cols() == 1));
     
-    if(equal_shape(mat) || (_cols == mat.cols() && mat.rows() == 1)){
-        auto lambda = [](T* a, const T& b){*a -= b;};
-        _po.parallel_mul2mul_repeat(_data, get_size(), mat.data(), mat.get_size(), lambda);
-    }else{
-        for(size_t i = 0; i < _rows; i++){
-            T value = mat.get_data(i, 0);
-            for(size_t j = 0; j < _cols; j++){
-                set_data(get_data(i, j) - value, i, j);
-            }
-        }
-    }
+    broadcast_kernel(_po, _data, *this, mat, &MatrixKernel<T>::sub, &MatrixKernel<T>::sub_scalar);
     return *this;
 }
 
 template<class T>
 Matrix<T> Matrix<T>::operator * (const T& value) const{
-    auto lambda = [](T* a, const T& b){*a *= b;};
     auto new_mat = clone();
-    _po.parallel_mul2one(new_mat.data(), new_mat.get_size(), value, lambda);
+    _po.parallel_kernel(new_mat.data(), new_mat.data(), new_mat.get_size(), value, &MatrixKernel<T>::mul_scalar);
     return new_mat;
 }
 
@@ -198,24 +220,13 @@ Matrix<T> Matrix<T>::operator * (const Matrix<T>& mat) const{
           || (_rows == mat.rows() && mat.cols() == 1));
     
     auto new_mat = clone();
-    if(equal_shape(mat) || (_cols == mat.cols() && mat.rows() == 1)){
-        auto lambda = [](T* a, const T& b){*a *= b;};
-        _po.parallel_mul2mul_repeat(new_mat.data(), new_mat.get_size(), mat.data(), mat.get_size(), lambda);
-    }else{
-        for(size_t i = 0; i < _rows; i++){
-            T value = mat.get_data(i, 0);
-            for(size_t j = 0; j < _cols; j++){
-                new_mat.set_data(get_data(i, j) * value, i, j);
-            }
-        }
-    }
+    broadcast_kernel(_po, new_mat.data(), new_mat, mat, &MatrixKernel<T>::mul, &MatrixKernel<T>::mul_scalar);
     return new_mat;
 }
 
 template<class T>
 Matrix<T>& Matrix<T>::operator *= (const T& value){
-    auto lambda = [](T* a, const T& b){*a *= b;};
-    _po.parallel_mul2one(_data, get_size(), value, lambda);
+    _po.parallel_kernel(_data, _data, get_size(), value, &MatrixKernel<T>::mul_scalar);
 	return *this;
 }
 
@@ -225,26 +236,15 @@ Matrix<T>& Matrix<T>::operator *= (const Matrix<T>& mat){
           || (_cols == mat.cols() && mat.rows() == 1)
           || (_rows == mat.rows() && mat.cols() == 1));
     
-    if(equal_shape(mat) || (_cols == mat.cols() && mat.rows() == 1)){
-        auto lambda = [](T* a, const T& b){*a *= b;};
-        _po.parallel_mul2mul_repeat(_data, get_size(), mat.data(), mat.get_size(), lambda);
-    }else{
-        for(size_t i = 0; i < _rows; i++){
-            T value = mat.get_data(i, 0);
-            for(size_t j = 0; j < _cols; j++){
-                set_data(get_data(i, j) * value, i, j);
-            }
-        }
-    }
+    broadcast_kernel(_po, _data, *this, mat, &MatrixKernel<T>::mul, &MatrixKernel<T>::mul_scalar);
     return *this;
 }
 
 template<class T>
 Matrix<T> Matrix<T>::operator / (const T& value) const{
 	CHECK(value != 0);
-    auto lambda = [](T* a, const T& b){*a /= b;};
     auto new_mat = clone();
-    _po.parallel_mul2one(new_mat.data(), new_mat.get_size(), value, lambda);
+    _po.parallel_kernel(new_mat.data(), new_mat.data(), new_mat.get_size(), value, &MatrixKernel<T>::div_scalar);
     return new_mat;
 }
 
@@ -255,26 +255,14 @@ Matrix<T> Matrix<T>::operator / (const Matrix<T>& mat) const{
           || (_rows == mat.rows() && mat.cols() == 1));
     
     auto new_mat = clone();
-    if(equal_shape(mat) || (_cols == mat.cols() && mat.rows() == 1)){
-        auto lambda = [](T* a, const T& b){ CHECK(b != 0); *a /= b;};
-        _po.parallel_mul2mul_repeat(new_mat.data(), new_mat.get_size(), mat.data(), mat.get_size(), lambda);
-    }else{
-        for(size_t i = 0; i < _rows; i++){
-            T value = mat.get_data(i, 0);
-            CHECK(value != 0);
-            for(size_t j = 0; j < _cols; j++){
-                new_mat.set_data(get_data(i, j) / value, i, j);
-            }
-        }
-    }
+    broadcast_kernel(_po, new_mat.data(), new_mat, mat, &MatrixKernel<T>::div, &MatrixKernel<T>::div_scalar);
     return new_mat;
 }
 
 template<class T>
 Matrix<T>& Matrix<T>::operator /= (const T& value){
 	CHECK(value != 0);
-    auto lambda = [](T* a, const T& b){*a /= b;};
-    _po.parallel_mul2one(_data, get_size(), value, lambda);
+    _po.parallel_kernel(_data, _data, get_size(), value, &MatrixKernel<T>::div_scalar);
 	return *this;
 }
 
@@ -284,18 +272,7 @@ Matrix<T>& Matrix<T>::operator /= (const Matrix<T>& mat){
           || (_cols == mat.cols() && mat.rows() == 1)
           || (_rows == mat.rows() && mat.cols() == 1));
     
-    if(equal_shape(mat) || (_cols == mat.cols() && mat.rows() == 1)){
-        auto lambda = [](T* a, const T& b){ CHECK(b != 0); *a /= b;};
-        _po.parallel_mul2mul_repeat(_data, get_size(), mat.data(), mat.get_size(), lambda);
-    }else{
-        for(size_t i = 0; i < _rows; i++){
-            T value = mat.get_data(i, 0);
-            CHECK(value != 0);
-            for(size_t j = 0; j < _cols; j++){
-                set_data(get_data(i, j) / value, i, j);
-            }
-        }
-    }
+    broadcast_kernel(_po, _data, *this, mat, &MatrixKernel<T>::div, &MatrixKernel<T>::div_scalar);
     return *this;
 }
 
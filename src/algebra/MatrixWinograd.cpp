@@ -0,0 +1,208 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 17:55
+ * Last modified : 2026-10-17 17:55
+ * Filename      : MatrixWinograd.cpp
+ * Description   : winograd convolution of 3 x 3 kernals
+ **********************************************/
+#include "algebra/MatrixWinograd.h"
+#include <string.h>
+#include <algorithm>
+#include <type_traits>
+
+namespace abcdl{
+namespace algebra{
+
+/*
+ * 1-D transforms of F(M, 3), x is read at stride xs, y written at stride ys.
+ *   kernal: u = G * g
+ *   input:  v = B.T * d
+ *   output: y = A.T * m
+ */
+template<size_t M>
+struct WinogradTransform;
+
+template<>
+struct WinogradTransform<2>{
+    static const size_t TILE = 4;
+
+    template<class T>
+    static inline void kernal(const T* g, const size_t gs, T* u, const size_t us){
+        T g0 = g[0], g1 = g[gs], g2 = g[2 * gs];
+        u[0]      = g0;
+        u[us]     = (g0 + g1 + g2) / 2;
+        u[2 * us] = (g0 - g1 + g2) / 2;
+        u[3 * us] = g2;
+    }
+    template<class T>
+    static inline void input(const T* d, const size_t ds, T* v, const size_t vs){
+        T d0 = d[0], d1 = d[ds], d2 = d[2 * ds], d3 = d[3 * ds];
+        v[0]      = d0 - d2;
+        v[vs]     = d1 + d2;
+        v[2 * vs] = d2 - d1;
+        v[3 * vs] = d1 - d3;
+    }
+    template<class T>
+    static inline void output(const T* m, const size_t ms, T* y, const size_t ys){
+        T m0 = m[0], m1 = m[ms], m2 = m[2 * ms], m3 = m[3 * ms];
+        y[0]  = m0 + m1 + m2;
+        y[ys] = m1 - m2 - m3;
+    }
+};
+
+template<>
+struct WinogradTransform<4>{
+    static const size_t TILE = 6;
+
+    template<class T>
+    static inline void kernal(const T* g, const size_t gs, T* u, const size_t us){
+        T g0 = g[0], g1 = g[gs], g2 = g[2 * gs];
+        u[0]      = g0 / 4;
+        u[us]     = -(g0 + g1 + g2) / 6;
+        u[2 * us] = -(g0 - g1 + g2) / 6;
+        u[3 * us] = g0 / 24 + g1 / 12 + g2 / 6;
+        u[4 * us] = g0 / 24 - g1 / 12 + g2 / 6;
+        u[5 * us] = g2;
+    }
+    template<class T>
+    static inline void input(const T* d, const size_t ds, T* v, const size_t vs){
+        T d0 = d[0], d1 = d[ds], d2 = d[2 * ds], d3 = d[3 * ds], d4 = d[4 * ds], d5 = d[5 * ds];
+        v[0]      = 4 * d0 - 5 * d2 + d4;
+        v[vs]     = d3 + d4 - 4 * (d1 + d2);
+        v[2 * vs] = d4 - d3 + 4 * (d1 - d2);
+        v[3 * vs] = d4 - d2 + 2 * (d3 - d1);
+        v[4 * vs] = d4 - d2 + 2 * (d1 - d3);
+        v[5 * vs] = 4 * d1 - 5 * d3 + d5;
+    }
+    template<class T>
+    static inline void output(const T* m, const size_t ms, T* y, const size_t ys){
+        T m0 = m[0], m1 = m[ms], m2 = m[2 * ms], m3 = m[3 * ms], m4 = m[4 * ms], m5 = m[5 * ms];
+        T a = m1 + m2, b = m1 - m2, c = m3 + m4, e = m3 - m4;
+        y[0]      = m0 + a + c;
+        y[ys]     = b + 2 * e;
+        y[2 * ys] = a + 4 * c;
+        y[3 * ys] = b + 8 * e + m5;
+    }
+};
+
+template<class T>
+bool MatrixWinograd<T>::is_supported(const size_t kernal_row,
+                                     const size_t kernal_col,
+                                     const size_t stride){
+    return std::is_floating_point<T>::value && kernal_row == 3 && kernal_col == 3 && stride == 1;
+}
+
+template<class T>
+void MatrixWinograd<T>::convn(T* result,
+                              const size_t conv_row,
+                              const size_t conv_col,
+                              const T* data,
+                              const size_t rows,
+                              const size_t cols,
+                              const T* kernal,
+                              const size_t pad_row,
+                              const size_t pad_col) const{
+    if(conv_row >= 4 && conv_col >= 4){
+        convn_tile<4>(result, conv_row, conv_col, data, rows, cols, kernal, pad_row, pad_col);
+    }else{
+        convn_tile<2>(result, conv_row, conv_col, data, rows, cols, kernal, pad_row, pad_col);
+    }
+}
+
+template<class T>
+template<size_t M>
+void MatrixWinograd<T>::convn_tile(T* result,
+                                   const size_t conv_row,
+                                   const size_t conv_col,
+                                   const T* data,
+                                   const size_t rows,
+                                   const size_t cols,
+                                   const T* kernal,
+                                   const size_t pad_row,
+                                   const size_t pad_col) const{
+    typedef WinogradTransform<M> Transform;
+    const size_t tile = Transform::TILE;
+
+    size_t tile_row = (conv_row + M - 1) / M;
+    size_t tile_col = (conv_col + M - 1) / M;
+
+    //U = G * g * G.T, shared by every tile
+    T u[tile * tile];
+    T tmp[tile * tile];
+    for(size_t j = 0; j != 3; j++){
+        Transform::kernal(&kernal[j], 3, &tmp[j], 3);
+    }
+    for(size_t i = 0; i != tile; i++){
+        Transform::kernal(&tmp[i * 3], 1, &u[i * tile], 1);
+    }
+
+    size_t size = conv_row * conv_col * 9;
+    size_t num_thread = std::min(tile_row, _po.get_num_thread(size, _po.get_block_size(size)));
+
+    _po.parallel_range(tile_row, num_thread,
+        [&](size_t start_idx, size_t end_idx){
+            T d[tile * tile];
+            T t[tile * tile];
+            T v[tile * tile];
+            T y[M * M];
+            for(size_t ti = start_idx; ti < end_idx; ti++){
+                size_t row = ti * M;
+                size_t out_row = std::min(M, conv_row - row);
+                //data rows [first_row, last_row) of the tile, padding and out of range read 0
+                size_t first_row = std::max(row, pad_row);
+                size_t last_row  = std::max(first_row, std::min(row + tile, rows + pad_row));
+                for(size_t tj = 0; tj != tile_col; tj++){
+                    size_t col = tj * M;
+                    size_t out_col = std::min(M, conv_col - col);
+                    size_t first_col = std::max(col, pad_col);
+                    size_t last_col  = std::max(first_col, std::min(col + tile, cols + pad_col));
+
+                    //input tile
+                    if(last_row - first_row != tile || last_col - first_col != tile){
+                        memset(d, 0, sizeof(T) * tile * tile);
+                    }
+                    if(last_col != first_col){
+                        for(size_t i = first_row; i < last_row; i++){
+                            memcpy(&d[(i - row) * tile + first_col - col],
+                                   &data[(i - pad_row) * cols + first_col - pad_col],
+                                   sizeof(T) * (last_col - first_col));
+                        }
+                    }
+
+                    //V = B.T * d * B
+                    for(size_t j = 0; j != tile; j++){
+                        Transform::input(&d[j], tile, &t[j], tile);
+                    }
+                    for(size_t i = 0; i != tile; i++){
+                        Transform::input(&t[i * tile], 1, &v[i * tile], 1);
+                    }
+
+                    //the only multiplies of the tile
+                    for(size_t i = 0; i != tile * tile; i++){
+                        v[i] *= u[i];
+                    }
+
+                    //Y = A.T * (U .* V) * A
+                    for(size_t j = 0; j != tile; j++){
+                        Transform::output(&v[j], tile, &t[j], tile);
+                    }
+                    for(size_t i = 0; i != M; i++){
+                        Transform::output(&t[i * tile], 1, &y[i * M], 1);
+                    }
+
+                    for(size_t i = 0; i != out_row; i++){
+                        memcpy(&result[(row + i) * conv_col + col], &y[i * M], sizeof(T) * out_col);
+                    }
+                }
+            }
+        }
+    );
+}
+
+template class MatrixWinograd<int>;
+template class MatrixWinograd<float>;
+template class MatrixWinograd<double>;
+template class MatrixWinograd<size_t>;
+
+}//namespace algebra
+}//namespace abcdl
@@ -55,12 +55,17 @@ void CNN::train(const abcdl::algebra::MatSet& train_data,
         shuffler.shuffle();
 
         for(size_t j = 0; j != num_train_data; j++){
-            forward(train_data[shuffler.get(j)]);
-            backward(train_label[shuffler.get(j)]);
-
-            if(j % _batch_size  == _batch_size - 1 || j == num_train_data - 1){
-                update_gradient(j % _batch_size + 1, _alpha);
+            {
+                //temporaries of the step come from _arena
+                abcdl::algebra::AllocatorScope scope(&_arena);
+                forward(train_data[shuffler.get(j)]);
+                backward(train_label[shuffler.get(j)]);
+
+                if(j % _batch_size  == _batch_size - 1 || j == num_train_data - 1){
+                    update_gradient(j % _batch_size + 1, _alpha);
+                }
             }
+            _arena.reset();
 
             if(j % 100 == 0){
                 printf("Epoch[%ld][%ld/%ld]training...\r", i, j, num_train_data);
@@ -20,41 +20,23 @@ void SubSamplingLayer::initialize(Layer* pre_layer){
     //can't change out_channel_size.
     this->_in_channel_size = this->_out_channel_size = pre_layer->get_out_channel_size();
 
-    this->_deltas.reserve(this->_out_channel_size);
-    for(size_t i = 0; i != this->_out_channel_size; i++){
-        this->_deltas.push_back(new abcdl::algebra::Mat());
-        this->_activations.push_back(new abcdl::algebra::Mat());
-    }
+    this->_deltas.resize(1, this->_out_channel_size, this->_rows, this->_cols);
+    this->_activations.resize(1, this->_out_channel_size, this->_rows, this->_cols);
 }
 void SubSamplingLayer::forward(Layer* pre_layer){
-	abcdl::algebra::Mat activation;
-    for(size_t i = 0; i != this->_out_channel_size; i++){
-        _pooling->pool(activation, pre_layer->get_activation(i), this->_rows, this->_cols, this->_scale);
-        this->set_activation(i, activation);
-    }
+    //all channels at once, max pooling keeps the position of every max for backward
+    _pooling->pool(this->_activations, pre_layer->get_activations(), this->_scale);
 }
 void SubSamplingLayer::backward(Layer* pre_layer, Layer* back_layer){
     if(back_layer->get_layer_type() == abcdl::framework::OUTPUT){
-        size_t size = this->_rows * this->_cols;
-        real*  data = back_layer->get_delta(0).data();
-        abcdl::algebra::Mat delta(this->_rows, this->_cols);
-        
-        //recover multiply mat
-        for(size_t i = 0; i != this->_out_channel_size; i++){
-            memcpy(delta.data(), &data[i * size], sizeof(real) * size);
-            this->set_delta(i, delta);
-        }
+        //delta of output layer is all channels concatenated, the same layout as _deltas
+        CHECK(back_layer->get_delta(0).get_size() == this->_deltas.get_size());
+        memcpy(this->_deltas.data(), back_layer->get_delta(0).data(), sizeof(real) * this->_deltas.get_size());
     }else if(back_layer->get_layer_type() == abcdl::framework::CONVOLUTION){
-        size_t stride = ((ConvolutionLayer*)back_layer)->get_stride();
-        for(size_t i = 0 ; i != this->_out_channel_size; i++){
-            abcdl::algebra::Mat delta;
-            abcdl::algebra::Mat sub_delta;
-            for(size_t j = 0; j != back_layer->get_out_channel_size(); j++){
-                _helper.convn(sub_delta, back_layer->get_delta(j), back_layer->get_weight(i, j), stride, abcdl::algebra::FULL);
-                delta += sub_delta;
-            }
-            this->set_delta(i, delta);
-        }
+        //error of convolution layer through its kernals, already in the layout of _deltas
+        abcdl::algebra::Tensor<real>& pre_deltas = ((ConvolutionLayer*)back_layer)->get_pre_deltas();
+        CHECK(pre_deltas.get_size() == this->_deltas.get_size());
+        memcpy(this->_deltas.data(), pre_deltas.data(), sizeof(real) * this->_deltas.get_size());
     }
 }
 
@@ -62,120 +44,119 @@ void ConvolutionLayer::initialize(Layer* pre_layer){
     size_t pre_rows = pre_layer->get_rows();
     size_t pre_cols = pre_layer->get_cols();
 
-    CHECK(pre_rows > _kernal_size && pre_cols > _kernal_size);
-
-    this->_rows = (pre_rows - _kernal_size) % _stride == 0 ? (pre_rows - _kernal_size) / _stride + 1 : (pre_rows - _kernal_size) / _stride + 2;
-    this->_cols = (pre_cols - _kernal_size) % _stride == 0 ? (pre_cols - _kernal_size) / _stride + 1 : (pre_cols - _kernal_size) / _stride + 2;
+    //SAME keeps the size of pre_layer at stride 1, so convolution layers can be stacked deeply
+    size_t padding;
+    CHECK(abcdl::algebra::MatrixHelper<real>::conv_dim(pre_rows, _kernal_size, _stride, _padding_type, &this->_rows, &padding) &&
+          abcdl::algebra::MatrixHelper<real>::conv_dim(pre_cols, _kernal_size, _stride, _padding_type, &this->_cols, &padding));
 
     this->_in_channel_size = pre_layer->get_out_channel_size();
 
-    size_t size = this->_in_channel_size * this->_out_channel_size;
-    this->_batch_weights.reserve(size);
-    this->_delta_weights.reserve(size);
-	this->_weights.reserve(size);
-	for(size_t i = 0; i != size; i++){
-        this->_weights.push_back(new abcdl::algebra::RandomMatrix<real>(_kernal_size, _kernal_size, 0.0, 0.5));
-        this->_batch_weights.push_back(new abcdl::algebra::Mat(_kernal_size, _kernal_size));
-        this->_delta_weights.push_back(new abcdl::algebra::Mat(_kernal_size, _kernal_size));
-	}
+    //row i of the weight matrix holds the kernals of all channels of pre_layer for channel i
+    this->initialize_weights(_kernal_size, _kernal_size);
 
     //all channels shared the same bias of current layer.
 	this->_bias->reset(0, this->_out_channel_size, 1);
 	this->_delta_bias->reset(0, this->_out_channel_size, 1);
 	this->_batch_bias->reset(0, this->_out_channel_size, 1);
     
-    for(size_t i = 0; i != this->_out_channel_size; i++){
-        this->_deltas.push_back(new abcdl::algebra::Mat());
-        this->_activations.push_back(new abcdl::algebra::Mat());
+    this->_deltas.resize(1, this->_out_channel_size, this->_rows, this->_cols);
+    this->_activations.resize(1, this->_out_channel_size, this->_rows, this->_cols);
+    if(pre_layer->get_layer_type() != abcdl::framework::INPUT){
+        _pre_deltas.resize(1, this->_in_channel_size, pre_rows, pre_cols);
     }
 }
 
 void ConvolutionLayer::forward(Layer* pre_layer){
+    size_t kernal_size = this->_in_channel_size * _kernal_size * _kernal_size;
+    size_t size = this->_rows * this->_cols;
+
+    //lower all channels of pre_layer into one patch matrix
+    _helper.im2col(_patches, pre_layer->get_activations(), 0, _kernal_size, _kernal_size, _stride, _padding_type);
+
+    //all channels of current layer by a single gemm, summed over channels of pre_layer
+    abcdl::algebra::Mat& activations = this->_activations.get_matrix();
+    _helper.dot(activations,
+                abcdl::algebra::MatrixView<real>(this->_weights.data(), this->_out_channel_size, kernal_size, kernal_size),
+                abcdl::algebra::MatrixView<real>(_patches));
+
+    //add shared bias of channel in current layer.
     for(size_t i = 0; i != this->_out_channel_size; i++){
-        abcdl::algebra::Mat activation;
-        abcdl::algebra::Mat pre_activation;
-        for(size_t j = 0; j != pre_layer->get_out_channel_size(); j++){
-            pre_activation = pre_layer->get_activation(j);
-            pre_activation.convn(this->get_weight(j, i), _stride, abcdl::algebra::VALID);
-            activation += pre_activation;//sum all channels of pre_layer
+        real bias  = this->_bias->get_data(i, 0);
+        real* data = &activations.data()[i * size];
+        for(size_t j = 0; j != size; j++){
+            data[j] += bias;
         }
-        //add shared bias of channel in current layer.
-        activation += this->_bias->get_data(i, 0);
-
-        _activate_func->activate(activation, activation);
-        this->set_activation(i, activation);
     }
+
+    _activate_func->activate(activations, activations);
 }
 
 void ConvolutionLayer::backward(Layer* pre_layer, Layer* back_layer){
     if(back_layer->get_layer_type() == abcdl::framework::OUTPUT){
-        size_t size = this->_rows * this->_cols;
-        real*  data = back_layer->get_delta(0).data();
-        abcdl::algebra::Mat delta(this->_rows, this->_cols);
-        
-        //recover multiply mat
-        for(size_t i = 0; i != this->_out_channel_size; i++){
-            memcpy(delta.data(), &data[i * size], sizeof(real) * size);
-            this->set_delta(i, delta);
-        }
+        //delta of output layer is all channels concatenated, the same layout as _deltas
+        CHECK(back_layer->get_delta(0).get_size() == this->_deltas.get_size());
+        memcpy(this->_deltas.data(), back_layer->get_delta(0).data(), sizeof(real) * this->_deltas.get_size());
     }else if(back_layer->get_layer_type() == abcdl::framework::SUBSAMPLING){
         SubSamplingLayer* sub_layer = (SubSamplingLayer*)back_layer;
-        size_t scale = sub_layer->get_scale();
-        abcdl::algebra::Mat delta;
-        abcdl::algebra::Mat back_delta;
-        for(size_t i = 0; i != this->_out_channel_size; i++){
-            _activate_func->derivative(delta, this->get_activation(i));
-            back_delta = back_layer->get_delta(i);
-            //subsampling layer reduced matrix dim, so recover it by expand function
-            back_delta.expand(scale, scale);
-            //back layer error sharing
-            back_delta /= scale * scale;
-            //delta_l = derivative_sigmoid * delta_l+1(recover dim)
-            delta *= back_delta;
-
-            this->set_delta(i, delta);
-	    }
+        //pooling routes the error of subsampling layer back to the values it pooled
+        sub_layer->get_pooling()->backward(this->_deltas,
+                                           sub_layer->get_deltas(),
+                                           this->_activations,
+                                           sub_layer->get_activations(),
+                                           sub_layer->get_scale());
+
+        //delta_l = derivative * delta_l+1(recover dim)
+        abcdl::algebra::Mat derivative;
+        _activate_func->derivative(derivative, this->_activations.get_matrix());
+        this->_deltas.get_matrix() *= derivative;
+    }else if(back_layer->get_layer_type() == abcdl::framework::CONVOLUTION){
+        //delta_l = derivative * error of the back convolution layer
+        abcdl::algebra::Tensor<real>& pre_deltas = ((ConvolutionLayer*)back_layer)->get_pre_deltas();
+        CHECK(pre_deltas.get_size() == this->_deltas.get_size());
+        _activate_func->derivative(this->_deltas.get_matrix(), this->_activations.get_matrix());
+        this->_deltas.get_matrix() *= pre_deltas.get_matrix();
     }
 
     for(size_t i = 0; i != this->_out_channel_size; i++){
-        abcdl::algebra::Mat weight;
-        for(size_t j = 0; j != pre_layer->get_out_channel_size(); j++){
-            _helper.convn(weight, pre_layer->get_activation(j), this->get_delta(i), _stride, abcdl::algebra::VALID);
-            this->set_delta_weight(j, i, weight);
-            this->set_batch_weight(j, i, weight);
-        }
-
         this->_delta_bias->set_data(this->get_delta(i).sum(), i, 0);
     }
     this->_batch_bias->operator+=(*this->_delta_bias);
+
+    //gradient of all kernals by a single gemm: deltas * patches.T,
+    //patches of forward still hold the activations of pre_layer.
+    size_t kernal_size = this->_in_channel_size * _kernal_size * _kernal_size;
+    abcdl::algebra::Mat delta_weights;
+    delta_weights.set_view_data(this->_delta_weights.data(), this->_out_channel_size, kernal_size);
+    _helper.dot(delta_weights,
+                abcdl::algebra::MatrixView<real>(this->_deltas.get_matrix()),
+                abcdl::algebra::MatrixView<real>(_patches).transpose());
+    this->_batch_weights.get_matrix() += this->_delta_weights.get_matrix();
+
+    //error of pre_layer: weights.T * deltas scattered back to the positions of patches
+    if(pre_layer->get_layer_type() != abcdl::framework::INPUT){
+        _helper.dot(_patches,
+                    abcdl::algebra::MatrixView<real>(this->_weights.data(), this->_out_channel_size, kernal_size, kernal_size).transpose(),
+                    abcdl::algebra::MatrixView<real>(this->_deltas.get_matrix()));
+        _helper.col2im(_pre_deltas, 0, _patches, _kernal_size, _kernal_size, _stride, _padding_type);
+    }
 }
 
 void OutputLayer::initialize(Layer* pre_layer){
     this->_cols = pre_layer->get_rows() * pre_layer->get_cols() * pre_layer->get_out_channel_size();
-    this->_in_channel_size = pre_layer->get_out_channel_size();
+    this->_in_channel_size = 1;
 
-    this->_weights.push_back(new abcdl::algebra::RandomMatrix<real>(this->_rows, this->_cols, 0.0, 0.5));
-    this->_bias = new abcdl::algebra::Mat(0.0, _rows, 1);
-    this->_activations.push_back(new abcdl::algebra::Mat());
-    this->_deltas.push_back(new abcdl::algebra::Mat());
+    this->initialize_weights(this->_rows, this->_cols);
+    this->_bias->reset(0.0, _rows, 1);
+    this->_delta_bias->reset(0.0, _rows, 1);
+    this->_batch_bias->reset(0.0, _rows, 1);
 
-    this->_delta_weights.push_back(new abcdl::algebra::Mat(this->_rows, this->_cols));
-    this->_delta_bias = new abcdl::algebra::Mat(0.0, _rows, 1);
-    this->_batch_weights.push_back(new abcdl::algebra::Mat(this->_rows, this->_cols));
-    this->_batch_bias = new abcdl::algebra::Mat(0.0, _rows, 1);
+    this->_activations.resize(1, 1, this->_rows, 1);
+    this->_deltas.resize(1, 1, this->_cols, 1);
 }
 void OutputLayer::forward(Layer* pre_layer){
-    //concatenate pre_layer's all channel mat into array
-	size_t size = pre_layer->get_rows() * pre_layer->get_cols() * this->_in_channel_size;
-    real* data = new real[size];
-    size_t idx = 0;
-    for(size_t i = 0; i != this->_in_channel_size; i++){
-        size_t activation_size = pre_layer->get_activation(i).get_size();
-        memcpy(&data[idx], pre_layer->get_activation(i).data(), sizeof(real) * activation_size);
-        idx += activation_size;
-    }
-
-    _pre_activation_array.set_shallow_data(data, size, 1);
+    //all channels of pre_layer are one continuous array, nothing is copied
+    abcdl::algebra::Tensor<real>& pre_activations = pre_layer->get_activations();
+    _pre_activation_array.set_view_data(pre_activations.data(), pre_activations.get_size(), 1);
 
     auto activation = _helper.dot(this->get_weight(0, 0), _pre_activation_array) + (*this->_bias);
     _activate_func->activate(activation, activation);
@@ -194,7 +175,9 @@ void OutputLayer::backward(Layer* pre_layer, Layer* back_layer){
     derivative_output *= error;
 
     //calc delta: weight.T * derivate_output
-    this->set_delta(0, _helper.dot(this->get_weight(0, 0).Ts(), derivative_output));
+    _helper.dot(this->get_delta(0),
+                abcdl::algebra::MatrixView<real>(this->get_weight(0, 0)).transpose(),
+                abcdl::algebra::MatrixView<real>(derivative_output));
 
     //if pre_layer is ConvolutionLayer, has sigmoid function
     if(pre_layer->get_layer_type() == abcdl::framework::CONVOLUTION){
@@ -205,8 +188,9 @@ void OutputLayer::backward(Layer* pre_layer, Layer* back_layer){
 
     //derivate_weight = derivate_output * _pre_activation_array.T
     //derivate_bias = derivate_output
-    auto delta_weight = _helper.dot(derivative_output, _pre_activation_array.Ts());
-    this->set_delta_weight(0, 0, delta_weight);
+    _helper.dot(this->get_delta_weight(0, 0),
+                abcdl::algebra::MatrixView<real>(derivative_output),
+                abcdl::algebra::MatrixView<real>(_pre_activation_array).transpose());
     (*this->_delta_bias) = derivative_output;
 
     this->set_batch_weight(0, 0, this->get_delta_weight(0, 0)); 
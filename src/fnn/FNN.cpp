@@ -34,38 +34,59 @@ void FNN::train(const abcdl::algebra::Mat& train_data,
     real total_loss = 0;
     std::vector<std::pair<real, real>> auc_train_vec;
 
+    CHECK(_batch_size > 0);
+    std::vector<size_t> batch_ids;
+    abcdl::algebra::Matrix<size_t> label_idx;
+    abcdl::algebra::Matrix<size_t> predict_idx;
+
+    /*
+     * every step runs a whole batch_size x input_dim matrix through the layers,
+     * the weights are updated once per batch after all layers went backward.
+     * Temporaries of a step come from _arena, it's rewound when the step is done.
+     */
     shuffler.shuffle();
-    for(size_t j = 0; j != num_train_data; j++){
-        train_data.get_row(&data, shuffler.get(j));
-        train_label.get_row(&label, shuffler.get(j));
-
-        for(size_t k = 0; k != layer_size; k++){
-            if(k == 0){
-                ((InputLayer*)_layers[k])->set_x(data);
-            }
-            _layers[k]->forward(_layers[k-1]);
+    for(size_t j = 0; j < num_train_data; j += _batch_size){
+        size_t batch_size = std::min(_batch_size, num_train_data - j);
+        batch_ids.clear();
+        for(size_t i = j; i != j + batch_size; i++){
+            batch_ids.push_back(shuffler.get(i));
         }
+        train_data.get_rows(&data, batch_ids);
+        train_label.get_rows(&label, batch_ids);
+
+        {
+            abcdl::algebra::AllocatorScope scope(&_arena);
+            ((InputLayer*)_layers[0])->set_x(data);
+            for(size_t k = 1; k != layer_size; k++){
+                _layers[k]->forward(_layers[k-1]);
+            }
 
-        for(size_t k = layer_size - 1; k > 0; k--){
-            if(k == layer_size - 1){
-                ((OutputLayer*)_layers[k])->set_y(label);
-                _layers[k]->backward(_layers[k-1], nullptr);
-            }else{
-                _layers[k]->backward(_layers[k-1], _layers[k+1]);
+            for(size_t k = layer_size - 1; k > 0; k--){
+                if(k == layer_size - 1){
+                    ((OutputLayer*)_layers[k])->set_y(label);
+                    _layers[k]->backward(_layers[k-1], nullptr);
+                }else{
+                    _layers[k]->backward(_layers[k-1], _layers[k+1]);
+                }
             }
-               
+
             //mini_batch_update
-            if(j % _batch_size == _batch_size - 1 || j == num_train_data - 1){
-                _layers[k]->update_gradient(j % _batch_size + 1, _alpha);
+            for(size_t k = layer_size - 1; k > 0; k--){
+                _layers[k]->update_gradient(batch_size, _alpha);
             }
-        }
 
-        total_loss += _loss->loss(label, _layers[layer_size - 1]->get_activate_data());
-        auc_train_vec.push_back(std::make_pair(label.argmax(), _layers[layer_size - 1]->get_activate_data().argmax()));
-
-        if(j % 100 == 0){
-            printf(" Train[%ld/%ld]\r", j, num_train_data);
+            const abcdl::algebra::Mat& output = _layers[layer_size - 1]->get_activate_data();
+            total_loss += _loss->loss(label, output);
+            label_idx   = label.argmax(abcdl::algebra::Axis_type::ROW);
+            predict_idx = output.argmax(abcdl::algebra::Axis_type::ROW);
+            for(size_t i = 0; i != batch_size; i++){
+                auc_train_vec.push_back(std::make_pair(label_idx.get_data(i, 0), predict_idx.get_data(i, 0)));
+            }
+            ((InputLayer*)_layers[0])->clear_x();
         }
+        _arena.reset();
+
+        printf(" Train[%ld/%ld]\r", j, num_train_data);
     }
         
     double auc_score = auc(auc_train_vec);
@@ -89,18 +110,22 @@ size_t FNN::evaluate(const abcdl::algebra::Mat& test_data,
     
     size_t rows = test_data.rows();
     size_t predict_num = 0;
-    abcdl::algebra::Mat mat;
+    abcdl::algebra::Mat result;
+    predict_batch(test_data, result, _batch_size);
 
-    real total_loss = 0;
+    real total_loss = _loss->loss(test_label, result);
+    auto label_idx   = test_label.argmax(abcdl::algebra::Axis_type::ROW);
+    auto predict_idx = result.argmax(abcdl::algebra::Axis_type::ROW);
     std::vector<std::pair<real, real>> auc_evaluate_vec;
+    auc_evaluate_vec.reserve(rows);
 
     for(size_t i = 0; i < rows; i++){
-        predict(mat, test_data.get_row(i));
-		if(mat.argmax() == test_label.get_row(i).argmax()){
-            ++ predict_num; 
+        size_t label = label_idx.get_data(i, 0);
+        size_t predict = predict_idx.get_data(i, 0);
+        if(label == predict){
+            ++ predict_num;
         }
-        auc_evaluate_vec.push_back(std::make_pair(test_label.get_row(i).argmax(), mat.argmax()));
-        total_loss += _loss->loss(test_label.get_row(i), mat);
+        auc_evaluate_vec.push_back(std::make_pair(label, predict));
     }
 
     *loss = total_loss / rows;
@@ -133,18 +158,42 @@ double FNN::auc(std::vector<std::pair<real,real>>& auc_vec){
 void FNN::predict(abcdl::algebra::Mat& result, const abcdl::algebra::Mat& predict_data){
     CHECK(predict_data.cols() == _layers[0]->get_input_dim());
     size_t layer_size = _layers.size();
-    for(size_t k = 0; k < layer_size; k++){
-        if(k == 0){
-            ((InputLayer*)_layers[k])->set_x(predict_data);
-        }
+    ((InputLayer*)_layers[0])->set_x(predict_data);
+    for(size_t k = 1; k < layer_size; k++){
         _layers[k]->forward(_layers[k-1]);
-        if(k > 0){
-            //_layers[k]->get_activate_data().display("|");
-        }
     }
     //predict_data.display("^");
     //_layers[layer_size - 1]->get_activate_data().display("|");
     result = _layers[layer_size - 1]->get_activate_data();
+    ((InputLayer*)_layers[0])->clear_x();
+}
+
+void FNN::predict_batch(const abcdl::algebra::Mat& predict_data,
+                        abcdl::algebra::Mat& result,
+                        const size_t batch){
+    CHECK(predict_data.cols() == _layers[0]->get_input_dim());
+    CHECK(batch > 0);
+    if(predict_data.cols() != _layers[0]->get_input_dim() || batch == 0){
+        return;
+    }
+    size_t layer_size = _layers.size();
+    size_t rows = predict_data.rows();
+    size_t output_dim = _layers[layer_size - 1]->get_output_dim();
+    result.resize(rows, output_dim);
+
+    abcdl::algebra::Mat data;
+    size_t cols = predict_data.cols();
+    for(size_t i = 0; i < rows; i += batch){
+        size_t batch_size = std::min(batch, rows - i);
+        //rows of a matrix are continuous, data views them in place
+        data.set_view_data(&predict_data.data()[i * cols], batch_size, cols);
+        ((InputLayer*)_layers[0])->set_x(data);
+        for(size_t k = 1; k < layer_size; k++){
+            _layers[k]->forward(_layers[k-1]);
+        }
+        result.set_row(i, _layers[layer_size - 1]->get_activate_data());
+    }
+    ((InputLayer*)_layers[0])->clear_x();
 }
 
 bool FNN::load_model(const std::string& path){
@@ -13,33 +13,49 @@ namespace fnn{
 
 void InputLayer::set_x(const abcdl::algebra::Mat& mat){
     CHECK(mat.cols() == _input_dim);
-    this->_activate_data  = mat;
+    //refers to mat without copy, mat lives until the step is done
+    this->_activate_data.set_view_data(mat.data(), mat.rows(), mat.cols());
+}
+
+void InputLayer::clear_x(){
+    this->_activate_data.set_view_data(nullptr, 0, 0);
 }
 
 void FullConnLayer::forward(Layer* pre_layer){
-    //activate_func(x * w + b)
-    _activate_func->activate(this->_activate_data, _helper.dot(pre_layer->get_activate_data(), this->_weight) + this->_bias);
+    //activate_func(x * w + b), bias and activation fused into the gemm
+    _helper.dot_bias_activate(this->_activate_data,
+                              pre_layer->get_activate_data(),
+                              this->_weight,
+                              this->_bias,
+                              _activate_func->get_activate_type());
 }
 void FullConnLayer::backward(Layer* pre_layer, Layer* next_layer){
     //δ_l = ( (w_l+1).T .* δ_l+1 ) * Derivative(a_l)
-    abcdl::algebra::Mat activate_derivative;
-    _activate_func->derivative(activate_derivative, this->_activate_data);
-    _delta_bias   = _helper.dot(next_layer->get_delta_bias(), next_layer->get_weight().Ts()) * activate_derivative;
+    _helper.dot_transpose_derivative(this->_delta_bias,
+                                     next_layer->get_delta_bias(),
+                                     next_layer->get_weight(),
+                                     this->_activate_data,
+                                     _activate_func->get_activate_type());
 
     /*
      * Derivative(Cw) = a_in * δ_out
      * a_in = a_l-1, δ_out = mat
      * activations include input layer, so l-1 is i.
+     * a row of δ is one sample, the product sums over the batch.
      */
-    this->_delta_weight   = _helper.dot(pre_layer->get_activate_data().Ts(), this->_delta_bias);
+    this->_delta_weight   = _helper.dot(abcdl::algebra::MatrixView<real>(pre_layer->get_activate_data()).transpose(), this->_delta_bias);
 
-    this->_batch_bias     += this->_delta_bias;
+    this->_batch_bias     += this->_delta_bias.sum(abcdl::algebra::Axis_type::COL);
     this->_batch_weight   += this->_delta_weight;
 }
 
 void OutputLayer::forward(Layer* pre_layer){
-    //activate_func(x * w + b)
-    _activate_func->activate(this->_activate_data, _helper.dot(pre_layer->get_activate_data(), this->_weight) + this->_bias);
+    //activate_func(x * w + b), bias and activation fused into the gemm
+    _helper.dot_bias_activate(this->_activate_data,
+                              pre_layer->get_activate_data(),
+                              this->_weight,
+                              this->_bias,
+                              _activate_func->get_activate_type());
 }
 void OutputLayer::backward(Layer* pre_layer, Layer* next_layer){
     /*
@@ -50,21 +66,22 @@ void OutputLayer::backward(Layer* pre_layer, Layer* next_layer){
     /*
      * Derivative(Cw) = a_in * δ_out
      * a_in = a_L-1, δ_out = delta
+     * a row of δ is one sample, the product sums over the batch.
      */
-    this->_delta_weight   = _helper.dot(pre_layer->get_activate_data().Ts(), this->_delta_bias);
+    this->_delta_weight   = _helper.dot(abcdl::algebra::MatrixView<real>(pre_layer->get_activate_data()).transpose(), this->_delta_bias);
 
     this->_batch_weight   += this->_delta_weight;
-    this->_batch_bias     += this->_delta_bias;
+    this->_batch_bias     += this->_delta_bias.sum(abcdl::algebra::Axis_type::COL);
 }
 
 void BatchNormalizationLayer::forward(Layer* pre_layer){
-    auto input = pre_layer->get_activate_data();
+    const auto& input = pre_layer->get_activate_data();
     CHECK(input.cols() == this->_weight.cols());
     _means = input.mean(abcdl::algebra::Axis_type::COL);
-    _variances = (input - _means).pow(2).mean(abcdl::algebra::Axis_type::COL);
+    _variances = (abcdl::algebra::expr(input) - _means).pow(2).eval().mean(abcdl::algebra::Axis_type::COL);
     _scales = (_variances + _epsilon).sqrt().inverse();
-    _normalize = (input - _means) * _scales;
-    this->_activate_data = _normalize * this->_weight.get_row(0) + this->_weight.get_row(1); 
+    _normalize = (abcdl::algebra::expr(input) - _means) * _scales;
+    this->_activate_data = abcdl::algebra::expr(_normalize) * this->_weight.get_row(0) + this->_weight.get_row(1);
 }
 
 void BatchNormalizationLayer::backward(Layer* pre_layer, Layer* next_layer){
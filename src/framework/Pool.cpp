@@ -1,78 +1,278 @@
 /*********************************************
 * Author: Jun Jiang - jiangjun4@sina.com
 * Created: 2017-08-24 16:47
-* Last modified: 2017-08-24 19:39
+* Last modified: 2026-10-17 20:10
 * Filename: Pool.cpp
 * Description: convolutional network pooling 
 **********************************************/
+#include <string.h>
+#include <algorithm>
 #include "framework/Pool.h"
+#include "algebra/MatrixKernel.h"
 
 namespace abcdl{
 namespace framework{
 
-void MeanPooling::pool(abcdl::algebra::Mat& pool,
-                       const abcdl::algebra::Mat& mat,
-                       const size_t rows,
-                       const size_t cols,
+typedef abcdl::algebra::MatrixKernel<real> Kernel;
+
+bool Pooling::resize_pool(abcdl::algebra::Tensor<real>& pool,
+                          const abcdl::algebra::Tensor<real>& tensor,
+                          const size_t scale) const{
+    if(scale == 0 || tensor.get_layout() != abcdl::algebra::NCHW){
+        LOG(FATAL) << "Pooling error: scale must be positive and layout must be NCHW.";
+        return false;
+    }
+    size_t rows = tensor.rows() / scale;
+    size_t cols = tensor.cols() / scale;
+    if(pool.num() != tensor.num() || pool.channels() != tensor.channels() ||
+       pool.rows() != rows || pool.cols() != cols || pool.get_layout() != abcdl::algebra::NCHW){
+        pool.resize(tensor.num(), tensor.channels(), rows, cols);
+    }
+    return true;
+}
+
+bool Pooling::check_delta(const abcdl::algebra::Tensor<real>& delta,
+                          const abcdl::algebra::Tensor<real>& pool_delta,
+                          const abcdl::algebra::Tensor<real>& tensor,
+                          const abcdl::algebra::Tensor<real>& pool) const{
+    if(delta.get_size() != tensor.get_size() || pool_delta.get_size() != pool.get_size() ||
+       delta.get_layout() != abcdl::algebra::NCHW || pool_delta.get_layout() != abcdl::algebra::NCHW){
+        LOG(FATAL) << "Pooling error: delta must be NCHW and the same size as forward.";
+        return false;
+    }
+    return true;
+}
+
+size_t Pooling::get_num_thread(const size_t size) const{
+    return _po.get_num_thread(size, _po.get_block_size(size));
+}
+
+void MeanPooling::pool(abcdl::algebra::Tensor<real>& pool,
+                       const abcdl::algebra::Tensor<real>& tensor,
                        const size_t scale){
-    real* data = new real[rows * cols];
-    size_t pooling_size = scale * scale;
-    for(size_t j = 0; j != rows; j++){
-        for(size_t k = 0; k != cols; k++){
-            real pooling_value = 0;
-            for(size_t m = 0; m != scale; m++){
-                for(size_t n = 0; n != scale; n++){
-                    pooling_value += mat.get_data(j * scale + m, k * scale + n);
+    if(!resize_pool(pool, tensor, scale)){
+        return;
+    }
+    size_t rows = pool.rows();
+    size_t cols = pool.cols();
+    size_t in_cols = tensor.cols();
+    size_t in_size = tensor.rows() * in_cols;
+    size_t num_channel = tensor.num() * tensor.channels();
+    real pooling_size = scale * scale;
+
+    _po.parallel_range(num_channel, get_num_thread(tensor.get_size()),
+        [&](size_t start_idx, size_t end_idx){
+            std::vector<real> row_sum(cols * scale);
+            for(size_t c = start_idx; c < end_idx; c++){
+                const real* in = &tensor.data()[c * in_size];
+                real* data = &pool.data()[c * rows * cols];
+                for(size_t j = 0; j != rows; j++){
+                    const real* row = &in[j * scale * in_cols];
+                    memcpy(row_sum.data(), row, sizeof(real) * row_sum.size());
+                    for(size_t m = 1; m != scale; m++){
+                        Kernel::add(row_sum.data(), row_sum.data(), &row[m * in_cols], row_sum.size());
+                    }
+                    for(size_t k = 0; k != cols; k++){
+                        real pooling_value = 0;
+                        for(size_t n = 0; n != scale; n++){
+                            pooling_value += row_sum[k * scale + n];
+                        }
+                        data[j * cols + k] = pooling_value / pooling_size;
+                    }
                 }
             }
-            data[j * cols + k] = pooling_value / pooling_size;
         }
+    );
+}
+void MeanPooling::backward(abcdl::algebra::Tensor<real>& delta,
+                           const abcdl::algebra::Tensor<real>& pool_delta,
+                           const abcdl::algebra::Tensor<real>& tensor,
+                           const abcdl::algebra::Tensor<real>& pool,
+                           const size_t scale){
+    if(!check_delta(delta, pool_delta, tensor, pool)){
+        return;
     }
-    pool.set_shallow_data(data, rows, cols);
+    size_t rows = pool.rows();
+    size_t cols = pool.cols();
+    size_t in_rows = tensor.rows();
+    size_t in_cols = tensor.cols();
+    size_t num_channel = tensor.num() * tensor.channels();
+    real pooling_size = scale * scale;
+
+    _po.parallel_range(num_channel, get_num_thread(tensor.get_size()),
+        [&](size_t start_idx, size_t end_idx){
+            for(size_t c = start_idx; c < end_idx; c++){
+                const real* back = &pool_delta.data()[c * rows * cols];
+                real* data = &delta.data()[c * in_rows * in_cols];
+                if(rows * scale != in_rows || cols * scale != in_cols){
+                    memset(data, 0, sizeof(real) * in_rows * in_cols);
+                }
+                for(size_t j = 0; j != rows; j++){
+                    //first row of the windows, the others are copies of it
+                    real* row = &data[j * scale * in_cols];
+                    for(size_t k = 0; k != cols; k++){
+                        real value = back[j * cols + k] / pooling_size;
+                        for(size_t n = 0; n != scale; n++){
+                            row[k * scale + n] = value;
+                        }
+                    }
+                    for(size_t m = 1; m != scale; m++){
+                        memcpy(&row[m * in_cols], row, sizeof(real) * cols * scale);
+                    }
+                }
+            }
+        }
+    );
 }
-void MaxPooling::pool(abcdl::algebra::Mat& pool,
-                      const abcdl::algebra::Mat& mat,
-                      const size_t rows,
-                      const size_t cols,
+
+void MaxPooling::pool(abcdl::algebra::Tensor<real>& pool,
+                      const abcdl::algebra::Tensor<real>& tensor,
                       const size_t scale){
-    real* data = new real[rows * cols];
-    for(size_t j = 0; j != rows; j++){
-        for(size_t k = 0; k != cols; k++){
-            real pooling_value = 0;
-            for(size_t m = 0; m != scale; m++){
-                for(size_t n = 0; n != scale; n++){
-                    real value = mat.get_data(j * scale + m, k * scale + n);
-                    if((m == 0 && n == 0) || value > pooling_value){
-                        pooling_value = value;
+    if(!resize_pool(pool, tensor, scale)){
+        return;
+    }
+    size_t rows = pool.rows();
+    size_t cols = pool.cols();
+    size_t in_cols = tensor.cols();
+    size_t in_size = tensor.rows() * in_cols;
+    size_t num_channel = tensor.num() * tensor.channels();
+    _mask.resize(pool.get_size());
+
+    _po.parallel_range(num_channel, get_num_thread(tensor.get_size()),
+        [&](size_t start_idx, size_t end_idx){
+            //max of every column over the rows of a window, and the row it came from
+            std::vector<real> row_max(cols * scale);
+            std::vector<real> row_id(cols * scale);
+            for(size_t c = start_idx; c < end_idx; c++){
+                const real* in = &tensor.data()[c * in_size];
+                real* data = &pool.data()[c * rows * cols];
+                size_t* mask = &_mask[c * rows * cols];
+                for(size_t j = 0; j != rows; j++){
+                    const real* row = &in[j * scale * in_cols];
+                    memcpy(row_max.data(), row, sizeof(real) * row_max.size());
+                    std::fill(row_id.begin(), row_id.end(), 0);
+                    for(size_t m = 1; m != scale; m++){
+                        Kernel::max_index(row_max.data(), row_id.data(), &row[m * in_cols], (real)m, row_max.size());
+                    }
+                    for(size_t k = 0; k != cols; k++){
+                        size_t col = k * scale;
+                        for(size_t n = 1; n != scale; n++){
+                            if(row_max[k * scale + n] > row_max[col]){
+                                col = k * scale + n;
+                            }
+                        }
+                        data[j * cols + k] = row_max[col];
+                        mask[j * cols + k] = c * in_size + (j * scale + (size_t)row_id[col]) * in_cols + col;
                     }
                 }
             }
-            data[j * cols + k] = pooling_value;
         }
+    );
+}
+void MaxPooling::backward(abcdl::algebra::Tensor<real>& delta,
+                          const abcdl::algebra::Tensor<real>& pool_delta,
+                          const abcdl::algebra::Tensor<real>& tensor,
+                          const abcdl::algebra::Tensor<real>& pool,
+                          const size_t scale){
+    if(!check_delta(delta, pool_delta, tensor, pool)){
+        return;
+    }
+    if(_mask.size() != pool.get_size()){
+        LOG(FATAL) << "Pooling error: backward without forward.";
+        return;
     }
-    pool.set_shallow_data(data, rows, cols);
+    size_t size = pool.rows() * pool.cols();
+    size_t in_size = tensor.rows() * tensor.cols();
+    size_t num_channel = tensor.num() * tensor.channels();
+
+    _po.parallel_range(num_channel, get_num_thread(tensor.get_size()),
+        [&](size_t start_idx, size_t end_idx){
+            memset(&delta.data()[start_idx * in_size], 0, sizeof(real) * (end_idx - start_idx) * in_size);
+            //windows do not overlap, a max takes one delta
+            for(size_t i = start_idx * size; i != end_idx * size; i++){
+                delta.data()[_mask[i]] = pool_delta.data()[i];
+            }
+        }
+    );
 }
-void L2Pooling::pool(abcdl::algebra::Mat& pool,
-                     const abcdl::algebra::Mat& mat,
-                     const size_t rows,
-                     const size_t cols,
+
+void L2Pooling::pool(abcdl::algebra::Tensor<real>& pool,
+                     const abcdl::algebra::Tensor<real>& tensor,
                      const size_t scale){
-    real* data = new real[rows * cols];
-    for(size_t j = 0; j != rows; j++){
-        for(size_t k = 0; k != cols; k++){
-            real pooling_value = 0;
-            for(size_t m = 0; m != scale; m++){
-                for(size_t n = 0; n != scale; n++){
-                    real value = mat.get_data(j * scale + m, k * scale + n);
-                    if(value != 0){
-                        pooling_value += (value * value);
+    if(!resize_pool(pool, tensor, scale)){
+        return;
+    }
+    size_t rows = pool.rows();
+    size_t cols = pool.cols();
+    size_t in_cols = tensor.cols();
+    size_t in_size = tensor.rows() * in_cols;
+    size_t num_channel = tensor.num() * tensor.channels();
+
+    _po.parallel_range(num_channel, get_num_thread(tensor.get_size()),
+        [&](size_t start_idx, size_t end_idx){
+            std::vector<real> row_sum(cols * scale);
+            for(size_t c = start_idx; c < end_idx; c++){
+                const real* in = &tensor.data()[c * in_size];
+                real* data = &pool.data()[c * rows * cols];
+                for(size_t j = 0; j != rows; j++){
+                    const real* row = &in[j * scale * in_cols];
+                    std::fill(row_sum.begin(), row_sum.end(), 0);
+                    for(size_t m = 0; m != scale; m++){
+                        Kernel::square_add(row_sum.data(), &row[m * in_cols], row_sum.size());
+                    }
+                    for(size_t k = 0; k != cols; k++){
+                        real pooling_value = 0;
+                        for(size_t n = 0; n != scale; n++){
+                            pooling_value += row_sum[k * scale + n];
+                        }
+                        data[j * cols + k] = sqrt(pooling_value);
                     }
                 }
             }
-            data[j * cols + k] = sqrt(pooling_value);
         }
+    );
+}
+void L2Pooling::backward(abcdl::algebra::Tensor<real>& delta,
+                         const abcdl::algebra::Tensor<real>& pool_delta,
+                         const abcdl::algebra::Tensor<real>& tensor,
+                         const abcdl::algebra::Tensor<real>& pool,
+                         const size_t scale){
+    if(!check_delta(delta, pool_delta, tensor, pool)){
+        return;
     }
-    pool.set_shallow_data(data, rows, cols);
+    size_t rows = pool.rows();
+    size_t cols = pool.cols();
+    size_t in_rows = tensor.rows();
+    size_t in_cols = tensor.cols();
+    size_t num_channel = tensor.num() * tensor.channels();
+
+    _po.parallel_range(num_channel, get_num_thread(tensor.get_size()),
+        [&](size_t start_idx, size_t end_idx){
+            std::vector<real> row_scale(cols * scale);
+            for(size_t c = start_idx; c < end_idx; c++){
+                const real* in = &tensor.data()[c * in_rows * in_cols];
+                const real* back = &pool_delta.data()[c * rows * cols];
+                const real* pooled = &pool.data()[c * rows * cols];
+                real* data = &delta.data()[c * in_rows * in_cols];
+                if(rows * scale != in_rows || cols * scale != in_cols){
+                    memset(data, 0, sizeof(real) * in_rows * in_cols);
+                }
+                for(size_t j = 0; j != rows; j++){
+                    //delta / pool of every window, a window of zeros takes none
+                    for(size_t k = 0; k != cols; k++){
+                        real value = pooled[j * cols + k] == 0 ? 0 : back[j * cols + k] / pooled[j * cols + k];
+                        for(size_t n = 0; n != scale; n++){
+                            row_scale[k * scale + n] = value;
+                        }
+                    }
+                    for(size_t m = 0; m != scale; m++){
+                        size_t offset = (j * scale + m) * in_cols;
+                        Kernel::mul(&data[offset], &in[offset], row_scale.data(), row_scale.size());
+                    }
+                }
+            }
+        }
+    );
 }
 
 }//namespace framework
@@ -1,11 +1,15 @@
 /***********************************************
  * Author: Jun Jiang - jiangjun4@sina.com
  * Create: 2017-09-05 16:04
- * Last modified : 2017-09-06 14:42
+ * Last modified : 2026-10-17 21:40
  * Filename	  : Layer.cpp
  * Description   : RNN network Layer 
  **********************************************/
 #include "rnn/Layer.h"
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include <random>
 
 namespace abcdl{
 namespace rnn{
@@ -16,25 +20,37 @@ void Layer::farward(const abcdl::algebra::Mat& train_seq_data,
 					const abcdl::algebra::Mat& act_weight,
 					abcdl::algebra::Mat& state,
 					abcdl::algebra::Mat& activation){
-	
-	size_t seq_rows = train_seq_data.rows();
-	size_t seq_cols = train_seq_data.cols();
-	state.reset(0, seq_rows, _hidden_dim);
-	activation.reset(0, seq_rows, seq_cols);
+	//x[t] is one-hot, only its index is needed
+	auto mat_index = train_seq_data.argmax(abcdl::algebra::Axis_type::ROW);
+	SeqIndex seq_index(mat_index.data(), mat_index.data() + mat_index.get_size());
 
-	abcdl::algebra::Mat s_t;
-	for(size_t t = 0; t != seq_rows; t++){
-		//s[t] = tanh(U*x[t] + W*s[t-1])
-		//o[t] = softmax(V* s[t])
-		if(t > 0){
-			_activate_func->activate(s_t, helper.dot(weight, train_seq_data.get_row(t).transpose()) + helper.dot(pre_weight, state.get_row(t - 1).transpose()));
-		}else{
-			_activate_func->activate(s_t, helper.dot(weight, train_seq_data.get_row(t).transpose()));
-		}
+	farward(seq_index, weight, pre_weight, act_weight, state, activation);
+}
 
-		state.set_row(t, s_t.Ts());
-		activation.set_row(t, helper.dot(act_weight, s_t).softmax().transpose());	
+void Layer::farward(const SeqIndex& train_seq_index,
+					const abcdl::algebra::Mat& weight,
+					const abcdl::algebra::Mat& pre_weight,
+					const abcdl::algebra::Mat& act_weight,
+					abcdl::algebra::Mat& state,
+					abcdl::algebra::Mat& activation){
+	//a sequence is a packed batch of one, the cell of the layer runs it
+	SeqBatch batch_index(1, &train_seq_index);
+	std::vector<abcdl::algebra::Mat> states;
+	farward_state(batch_index, weight, pre_weight, states);
+
+	//row t is the state column of step t
+	size_t seq_rows = states.size();
+	size_t state_rows = seq_rows == 0 ? _hidden_dim : states[0].rows();
+	state.reset(0, seq_rows, state_rows);
+	for(size_t t = 0; t != seq_rows; t++){
+		memcpy(&state.data()[t * state_rows], states[t].data(), sizeof(real) * state_rows);
 	}
+
+	//o[t] = softmax(V * h[t]), a row per step
+	helper.dot(activation,
+			   abcdl::algebra::MatrixView<real>(state).col_range(0, _hidden_dim),
+			   abcdl::algebra::MatrixView<real>(act_weight).transpose());
+	helper.softmax(activation, activation, abcdl::algebra::ROW);
 }
 
 void Layer::backward(const abcdl::algebra::Mat& train_seq_data,
@@ -49,50 +65,642 @@ void Layer::backward(const abcdl::algebra::Mat& train_seq_data,
 					 abcdl::algebra::Mat& derivate_act_weight){
 	abcdl::algebra::Mat derivate_output;
 	_cost->delta(derivate_output, activation, train_seq_label);
-	
-	size_t seq_size = train_seq_data.rows();
+
+	//x[t] is one-hot, only its index is needed
+	auto mat_index = train_seq_data.argmax(abcdl::algebra::Axis_type::ROW);
+	SeqIndex seq_index(mat_index.data(), mat_index.data() + mat_index.get_size());
+
+	backward_index(seq_index, derivate_output, pre_weight, act_weight, state, derivate_weight, derivate_pre_weight, derivate_act_weight);
+}
+
+void Layer::backward(const SeqIndex& train_seq_index,
+					 const SeqIndex& train_seq_label,
+					 abcdl::algebra::Mat& weight,
+					 abcdl::algebra::Mat& pre_weight,
+					 abcdl::algebra::Mat& act_weight,
+					 const abcdl::algebra::Mat& state,
+					 const abcdl::algebra::Mat& activation,
+					 abcdl::algebra::Mat& derivate_weight,
+					 abcdl::algebra::Mat& derivate_pre_weight,
+					 abcdl::algebra::Mat& derivate_act_weight){
+	//cost takes a dense label, it is as large as activation
+	abcdl::algebra::Mat label(0.0, activation.rows(), activation.cols());
+	for(size_t t = 0; t != train_seq_label.size(); t++){
+		CHECK(train_seq_label[t] < label.cols());
+		label.set_data(1, t, train_seq_label[t]);
+	}
+
+	abcdl::algebra::Mat derivate_output;
+	_cost->delta(derivate_output, activation, label);
+
+	backward_index(train_seq_index, derivate_output, pre_weight, act_weight, state, derivate_weight, derivate_pre_weight, derivate_act_weight);
+}
+
+void Layer::backward_index(const SeqIndex& seq_index,
+						   const abcdl::algebra::Mat& derivate_output,
+						   abcdl::algebra::Mat& pre_weight,
+						   abcdl::algebra::Mat& act_weight,
+						   const abcdl::algebra::Mat& state,
+						   abcdl::algebra::Mat& derivate_weight,
+						   abcdl::algebra::Mat& derivate_pre_weight,
+						   abcdl::algebra::Mat& derivate_act_weight){
+	size_t seq_size = seq_index.size();
+	abcdl::algebra::MatrixView<real> state_view(state);
+	abcdl::algebra::MatrixView<real> derivate_output_view(derivate_output);
+
+    //update derivate_act_weight, summed over the sequence, h[t] is the first hidden_dim columns
+	derivate_act_weight += helper.dot(derivate_output_view.transpose(), state_view.col_range(0, _hidden_dim));
+
+	//a sequence is a packed batch of one, it takes the bptt of the batch
+	SeqBatch batch_index(1, &seq_index);
+	std::vector<abcdl::algebra::Mat> states(seq_size);
+	std::vector<abcdl::algebra::Mat> derivate_states(seq_size);
+	for(size_t t = 0; t != seq_size; t++){
+		state_view.row(t).transpose().copy_to(&states[t]);
+		helper.dot(derivate_states[t],
+				   abcdl::algebra::MatrixView<real>(act_weight).transpose(),
+				   derivate_output_view.row(t).transpose());
+	}
+
+	backward_state(batch_index, pre_weight, states, derivate_states, derivate_weight, derivate_pre_weight);
+}
+
+size_t Layer::batch_size(const SeqBatch& batch, const size_t t){
+	size_t size = batch.size();
+	while(size > 0 && batch[size - 1]->size() <= t){
+		size--;
+	}
+	return size;
+}
+
+void Layer::gather_weight(const SeqIndex& words,
+						  const abcdl::algebra::Mat& weight,
+						  abcdl::algebra::Mat& mat){
+	size_t feature_dim = weight.cols();
+	size_t rows = mat.rows();
+	size_t batch = mat.cols();
+	CHECK(rows <= weight.rows() && batch == words.size());
+	real* data = mat.data();
+	for(size_t b = 0; b != batch; b++){
+		size_t idx = words[b];
+		CHECK(idx < feature_dim);
+		const real* weight_data = &weight.data()[idx];
+		for(size_t i = 0; i != rows; i++){
+			data[i * batch + b] += weight_data[i * feature_dim];
+		}
+	}
+}
+
+void Layer::scatter_weight(const SeqBatch& batch_index,
+						   const size_t t,
+						   const abcdl::algebra::Mat& delta,
+						   abcdl::algebra::Mat& derivate_weight){
+	size_t feature_dim = derivate_weight.cols();
+	size_t rows = delta.rows();
+	size_t batch = delta.cols();
+	CHECK(rows <= derivate_weight.rows());
+	const real* data = delta.data();
+	for(size_t b = 0; b != batch; b++){
+		size_t idx = (*batch_index[b])[t];
+		CHECK(idx < feature_dim);
+		real* weight_data = &derivate_weight.data()[idx];
+		for(size_t i = 0; i != rows; i++){
+			weight_data[i * feature_dim] += data[i * batch + b];
+		}
+	}
+}
+
+void Layer::farward(const SeqBatch& batch_index,
+					const abcdl::algebra::Mat& weight,
+					const abcdl::algebra::Mat& pre_weight,
+					const abcdl::algebra::Mat& act_weight,
+					std::vector<abcdl::algebra::Mat>& states,
+					std::vector<abcdl::algebra::Mat>& activations){
+	farward_state(batch_index, weight, pre_weight, states);
+
+	size_t seq_rows = states.size();
+	activations.resize(seq_rows);
+	for(size_t t = 0; t != seq_rows; t++){
+		//O[t] = softmax(V * h[t]), a row per sequence
+		helper.dot(activations[t],
+				   hidden(states[t]).transpose(),
+				   abcdl::algebra::MatrixView<real>(act_weight).transpose());
+		helper.softmax(activations[t], activations[t], abcdl::algebra::ROW);
+	}
+}
+
+void Layer::farward_state(const SeqBatch& batch_index,
+						  const abcdl::algebra::Mat& weight,
+						  const abcdl::algebra::Mat& pre_weight,
+						  std::vector<abcdl::algebra::Mat>& states){
+	size_t seq_rows = batch_index.empty() ? 0 : batch_index[0]->size();
+	states.resize(seq_rows);
+
+	SeqIndex words;
+	for(size_t t = 0; t != seq_rows; t++){
+		size_t batch = batch_size(batch_index, t);
+		words.resize(batch);
+		for(size_t b = 0; b != batch; b++){
+			words[b] = (*batch_index[b])[t];
+		}
+		farward_cell(words, weight, pre_weight, t > 0 ? &states[t - 1] : nullptr, states[t]);
+	}
+}
+
+void Layer::farward_cell(const SeqIndex& words,
+						 const abcdl::algebra::Mat& weight,
+						 const abcdl::algebra::Mat& pre_weight,
+						 const abcdl::algebra::Mat* pre_state,
+						 abcdl::algebra::Mat& state){
+	size_t batch = words.size();
+
+	//S[t] = tanh(U*X[t] + W*S[t-1]), sequences ended before t are left out of S[t-1]
+	if(pre_state != nullptr){
+		helper.dot(state,
+				   abcdl::algebra::MatrixView<real>(pre_weight),
+				   abcdl::algebra::MatrixView<real>(*pre_state).col_range(0, batch));
+	}else{
+		state.reset(0, _hidden_dim, batch);
+	}
+	//U * X[t]: column b is the column of U at the word of sequence b
+	gather_weight(words, weight, state);
+	_activate_func->activate(state, state);
+}
+
+void Layer::step(const size_t index,
+				 const abcdl::algebra::Mat& weight,
+				 const abcdl::algebra::Mat& pre_weight,
+				 State& state){
+	state.words.assign(1, index);
+	farward_cell(state.words, weight, pre_weight, state.t > 0 ? &state.state : nullptr, state.pre_state);
+	std::swap(state.state, state.pre_state);
+	state.t++;
+}
+
+void Layer::backward(const SeqBatch& batch_index,
+					 const SeqBatch& batch_label,
+					 abcdl::algebra::Mat& weight,
+					 abcdl::algebra::Mat& pre_weight,
+					 abcdl::algebra::Mat& act_weight,
+					 const std::vector<abcdl::algebra::Mat>& states,
+					 const std::vector<abcdl::algebra::Mat>& activations,
+					 abcdl::algebra::Mat& derivate_weight,
+					 abcdl::algebra::Mat& derivate_pre_weight,
+					 abcdl::algebra::Mat& derivate_act_weight){
+	size_t seq_size = states.size();
+	std::vector<abcdl::algebra::Mat> derivate_states(seq_size);
 	for(size_t s = seq_size; s != 0 ; s--){
 		size_t t = s - 1;
-		auto derivate_output_t = derivate_output.get_row(t).transpose();
-		auto state_t = state.get_row(t).transpose();
+		size_t batch = batch_size(batch_index, t);
+		const abcdl::algebra::Mat& activation = activations[t];
+
+		abcdl::algebra::Mat label(0.0, batch, activation.cols());
+		for(size_t b = 0; b != batch; b++){
+			size_t idx = (*batch_label[b])[t];
+			CHECK(idx < label.cols());
+			label.set_data(1, b, idx);
+		}
+		abcdl::algebra::Mat derivate_output;
+		_cost->delta(derivate_output, activation, label);
 
-        //update derivate_act_weight
-		derivate_act_weight += helper.outer(derivate_output_t, state_t);
+        //update derivate_act_weight, summed over the batch
+		derivate_act_weight += helper.dot(abcdl::algebra::MatrixView<real>(derivate_output).transpose(),
+										  hidden(states[t]).transpose());
+
+        //derivate of h[t], hidden_dim x batch
+		helper.dot(derivate_states[t],
+				   abcdl::algebra::MatrixView<real>(act_weight).transpose(),
+				   abcdl::algebra::MatrixView<real>(derivate_output).transpose());
+	}
 
-        //calc derivate_t
+	backward_state(batch_index, pre_weight, states, derivate_states, derivate_weight, derivate_pre_weight);
+}
+
+void Layer::backward_state(const SeqBatch& batch_index,
+						   abcdl::algebra::Mat& pre_weight,
+						   const std::vector<abcdl::algebra::Mat>& states,
+						   std::vector<abcdl::algebra::Mat>& derivate_states,
+						   abcdl::algebra::Mat& derivate_weight,
+						   abcdl::algebra::Mat& derivate_pre_weight){
+	for(size_t s = states.size(); s != 0 ; s--){
+		size_t t = s - 1;
+
+        //calc derivate_t, hidden_dim x batch
 		abcdl::algebra::Mat state_derivate;
-		helper.sigmoid_derivative(state_derivate, state_t);
-		auto derivate_t = helper.dot(act_weight.Ts(), derivate_output_t) * state_derivate;
-
-		//back_propagation steps
-		for(size_t step = 0; step < _bptt_truncate && step <= t; step++){
-			size_t bptt_step = t - step;
-			abcdl::algebra::Mat derivate_state_t;
-			if(bptt_step > 0){
-				state.get_row(&derivate_state_t, bptt_step - 1);
-			}else{
-				derivate_state_t.reset(0, state.cols(), 1);
+		_activate_func->derivative(state_derivate, states[t]);
+		abcdl::algebra::Mat& derivate_t = derivate_states[t];
+		derivate_t *= state_derivate;
+
+		backward_step(batch_index, t, derivate_t, pre_weight, states, derivate_weight, derivate_pre_weight);
+	}
+}
+
+void Layer::backward_step(const SeqBatch& batch_index,
+						  const size_t t,
+						  abcdl::algebra::Mat& derivate_t,
+						  const abcdl::algebra::Mat& pre_weight,
+						  const std::vector<abcdl::algebra::Mat>& states,
+						  abcdl::algebra::Mat& derivate_weight,
+						  abcdl::algebra::Mat& derivate_pre_weight){
+	size_t batch = batch_size(batch_index, t);
+
+	//back_propagation steps
+	for(size_t step = 0; step < _bptt_truncate && step <= t; step++){
+		size_t bptt_step = t - step;
+		abcdl::algebra::Mat derivate_state_t;
+		if(bptt_step > 0){
+			abcdl::algebra::MatrixView<real>(states[bptt_step - 1]).col_range(0, batch).copy_to(&derivate_state_t);
+
+			//update derivate_pre_weight, s[-1] is 0
+			derivate_pre_weight += helper.dot(abcdl::algebra::MatrixView<real>(derivate_t),
+											  abcdl::algebra::MatrixView<real>(derivate_state_t).transpose());
+		}
+
+        //update derivate_weight: column of the word of every sequence
+        scatter_weight(batch_index, bptt_step, derivate_t, derivate_weight);
+
+		//update delta
+		if(bptt_step > 0){
+			_activate_func->derivative(derivate_state_t, derivate_state_t);
+			derivate_t = helper.dot(abcdl::algebra::MatrixView<real>(pre_weight).transpose(), abcdl::algebra::MatrixView<real>(derivate_t)) * derivate_state_t;
+		}
+	}
+}
+
+void Layer::backward_sampled(const SeqBatch& batch_index,
+							 const SeqBatch& batch_label,
+							 const size_t num_sampled,
+							 Sampler& sampler,
+							 abcdl::algebra::Mat& weight,
+							 abcdl::algebra::Mat& pre_weight,
+							 abcdl::algebra::Mat& act_weight,
+							 const std::vector<abcdl::algebra::Mat>& states,
+							 abcdl::algebra::Mat& derivate_weight,
+							 abcdl::algebra::Mat& derivate_pre_weight,
+							 abcdl::algebra::Mat& derivate_act_weight){
+	size_t feature_dim = act_weight.rows();
+	size_t seq_size = states.size();
+
+	//the sampler of this call, not thread_local: a thread waiting in a gemm runs other pool tasks
+	std::vector<size_t>& candidate_col = sampler.candidate_col;
+	std::default_random_engine& random_engine = sampler.random_engine;
+	if(candidate_col.size() != feature_dim){
+		candidate_col.assign(feature_dim, feature_dim);
+	}
+
+	//P(c) = log((c + 2) / (c + 1)) / log(V + 1), c = exp(u * log(V + 1)) - 1 for a uniform u
+	real log_range = std::log(static_cast<real>(feature_dim) + 1);
+	std::uniform_real_distribution<real> uniform(0, 1);
+
+	std::vector<size_t> candidates;
+	std::vector<real> log_expected_count;
+	std::vector<abcdl::algebra::Mat> derivate_states(seq_size);
+	for(size_t s = seq_size; s != 0 ; s--){
+		size_t t = s - 1;
+		size_t batch = batch_size(batch_index, t);
+
+		//the labels of the batch then the sampled words, every word once
+		candidates.clear();
+		for(size_t b = 0; b != batch; b++){
+			size_t idx = (*batch_label[b])[t];
+			CHECK(idx < feature_dim);
+			if(candidate_col[idx] == feature_dim){
+				candidate_col[idx] = candidates.size();
+				candidates.push_back(idx);
+			}
+		}
+		for(size_t k = 0; k != num_sampled; k++){
+			size_t idx = static_cast<size_t>(std::exp(uniform(random_engine) * log_range)) - 1;
+			idx = std::min(idx, feature_dim - 1);
+			if(candidate_col[idx] == feature_dim){
+				candidate_col[idx] = candidates.size();
+				candidates.push_back(idx);
+			}
+		}
+
+		//rows of V of the candidates
+		size_t num_candidate = candidates.size();
+		abcdl::algebra::Mat candidate_weight;
+		candidate_weight.resize(num_candidate, _hidden_dim);
+		log_expected_count.resize(num_candidate);
+		for(size_t c = 0; c != num_candidate; c++){
+			size_t idx = candidates[c];
+			memcpy(&candidate_weight.data()[c * _hidden_dim], &act_weight.data()[idx * _hidden_dim], sizeof(real) * _hidden_dim);
+			real probability = std::log((idx + static_cast<real>(2)) / (idx + static_cast<real>(1))) / log_range;
+			log_expected_count[c] = std::log(num_sampled * probability);
+		}
+
+		//O[t] = softmax(V_c * S[t] - log Q(c)) over the candidates only
+		abcdl::algebra::Mat activation;
+		helper.dot(activation,
+				   hidden(states[t]).transpose(),
+				   abcdl::algebra::MatrixView<real>(candidate_weight).transpose());
+		real* data = activation.data();
+		for(size_t b = 0; b != batch; b++){
+			for(size_t c = 0; c != num_candidate; c++){
+				data[b * num_candidate + c] -= log_expected_count[c];
+			}
+		}
+		helper.softmax(activation, activation, abcdl::algebra::ROW);
+
+		abcdl::algebra::Mat label(0.0, batch, num_candidate);
+		for(size_t b = 0; b != batch; b++){
+			label.set_data(1, b, candidate_col[(*batch_label[b])[t]]);
+		}
+		abcdl::algebra::Mat derivate_output;
+		_cost->delta(derivate_output, activation, label);
+
+		//update derivate_act_weight: rows of the candidates only
+		auto derivate_candidate = helper.dot(abcdl::algebra::MatrixView<real>(derivate_output).transpose(),
+											 hidden(states[t]).transpose());
+		for(size_t c = 0; c != num_candidate; c++){
+			real* weight_data = &derivate_act_weight.data()[candidates[c] * _hidden_dim];
+			const real* candidate_data = &derivate_candidate.data()[c * _hidden_dim];
+			for(size_t i = 0; i != _hidden_dim; i++){
+				weight_data[i] += candidate_data[i];
+			}
+			candidate_col[candidates[c]] = feature_dim;
+		}
+
+        //derivate of h[t], hidden_dim x batch
+		helper.dot(derivate_states[t],
+				   abcdl::algebra::MatrixView<real>(candidate_weight).transpose(),
+				   abcdl::algebra::MatrixView<real>(derivate_output).transpose());
+	}
+
+	backward_state(batch_index, pre_weight, states, derivate_states, derivate_weight, derivate_pre_weight);
+}
+
+void LSTMLayer::farward_cell(const SeqIndex& words,
+							 const abcdl::algebra::Mat& weight,
+							 const abcdl::algebra::Mat& pre_weight,
+							 const abcdl::algebra::Mat* pre_state,
+							 abcdl::algebra::Mat& state){
+	size_t batch = words.size();
+	abcdl::algebra::Mat gate;
+	abcdl::algebra::Mat sigmoid_gate;
+	abcdl::algebra::Mat tanh_gate;
+	abcdl::algebra::Mat hidden_state;
+	abcdl::algebra::Mat cell;
+
+	size_t size = _hidden_dim * batch;
+	state.resize(6 * _hidden_dim, batch);
+	real* data = state.data();
+
+	//[i f o g] = W * h[t-1] + U * X[t], the four gates of the batch in one gemm
+	gate.set_view_data(&data[2 * size], 4 * _hidden_dim, batch);
+	if(pre_state != nullptr){
+		helper.dot(gate, abcdl::algebra::MatrixView<real>(pre_weight), hidden(*pre_state).col_range(0, batch));
+	}else{
+		gate.reset(0);
+	}
+	gather_weight(words, weight, gate);
+
+	sigmoid_gate.set_view_data(&data[2 * size], 3 * _hidden_dim, batch);
+	helper.sigmoid(sigmoid_gate, sigmoid_gate);
+	tanh_gate.set_view_data(&data[5 * size], _hidden_dim, batch);
+	_activate_func->activate(tanh_gate, tanh_gate);
+
+	//c[t] = f .* c[t-1] + i .* g
+	size_t pre_batch = pre_state != nullptr ? pre_state->cols() : 0;
+	const real* pre_cell = pre_state != nullptr ? &pre_state->data()[_hidden_dim * pre_batch] : nullptr;
+	real* cell_data = &data[size];
+	for(size_t i = 0; i != _hidden_dim; i++){
+		for(size_t b = 0; b != batch; b++){
+			size_t id = i * batch + b;
+			real value = data[2 * size + id] * data[5 * size + id];
+			if(pre_cell != nullptr){
+				value += data[3 * size + id] * pre_cell[i * pre_batch + b];
+			}
+			cell_data[id] = value;
+		}
+	}
+
+	//h[t] = o .* tanh(c[t])
+	cell.set_view_data(cell_data, _hidden_dim, batch);
+	hidden_state.set_view_data(data, _hidden_dim, batch);
+	_activate_func->activate(hidden_state, cell);
+	for(size_t id = 0; id != size; id++){
+		data[id] *= data[4 * size + id];
+	}
+}
+
+void LSTMLayer::backward_state(const SeqBatch& batch_index,
+							   abcdl::algebra::Mat& pre_weight,
+							   const std::vector<abcdl::algebra::Mat>& states,
+							   std::vector<abcdl::algebra::Mat>& derivate_states,
+							   abcdl::algebra::Mat& derivate_weight,
+							   abcdl::algebra::Mat& derivate_pre_weight){
+	size_t seq_size = states.size();
+
+	abcdl::algebra::Mat delta;
+	abcdl::algebra::Mat derivate_pre;
+	abcdl::algebra::Mat derivate_cell;
+	abcdl::algebra::Mat pre_derivate_cell;
+	abcdl::algebra::Mat cell;
+	abcdl::algebra::Mat tanh_cell;
+	abcdl::algebra::Mat tanh_derivate;
+	abcdl::algebra::Mat gate;
+	abcdl::algebra::Mat gate_derivate;
+	for(size_t s = seq_size; s != 0 ; s--){
+		size_t t = s - 1;
+		size_t batch = batch_size(batch_index, t);
+		size_t size = _hidden_dim * batch;
+		const real* data = states[t].data();
+
+		//h[t] feeds the output of t and the gates of t + 1
+		real* derivate_hidden = derivate_states[t].data();
+		size_t next_batch = t + 1 < seq_size ? derivate_pre.cols() : 0;
+		for(size_t i = 0; i != _hidden_dim; i++){
+			for(size_t b = 0; b != next_batch; b++){
+				derivate_hidden[i * batch + b] += derivate_pre.data()[i * next_batch + b];
 			}
+		}
+
+		cell.set_view_data(const_cast<real*>(&data[size]), _hidden_dim, batch);
+		_activate_func->activate(tanh_cell, cell);
+		_activate_func->derivative(tanh_derivate, tanh_cell);
+		gate.set_view_data(const_cast<real*>(&data[5 * size]), _hidden_dim, batch);
+		_activate_func->derivative(gate_derivate, gate);
 
-            //update derivate_pre_weight
-			derivate_pre_weight += helper.outer(derivate_t, derivate_state_t.transpose());
-			
-            //update derivate_weight
-			auto train_data_t = train_seq_data.get_row(bptt_step).transpose();
-            auto derivate_weight_t = helper.dot(derivate_weight, train_data_t) + derivate_t;
+		size_t pre_batch = t > 0 ? states[t - 1].cols() : 0;
+		const real* pre_cell = t > 0 ? &states[t - 1].data()[_hidden_dim * pre_batch] : nullptr;
+		delta.resize(4 * _hidden_dim, batch);
+		pre_derivate_cell.resize(_hidden_dim, batch);
+		real* delta_data = delta.data();
+		for(size_t i = 0; i != _hidden_dim; i++){
+			for(size_t b = 0; b != batch; b++){
+				size_t id = i * batch + b;
+				real i_t = data[2 * size + id];
+				real f_t = data[3 * size + id];
+				real o_t = data[4 * size + id];
+				real g_t = data[5 * size + id];
+				real c_t = pre_cell != nullptr ? pre_cell[i * pre_batch + b] : 0;
 
-            size_t idx = train_data_t.argmax(0, abcdl::algebra::Axis_type::ROW);
-            derivate_weight.set_col(idx, derivate_weight.get_col(idx) + derivate_weight_t);
+				//c[t] feeds h[t] and c[t + 1]
+				real derivate_c = derivate_hidden[id] * o_t * tanh_derivate.data()[id];
+				if(b < next_batch){
+					derivate_c += derivate_cell.data()[i * next_batch + b];
+				}
 
-			//update delta
-			if(bptt_step > 0){
-				helper.sigmoid_derivative(derivate_state_t, derivate_state_t);
-				derivate_t = pre_weight.Ts().dot(derivate_t) * derivate_state_t;
+				delta_data[id]            = derivate_c * g_t * i_t * (1 - i_t);
+				delta_data[size + id]     = derivate_c * c_t * f_t * (1 - f_t);
+				delta_data[2 * size + id] = derivate_hidden[id] * tanh_cell.data()[id] * o_t * (1 - o_t);
+				delta_data[3 * size + id] = derivate_c * i_t * gate_derivate.data()[id];
+				pre_derivate_cell.data()[id] = derivate_c * f_t;
 			}
 		}
+		std::swap(derivate_cell, pre_derivate_cell);
+
+		//update derivate_weight: column of the word of every sequence
+		scatter_weight(batch_index, t, delta, derivate_weight);
+
+		if(t > 0){
+			//update derivate_pre_weight and the derivate of h[t-1], one gemm each for the four gates
+			derivate_pre_weight += helper.dot(abcdl::algebra::MatrixView<real>(delta),
+											  hidden(states[t - 1]).col_range(0, batch).transpose());
+			helper.dot(derivate_pre,
+					   abcdl::algebra::MatrixView<real>(pre_weight).transpose(),
+					   abcdl::algebra::MatrixView<real>(delta));
+		}
 	}
 }
 
+void GRULayer::farward_cell(const SeqIndex& words,
+							const abcdl::algebra::Mat& weight,
+							const abcdl::algebra::Mat& pre_weight,
+							const abcdl::algebra::Mat* pre_state,
+							abcdl::algebra::Mat& state){
+	size_t batch = words.size();
+	size_t feature_dim = weight.cols();
+	abcdl::algebra::Mat gate;
+	abcdl::algebra::Mat sigmoid_gate;
+	abcdl::algebra::Mat tanh_gate;
+
+	size_t size = _hidden_dim * batch;
+	state.resize(5 * _hidden_dim, batch);
+	real* data = state.data();
+
+	//[z r n] = W * h[t-1], the three gates of the batch in one gemm
+	gate.set_view_data(&data[size], 3 * _hidden_dim, batch);
+	if(pre_state != nullptr){
+		helper.dot(gate, abcdl::algebra::MatrixView<real>(pre_weight), hidden(*pre_state).col_range(0, batch));
+	}else{
+		gate.reset(0);
+	}
+	memcpy(&data[4 * size], &data[3 * size], sizeof(real) * size);
+
+	//z and r take U * X[t] before the sigmoid
+	sigmoid_gate.set_view_data(&data[size], 2 * _hidden_dim, batch);
+	gather_weight(words, weight, sigmoid_gate);
+	helper.sigmoid(sigmoid_gate, sigmoid_gate);
+
+	//n = tanh(U_n * x[t] + r .* (W_n * h[t-1]))
+	for(size_t b = 0; b != batch; b++){
+		size_t idx = words[b];
+		CHECK(idx < feature_dim);
+		const real* weight_data = &weight.data()[2 * _hidden_dim * feature_dim + idx];
+		for(size_t i = 0; i != _hidden_dim; i++){
+			size_t id = i * batch + b;
+			data[3 * size + id] = weight_data[i * feature_dim] + data[2 * size + id] * data[4 * size + id];
+		}
+	}
+	tanh_gate.set_view_data(&data[3 * size], _hidden_dim, batch);
+	_activate_func->activate(tanh_gate, tanh_gate);
+
+	//h[t] = (1 - z) .* n + z .* h[t-1]
+	size_t pre_batch = pre_state != nullptr ? pre_state->cols() : 0;
+	const real* pre_hidden = pre_state != nullptr ? pre_state->data() : nullptr;
+	for(size_t i = 0; i != _hidden_dim; i++){
+		for(size_t b = 0; b != batch; b++){
+			size_t id = i * batch + b;
+			real z_t = data[size + id];
+			real value = (1 - z_t) * data[3 * size + id];
+			if(pre_hidden != nullptr){
+				value += z_t * pre_hidden[i * pre_batch + b];
+			}
+			data[id] = value;
+		}
+	}
+}
+
+void GRULayer::backward_state(const SeqBatch& batch_index,
+							  abcdl::algebra::Mat& pre_weight,
+							  const std::vector<abcdl::algebra::Mat>& states,
+							  std::vector<abcdl::algebra::Mat>& derivate_states,
+							  abcdl::algebra::Mat& derivate_weight,
+							  abcdl::algebra::Mat& derivate_pre_weight){
+	size_t seq_size = states.size();
+
+	abcdl::algebra::Mat delta;
+	abcdl::algebra::Mat pre_delta;
+	abcdl::algebra::Mat derivate_pre;
+	abcdl::algebra::Mat derivate_direct;
+	abcdl::algebra::Mat gate;
+	abcdl::algebra::Mat gate_derivate;
+	for(size_t s = seq_size; s != 0 ; s--){
+		size_t t = s - 1;
+		size_t batch = batch_size(batch_index, t);
+		size_t size = _hidden_dim * batch;
+		const real* data = states[t].data();
+
+		//h[t] feeds the output of t and the gates and h of t + 1
+		real* derivate_hidden = derivate_states[t].data();
+		size_t next_batch = t + 1 < seq_size ? derivate_pre.cols() : 0;
+		for(size_t i = 0; i != _hidden_dim; i++){
+			for(size_t b = 0; b != next_batch; b++){
+				derivate_hidden[i * batch + b] += derivate_pre.data()[i * next_batch + b];
+			}
+		}
+
+		gate.set_view_data(const_cast<real*>(&data[3 * size]), _hidden_dim, batch);
+		_activate_func->derivative(gate_derivate, gate);
+
+		//delta of [z r n] before their activation for U, pre_delta of W * h[t-1] for W
+		size_t pre_batch = t > 0 ? states[t - 1].cols() : 0;
+		const real* pre_hidden = t > 0 ? states[t - 1].data() : nullptr;
+		delta.resize(3 * _hidden_dim, batch);
+		pre_delta.resize(3 * _hidden_dim, batch);
+		derivate_direct.resize(_hidden_dim, batch);
+		real* delta_data = delta.data();
+		real* pre_delta_data = pre_delta.data();
+		for(size_t i = 0; i != _hidden_dim; i++){
+			for(size_t b = 0; b != batch; b++){
+				size_t id = i * batch + b;
+				real z_t = data[size + id];
+				real r_t = data[2 * size + id];
+				real n_t = data[3 * size + id];
+				real h_t = pre_hidden != nullptr ? pre_hidden[i * pre_batch + b] : 0;
+				real derivate_h = derivate_hidden[id];
+
+				real derivate_n = derivate_h * (1 - z_t) * gate_derivate.data()[id];
+				real derivate_z = derivate_h * (h_t - n_t) * z_t * (1 - z_t);
+				real derivate_r = derivate_n * data[4 * size + id] * r_t * (1 - r_t);
+
+				delta_data[id]                = derivate_z;
+				delta_data[size + id]         = derivate_r;
+				delta_data[2 * size + id]     = derivate_n;
+				pre_delta_data[id]            = derivate_z;
+				pre_delta_data[size + id]     = derivate_r;
+				pre_delta_data[2 * size + id] = derivate_n * r_t;
+				derivate_direct.data()[id]    = derivate_h * z_t;
+			}
+		}
+
+		//update derivate_weight: column of the word of every sequence
+		scatter_weight(batch_index, t, delta, derivate_weight);
+
+		if(t > 0){
+			//update derivate_pre_weight and the derivate of h[t-1], one gemm each for the three gates
+			derivate_pre_weight += helper.dot(abcdl::algebra::MatrixView<real>(pre_delta),
+											  hidden(states[t - 1]).col_range(0, batch).transpose());
+			helper.dot(derivate_pre,
+					   abcdl::algebra::MatrixView<real>(pre_weight).transpose(),
+					   abcdl::algebra::MatrixView<real>(pre_delta));
+			derivate_pre += derivate_direct;
+		}
+	}
+}
 
 }//namespace rnn
 }//namespace abcdl
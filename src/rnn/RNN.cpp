@@ -1,7 +1,7 @@
 /***********************************************
  * Author: Jun Jiang - jiangjun4@sina.com
  * Create: 2017-09-05 16:06
- * Last modified : 2017-09-05 16:06
+ * Last modified : 2026-10-17 21:40
  * Filename      : RNN.cpp
  * Description   : 
  **********************************************/
@@ -9,97 +9,298 @@
 #include "rnn/RNN.h"
 #include "utils/Log.h"
 #include "utils/Shuffler.h"
+#include "utils/ThreadPool.h"
 #include <functional>
+#include <algorithm>
 
 namespace abcdl{
 namespace rnn{
 
+//one-hot rows to word indices
+static void to_index(const abcdl::algebra::MatSet& seq_data, SeqIndexSet& seq_index){
+    seq_index.resize(seq_data.size());
+    for(size_t i = 0; i != seq_data.size(); i++){
+        auto mat_index = seq_data[i].argmax(abcdl::algebra::Axis_type::ROW);
+        seq_index[i].assign(mat_index.data(), mat_index.data() + mat_index.get_size());
+    }
+}
+
+//mats[0] += mats[1] + ... + mats[n - 1], pairs are added in parallel, log2(n) rounds
+static void tree_reduce(std::vector<abcdl::algebra::Mat>& mats){
+    size_t size = mats.size();
+    for(size_t stride = 1; stride < size; stride *= 2){
+        size_t num_task = (size + 2 * stride - 1) / (2 * stride);
+        abcdl::utils::ThreadPool::get_instance().parallel_run(num_task,
+            [&mats, size, stride](size_t k){
+                size_t id = 2 * stride * k;
+                if(id + stride < size){
+                    mats[id] += mats[id + stride];
+                }
+            }
+        );
+    }
+}
+
 void RNN::train(const abcdl::algebra::MatSet& train_seq_data,
                 const abcdl::algebra::MatSet& train_seq_label){
 	if(!check_data(train_seq_data, train_seq_label)){
         printf("RNN::sgd Data dim Error.\n");
 		return ;
 	}
+
+    //x[t] and y[t] are one-hot, batches only need their indices
+    SeqIndexSet train_seq_index;
+    SeqIndexSet train_seq_label_index;
+    to_index(train_seq_data, train_seq_index);
+    to_index(train_seq_label, train_seq_label_index);
+    train(train_seq_index, train_seq_label_index);
+}
+
+void RNN::train(const SeqIndexSet& train_seq_index,
+                const SeqIndexSet& train_seq_label){
+	if(!check_data(train_seq_index, train_seq_label)){
+        printf("RNN::sgd Data dim Error.\n");
+		return ;
+	}
 	
-	size_t num_train_data = train_seq_data.size();
+	size_t num_train_data = train_seq_index.size();
     abcdl::utils::Shuffler shuffler(num_train_data);
 	auto now = []{return std::chrono::system_clock::now();};
 
-	abcdl::algebra::Mat state;
-	abcdl::algebra::Mat activation;
-	
-	abcdl::algebra::Mat batch_derivate_weight(_U.rows(), _U.cols());
-	abcdl::algebra::Mat batch_derivate_pre_weight(_W.rows(), _W.cols());
-	abcdl::algebra::Mat batch_derivate_act_weight(_V.rows(), _V.cols());
+	//gradients of every shard, those of shard 0 take the sum
+	size_t num_shard = std::max(static_cast<size_t>(1), std::min(_num_shard, _mini_batch_size));
+	std::vector<abcdl::algebra::Mat> batch_derivate_weights;
+	std::vector<abcdl::algebra::Mat> batch_derivate_pre_weights;
+	std::vector<abcdl::algebra::Mat> batch_derivate_act_weights;
+	for(size_t k = 0; k != num_shard; k++){
+		batch_derivate_weights.emplace_back(_U.rows(), _U.cols());
+		batch_derivate_pre_weights.emplace_back(_W.rows(), _W.cols());
+		batch_derivate_act_weights.emplace_back(_V.rows(), _V.cols());
+	}
+	abcdl::algebra::Mat& batch_derivate_weight = batch_derivate_weights[0];
+	abcdl::algebra::Mat& batch_derivate_pre_weight = batch_derivate_pre_weights[0];
+	abcdl::algebra::Mat& batch_derivate_act_weight = batch_derivate_act_weights[0];
+	//the sampled softmax of a shard changes its sampler, the temporaries of a shard come from its arena
+	std::vector<Sampler> samplers;
+	for(size_t k = 0; k != num_shard; k++){
+		samplers.emplace_back(_seed + k);
+	}
+	std::vector<abcdl::algebra::ArenaAllocator> arenas(num_shard);
 
+	SeqBatch batch_index;
+	SeqBatch batch_label;
+	std::vector<SeqBatch> shard_index(num_shard);
+	std::vector<SeqBatch> shard_label(num_shard);
 	for(size_t i = 0; i != _epoch; i++){
         shuffler.shuffle();
 		auto start_time = now();
 
-		for(size_t j = 0; j != num_train_data; j++){
-			_layer->farward(train_seq_data[shuffler.get(j)], _U, _W, _V, state, activation);
-			_layer->backward(train_seq_data[shuffler.get(j)], train_seq_label[shuffler.get(j)], _U, _W, _V, state, activation, batch_derivate_weight, batch_derivate_pre_weight, batch_derivate_act_weight);
+		for(size_t j = 0; j < num_train_data; j += _mini_batch_size){
+			//a mini batch is one packed batch, the whole of it advances every step
+			size_t n = std::min(_mini_batch_size, num_train_data - j);
+			std::vector<size_t> ids(n);
+			for(size_t k = 0; k != n; k++){
+				ids[k] = shuffler.get(j + k);
+			}
+			pack(ids, train_seq_index, train_seq_label, batch_index, batch_label);
+
+			if(num_shard == 1){
+				backward_batch(batch_index, batch_label, samplers[0], arenas[0], batch_derivate_weight, batch_derivate_pre_weight, batch_derivate_act_weight);
+			}else{
+				//dealt round robin, every shard stays longest first and gets as many words
+				for(size_t k = 0; k != num_shard; k++){
+					shard_index[k].clear();
+					shard_label[k].clear();
+				}
+				for(size_t k = 0; k != n; k++){
+					shard_index[k % num_shard].push_back(batch_index[k]);
+					shard_label[k % num_shard].push_back(batch_label[k]);
+				}
+				abcdl::utils::ThreadPool::get_instance().parallel_run_coarse(num_shard,
+					[&](size_t k){
+						if(!shard_index[k].empty()){
+							backward_batch(shard_index[k], shard_label[k], samplers[k], arenas[k], batch_derivate_weights[k], batch_derivate_pre_weights[k], batch_derivate_act_weights[k]);
+						}
+					}
+				);
+				tree_reduce(batch_derivate_weights);
+				tree_reduce(batch_derivate_pre_weights);
+				tree_reduce(batch_derivate_act_weights);
+			}
 
-            if( j % _mini_batch_size == (_mini_batch_size - 1) || j == (num_train_data - 1)){
-				size_t n = j % _mini_batch_size + 1;
-    			_U -= batch_derivate_weight * (_alpha / n);
-			    _W -= batch_derivate_pre_weight * (_alpha / n);
-			    _V -= batch_derivate_act_weight * (_alpha / n);
+			{
+				abcdl::algebra::AllocatorScope scope(&_arena);
+				_U -= batch_derivate_weight * (_alpha / n);
+				_W -= batch_derivate_pre_weight * (_alpha / n);
+				_V -= batch_derivate_act_weight * (_alpha / n);
+			}
+			_arena.reset();
+			for(auto& arena : arenas){
+				arena.reset();
+			}
 
+			for(size_t k = 0; k != num_shard; k++){
+				batch_derivate_weights[k].reset(0);
+				batch_derivate_pre_weights[k].reset(0);
+				batch_derivate_act_weights[k].reset(0);
 			}
 
-            if( j % 5 == 0){
-                printf("Epoch[%ld][%ld/%ld] training...\r", i, j, num_train_data);
-            }
+            printf("Epoch[%ld][%ld/%ld] training...\r", i, j, num_train_data);
 		}
 
         if(_path != ""){
             write_model(_path);
         }
 
-        printf("Epoch[%ld] training run time: %lld ms, loss[%f] base loss[%f]\n", i, (long long int)std::chrono::duration_cast<std::chrono::milliseconds>(now() - start_time).count(), loss(train_seq_data, train_seq_label), std::log(_feature_dim));
+        printf("Epoch[%ld] training run time: %lld ms, loss[%f] base loss[%f]\n", i, (long long int)std::chrono::duration_cast<std::chrono::milliseconds>(now() - start_time).count(), loss(train_seq_index, train_seq_label), std::log(_feature_dim));
 	}
 
 	printf("training finished.\n");
 }
 
-real RNN::total_loss(const abcdl::algebra::MatSet& train_seq_data,
-                     const abcdl::algebra::MatSet& train_seq_label){
+void RNN::backward_batch(const SeqBatch& batch_index,
+                         const SeqBatch& batch_label,
+                         Sampler& sampler,
+                         abcdl::algebra::ArenaAllocator& arena,
+                         abcdl::algebra::Mat& derivate_weight,
+                         abcdl::algebra::Mat& derivate_pre_weight,
+                         abcdl::algebra::Mat& derivate_act_weight){
+    //temporaries of the step come from the arena of the shard, it is current on this thread only
+    abcdl::algebra::AllocatorScope scope(&arena);
+    std::vector<abcdl::algebra::Mat> states;
+    if(_num_sampled > 0 && _num_sampled < _feature_dim){
+        _layer->farward_state(batch_index, _U, _W, states);
+        _layer->backward_sampled(batch_index, batch_label, _num_sampled, sampler, _U, _W, _V, states, derivate_weight, derivate_pre_weight, derivate_act_weight);
+    }else{
+        std::vector<abcdl::algebra::Mat> activations;
+        _layer->farward(batch_index, _U, _W, _V, states, activations);
+        _layer->backward(batch_index, batch_label, _U, _W, _V, states, activations, derivate_weight, derivate_pre_weight, derivate_act_weight);
+    }
+}
+
+void RNN::pack(std::vector<size_t>& ids,
+               const SeqIndexSet& train_seq_index,
+               const SeqIndexSet& train_seq_label,
+               SeqBatch& batch_index,
+               SeqBatch& batch_label){
+    //longest first, equal lengths keep their order
+    std::stable_sort(ids.begin(), ids.end(), [&train_seq_index](size_t a, size_t b){
+        return train_seq_index[a].size() > train_seq_index[b].size();
+    });
+    batch_index.clear();
+    batch_label.clear();
+    for(auto id : ids){
+        batch_index.push_back(&train_seq_index[id]);
+        batch_label.push_back(&train_seq_label[id]);
+    }
+}
+
+real RNN::total_loss(const SeqIndexSet& train_seq_index,
+                     const SeqIndexSet& train_seq_label){
 
 	real loss_value = 0;
-    abcdl::algebra::Mat state;
-    abcdl::algebra::Mat activation;
+	std::vector<abcdl::algebra::Mat> states;
+	abcdl::algebra::Mat logit;
+	SeqBatch batch_index;
+	SeqBatch batch_label;
 	
-    size_t num_train_data = train_seq_data.size();
-	for(size_t j = 0; j != num_train_data; j++){
-		_layer->farward(train_seq_data[j], _U, _W, _V, state, activation);
-
-		auto mat_label = train_seq_label[j].argmax(abcdl::algebra::Axis_type::ROW);
-        size_t rows = mat_label.rows();
-        for(size_t row = 0; row != rows; row++){
-            loss_value -= std::log(activation.get_data(row, mat_label.get_data(row, 0)));
+    size_t num_train_data = train_seq_index.size();
+	for(size_t j = 0; j < num_train_data; j += _mini_batch_size){
+		size_t n = std::min(_mini_batch_size, num_train_data - j);
+		std::vector<size_t> ids(n);
+		for(size_t k = 0; k != n; k++){
+			ids[k] = j + k;
+		}
+		pack(ids, train_seq_index, train_seq_label, batch_index, batch_label);
+		_layer->farward_state(batch_index, _U, _W, states);
+
+        //exact softmax, -log(o[t][y]) = log(sum(exp(v))) - v[y] of the logits v of a step
+        for(size_t t = 0; t != states.size(); t++){
+            helper.dot(logit,
+                       abcdl::algebra::MatrixView<real>(states[t]).row_range(0, _hidden_dim).transpose(),
+                       abcdl::algebra::MatrixView<real>(_V).transpose());
+            for(size_t b = 0; b != logit.rows(); b++){
+                const real* data = &logit.data()[b * _feature_dim];
+                real max_value = *std::max_element(data, data + _feature_dim);
+                real sum = 0;
+                for(size_t k = 0; k != _feature_dim; k++){
+                    sum += std::exp(data[k] - max_value);
+                }
+                loss_value += std::log(sum) + max_value - data[(*batch_label[b])[t]];
+            }
         }
 	}
 
 	return loss_value;
 }
 
-real RNN::loss(const abcdl::algebra::MatSet& train_seq_data,
-               const abcdl::algebra::MatSet& train_seq_label){
+real RNN::loss(const SeqIndexSet& train_seq_index,
+               const SeqIndexSet& train_seq_label){
 
     //L(y, o) = - (1/N)(Sum y_n*log(o_n))
 
-    real loss_value = total_loss(train_seq_data, train_seq_label);
+    real loss_value = total_loss(train_seq_index, train_seq_label);
     size_t N = 0;
     
     size_t size = train_seq_label.size();
     for(size_t i = 0; i != size; i++){
-        N += train_seq_label[i].rows();
+        N += train_seq_label[i].size();
     }
 
     return loss_value / N;
 }
 
+void RNN::step(const size_t token_id, State& state){
+    if(token_id >= _feature_dim){
+        LOG(FATAL) << "RNN step error:" << token_id << " must be less than:" << _feature_dim;
+        return;
+    }
+    _layer->step(token_id, _U, _W, state);
+}
+
+void RNN::step(const size_t token_id, State& state, abcdl::algebra::Mat& activation){
+    step(token_id, state);
+    helper.dot(activation,
+               _layer->hidden(state.state).transpose(),
+               abcdl::algebra::MatrixView<real>(_V).transpose());
+    helper.softmax(activation, activation, abcdl::algebra::ROW);
+}
+
+void RNN::step(const size_t token_id,
+               State& state,
+               const size_t top_k,
+               std::vector<std::pair<size_t, real>>& top){
+    step(token_id, state);
+    helper.dot(state.logit,
+               _layer->hidden(state.state).transpose(),
+               abcdl::algebra::MatrixView<real>(_V).transpose());
+
+    //one pass: the softmax sum and a min-heap of the top_k logits, no o[t] is written
+    const real* data = state.logit.data();
+    real max_value = *std::max_element(data, data + _feature_dim);
+    real sum = 0;
+    size_t k = std::min(top_k, _feature_dim);
+    auto greater = [](const std::pair<size_t, real>& a, const std::pair<size_t, real>& b){
+        return a.second > b.second;
+    };
+    top.clear();
+    for(size_t i = 0; i != _feature_dim; i++){
+        sum += std::exp(data[i] - max_value);
+        if(top.size() < k){
+            top.push_back(std::make_pair(i, data[i]));
+            std::push_heap(top.begin(), top.end(), greater);
+        }else if(k > 0 && data[i] > top.front().second){
+            std::pop_heap(top.begin(), top.end(), greater);
+            top.back() = std::make_pair(i, data[i]);
+            std::push_heap(top.begin(), top.end(), greater);
+        }
+    }
+    std::sort_heap(top.begin(), top.end(), greater);
+    for(auto& word : top){
+        word.second = std::exp(word.second - max_value) / sum;
+    }
+}
+
 bool RNN::check_data(const abcdl::algebra::MatSet& train_seq_data,
               		 const abcdl::algebra::MatSet& train_seq_label){
     return train_seq_data.size() == train_seq_label.size() &&
@@ -107,6 +308,24 @@ bool RNN::check_data(const abcdl::algebra::MatSet& train_seq_data,
            train_seq_data.cols() == train_seq_label.cols();
 }			  
 
+bool RNN::check_data(const SeqIndexSet& train_seq_index,
+              		 const SeqIndexSet& train_seq_label){
+    if(train_seq_index.size() != train_seq_label.size()){
+        return false;
+    }
+    for(size_t i = 0; i != train_seq_index.size(); i++){
+        if(train_seq_index[i].size() != train_seq_label[i].size()){
+            return false;
+        }
+        for(size_t j = 0; j != train_seq_index[i].size(); j++){
+            if(train_seq_index[i][j] >= _feature_dim || train_seq_label[i][j] >= _feature_dim){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 bool RNN::load_model(const std::string& path){
     std::vector<abcdl::algebra::Mat*> models;
     if(!loader.read<real>(path, &models,"RNNMODEL") || models.size() != 3){
@@ -118,16 +337,15 @@ bool RNN::load_model(const std::string& path){
     
     _U = *(models[0]);
     _W = *(models[1]);
-    _U = *(models[2]);
+    _V = *(models[2]);
 
     _feature_dim    = _U.cols();
-    _hidden_dim     = _U.rows();
+    _hidden_dim     = _W.cols();
     _path           = path;
 
-    if(_layer != nullptr){
-        delete _layer;
-    }
-    _layer = new abcdl::rnn::Layer(_hidden_dim, _bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc());
+    size_t num_gates = _hidden_dim == 0 ? 1 : _U.rows() / _hidden_dim;
+    _cell_type = num_gates == 4 ? LSTM : (num_gates == 3 ? GRU : ELMAN);
+    create_layer();
 
     for(auto&& mat : models){
         delete mat;
@@ -137,6 +355,19 @@ bool RNN::load_model(const std::string& path){
     return true;
 }
 
+void RNN::create_layer(){
+    if(_layer != nullptr){
+        delete _layer;
+    }
+    if(_cell_type == LSTM){
+        _layer = new abcdl::rnn::LSTMLayer(_hidden_dim, _bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc());
+    }else if(_cell_type == GRU){
+        _layer = new abcdl::rnn::GRULayer(_hidden_dim, _bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc());
+    }else{
+        _layer = new abcdl::rnn::Layer(_hidden_dim, _bptt_truncate, new abcdl::framework::CrossEntropyCost(), new abcdl::framework::TanhActivateFunc());
+    }
+}
+
 bool RNN::write_model(const std::string& path){
     std::vector<abcdl::algebra::Mat*> models;
     models.push_back(&_U);
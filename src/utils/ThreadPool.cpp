@@ -0,0 +1,207 @@
+/***********************************************
+ * Author: Jun Jiang - jiangjun4@sina.com
+ * Create: 2026-10-17 10:12
+ * Last modified : 2026-10-17 10:12
+ * Filename      : ThreadPool.cpp
+ * Description   : process-wide persistent thread pool
+ **********************************************/
+#include "utils/ThreadPool.h"
+#include <stdlib.h>
+#include <limits>
+
+namespace abcdl{
+namespace utils{
+
+static const size_t NOT_WORKER = std::numeric_limits<size_t>::max();
+static thread_local size_t t_worker_id = NOT_WORKER;
+
+static size_t default_num_thread(){
+    char* env_value = getenv("ABCDL_NUM_THREAD");
+    if(env_value != nullptr && atoi(env_value) > 0){
+        return static_cast<size_t>(atoi(env_value));
+    }
+    size_t num_thread = std::thread::hardware_concurrency();
+    return num_thread == 0 ? 1 : num_thread;
+}
+
+ThreadPool& ThreadPool::get_instance(){
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool() : _num_thread(0), _num_queued(0), _num_coarse_queued(0), _next_worker(0){
+    start(default_num_thread());
+}
+
+ThreadPool::~ThreadPool(){
+    stop();
+}
+
+void ThreadPool::set_num_thread(const size_t num_thread){
+    std::lock_guard<std::mutex> resize_lock(_resize_mutex);
+    size_t new_num_thread = num_thread == 0 ? 1 : num_thread;
+    if(new_num_thread == _num_thread.load()){
+        return;
+    }
+    stop();
+    start(new_num_thread);
+}
+
+void ThreadPool::start(const size_t num_thread){
+    _stop = false;
+    _num_thread = num_thread;
+    //the calling thread of parallel_run is the last executor
+    for(size_t i = 0; i + 1 < num_thread; i++){
+        _workers.push_back(new Worker());
+    }
+    for(size_t i = 0; i != _workers.size(); i++){
+        _threads.push_back(std::thread(&ThreadPool::work, this, i));
+    }
+}
+
+void ThreadPool::stop(){
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _task_cond.notify_all();
+    for(auto& thread : _threads){
+        thread.join();
+    }
+    _threads.clear();
+    for(auto& worker : _workers){
+        delete worker;
+    }
+    _workers.clear();
+}
+
+void ThreadPool::parallel_run(const size_t num_task, const std::function<void(size_t)>& f){
+    run(num_task, f, false);
+}
+
+void ThreadPool::parallel_run_coarse(const size_t num_task, const std::function<void(size_t)>& f){
+    run(num_task, f, true);
+}
+
+void ThreadPool::run(const size_t num_task, const std::function<void(size_t)>& f, const bool coarse){
+    if(num_task == 0){
+        return;
+    }
+
+    size_t num_worker = _workers.size();
+    if(num_task == 1 || num_worker == 0){
+        for(size_t i = 0; i != num_task; i++){
+            f(i);
+        }
+        return;
+    }
+
+    TaskGroup group;
+    group.func = &f;
+    group.num_pending = num_task;
+    group.coarse = coarse;
+
+    //task 0 is kept by the calling thread, the others are dealt round-robin
+    if(coarse){
+        _num_coarse_queued += num_task - 1;
+    }
+    _num_queued += num_task - 1;
+    size_t first_worker = _next_worker.fetch_add(1);
+    for(size_t i = 1; i != num_task; i++){
+        Worker* worker = _workers[(first_worker + i) % num_worker];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.push_back(Task{&group, i});
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+    }
+    _task_cond.notify_all();
+    _done_cond.notify_all();
+
+    run_task(Task{&group, 0});
+
+    /*
+     * help the pool until all tasks of this group are finished.
+     * Waiting for fine tasks, maybe inside a coarse one, coarse tasks are
+     * left to the workers, they would pile up on this stack.
+     */
+    Task task;
+    while(group.num_pending.load() != 0){
+        if(pop_task(t_worker_id, &task, coarse)){
+            run_task(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done_cond.wait(lock, [this, &group, coarse]{
+            size_t num_queued = _num_queued.load();
+            return group.num_pending.load() == 0 ||
+                   (coarse ? num_queued != 0 : num_queued > _num_coarse_queued.load());
+        });
+    }
+}
+
+void ThreadPool::work(const size_t worker_id){
+    t_worker_id = worker_id;
+    Task task;
+    while(true){
+        if(pop_task(worker_id, &task, true)){
+            run_task(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _task_cond.wait(lock, [this]{ return _stop || _num_queued.load() != 0; });
+        if(_stop && _num_queued.load() == 0){
+            return;
+        }
+    }
+}
+
+bool ThreadPool::pop_task(const size_t worker_id, Task* task, const bool take_coarse){
+    size_t num_worker = _workers.size();
+    auto take = [this, task](std::deque<Task>& tasks, std::deque<Task>::iterator it){
+        *task = *it;
+        tasks.erase(it);
+        if(task->group->coarse){
+            --_num_coarse_queued;
+        }
+        --_num_queued;
+    };
+
+    //own deque first, LIFO keeps the most recent data in cache
+    if(worker_id < num_worker){
+        Worker* worker = _workers[worker_id];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        for(auto it = worker->tasks.end(); it != worker->tasks.begin();){
+            --it;
+            if(take_coarse || !it->group->coarse){
+                take(worker->tasks, it);
+                return true;
+            }
+        }
+    }
+
+    //steal from the front of the other deques
+    size_t start_id = worker_id < num_worker ? worker_id + 1 : 0;
+    for(size_t i = 0; i != num_worker; i++){
+        Worker* victim = _workers[(start_id + i) % num_worker];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        for(auto it = victim->tasks.begin(); it != victim->tasks.end(); ++it){
+            if(take_coarse || !it->group->coarse){
+                take(victim->tasks, it);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run_task(const Task& task){
+    (*task.group->func)(task.idx);
+    if(task.group->num_pending.fetch_sub(1) == 1){
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done_cond.notify_all();
+    }
+}
+
+}//namespace utils
+}//namespace abcdl